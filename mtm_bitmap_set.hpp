@@ -0,0 +1,1258 @@
+#ifndef MTM_BITMAP_SET_HPP_
+#define MTM_BITMAP_SET_HPP_
+
+/* The minimum of headers required */
+#include <utility>
+#include <iterator>
+#include <exception>
+#include <algorithm>
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+/* Tells the compiler that the bitmaps do not overlap, where supported */
+#ifdef __GNUC__
+#define MTM_BITMAP_SET_RESTRICT __restrict__
+#else
+#define MTM_BITMAP_SET_RESTRICT
+#endif
+
+namespace mtm {
+
+	/**
+	 * Bitmap Set Class
+	 *
+	 * template <class T>
+	 * class bitmap_set
+	 *
+	 * T - Stored data type, an integral type of at most 32 bits. Elements are
+	 * 	   ordered by operator<.
+	 *
+	 * A sibling of mtm::set for sets of integers, such as dense IDs, that
+	 * stores them in compressed bitmaps instead of in tree nodes (the
+	 * "Roaring" layout). The elements are split by their high 16 bits into
+	 * containers of up to 65536 elements, kept sorted by those bits. A
+	 * container holds the low 16 bits of its elements in one of three
+	 * representations:
+	 *  array - the sorted low bits, 2 bytes per element, used for up to
+	 *         4096 elements.
+	 *  bitmap - one bit for each of the 65536 possible low bits, 8KB for any
+	 *         number of elements. A set of dense IDs costs about one bit per
+	 *         element.
+	 *  run - the start and length of each run of consecutive elements, 4
+	 *         bytes per run. Only optimize() creates runs, and a run
+	 *         container is turned back into an array or a bitmap when it is
+	 *         modified.
+	 * insert, find and erase find the container by binary search, then
+	 * search an array or a run container, or test a single bit. The set
+	 * algebra combines two bitmaps 64 bits at a time, in loops over a fixed
+	 * number of words which the compiler vectorizes, and merges or probes
+	 * array containers.
+	 *
+	 * Iterators are bidirectional. As the elements are not stored as T, an
+	 * iterator is dereferenced to a value rather than to a reference. insert
+	 * and erase invalidate all iterators.
+	 *
+	 * The following public members are available:
+	 *
+	 * Types:
+	 *  const_iterator, value_type, result_type - as in mtm::set.
+	 *  const_reference - typedef for T, the type an iterator dereferences to.
+	 *
+	 * Functions:
+	 *  bitmap_set - constructor. initializes empty set.
+	 *  bitmap_set(first, last) - range constructor.
+	 *  begin, end, cbegin, cend - iteration, in ascending order.
+	 *  size - number of elements in set
+	 *  memory_usage - bytes of memory the set holds.
+	 *  optimize - compresses every container to its smallest representation.
+	 *  find, contains, count - as in mtm::set.
+	 *  insert - as in mtm::set.
+	 *  erase(T const& element), erase(const_iterator iter) - as in mtm::set.
+	 *  clear() - erases all elements in the set.
+	 *  operator|, operator&, operator-, operator^ and the in-place versions -
+	 *         set algebra, as in mtm::set.
+	 */
+	template<class T>
+	class bitmap_set
+	{
+		static_assert(std::is_integral<T>::value && sizeof(T) <= sizeof(uint32_t),
+				"mtm::bitmap_set holds integers of at most 32 bits");
+
+	public:
+		/** iterator type for the container */
+		class const_iterator;
+		/** element data type */
+		typedef T value_type;
+		/** what an iterator dereferences to */
+		typedef T const_reference;
+		/** set insert result type */
+		typedef std::pair<const_iterator, bool> result_type;
+
+		bitmap_set();
+		template<class InputIterator>
+		bitmap_set(InputIterator first, InputIterator last);
+
+		const_iterator begin() const;
+		const_iterator end() const;
+		const_iterator cbegin() const;
+		const_iterator cend() const;
+		/** returns the number of elements in the set */
+		int size() const;
+		/** returns the bytes of memory held by the set and its containers */
+		size_t memory_usage() const;
+		/**
+		 * optimize
+		 *  converts every container to the smallest of the three
+		 *  representations, and frees unused capacity. Worth calling once a
+		 *  set is built, especially if it has long runs of consecutive
+		 *  elements. Invalidates all iterators.
+		 */
+		void optimize();
+		/**
+		 * find
+		 *  obtain const iterator to element. If element is not in the set,
+		 *  return value compares to end().
+		 */
+		const_iterator find(T const& element) const;
+		/**
+		 * contains, count
+		 *  contains returns true if element is in the set, and count
+		 *  returns 1 if it is and 0 otherwise.
+		 */
+		bool contains(T const& element) const;
+		int count(T const& element) const;
+		/**
+		 * insert
+		 *  inserts an element to the set. Return value is as in
+		 *  mtm::set::insert.
+		 */
+		result_type insert(T const& data);
+		/**
+		 * erase(T const& element)
+		 *  erases given value from the set.
+		 *  Throws ElementNotFound() if value does not exist in the set.
+		 */
+		void erase(T const& element);
+		/**
+		 * erase(const_iterator iter)
+		 *  erases element pointed to by iterator.
+		 *  Throws InvalidIterator() if iterator does not point to an element.
+		 */
+		void erase(const_iterator iter);
+		/** erases all elements in the set */
+		void clear();
+		/**
+		 * Set algebra
+		 *  the containers of the operands are walked side by side in order of
+		 *  their high bits. Containers found in one operand only are copied
+		 *  or skipped, and pairs of containers are merged, probed or combined
+		 *  word by word. The in-place operators replace the set by the
+		 *  result, and invalidate all iterators.
+		 */
+		bitmap_set operator|(bitmap_set const& other) const;
+		bitmap_set operator&(bitmap_set const& other) const;
+		bitmap_set operator-(bitmap_set const& other) const;
+		bitmap_set operator^(bitmap_set const& other) const;
+		bitmap_set& operator|=(bitmap_set const& other);
+		bitmap_set& operator&=(bitmap_set const& other);
+		bitmap_set& operator-=(bitmap_set const& other);
+		bitmap_set& operator^=(bitmap_set const& other);
+		//--------------- Exception types: -------------
+		class Exception: public std::exception
+		{
+		};
+		class ElementNotFound: public Exception
+		{
+		};
+		class InvalidIterator: public Exception
+		{
+		};
+
+	private:
+		/** Representation of the low bits of a container */
+		enum ContainerType {
+			ARRAY, BITMAP, RUN
+		};
+
+		/** The elements sharing their high 16 bits */
+		struct Container {
+			/** The high 16 bits of the elements */
+			uint16_t key;
+			ContainerType type;
+			/** Number of elements in the container */
+			int cardinality;
+			/** ARRAY: the sorted low bits. RUN: start and length - 1 of runs */
+			std::vector<uint16_t> values;
+			/** BITMAP: bit i of word w is set if the low bits 64w + i are */
+			std::vector<uint64_t> words;
+		};
+
+		enum Operation {
+			UNION, INTERSECTION, DIFFERENCE, SYMMETRIC_DIFFERENCE
+		};
+
+		/** Largest array container, which takes as much memory as a bitmap */
+		static const int arrayMax = 4096;
+		/** Number of words of a bitmap container */
+		static const int bitmapWords = 65536 / 64;
+
+		/** The containers, sorted by key and never empty */
+		std::vector<Container> m_Containers;
+		/** Number of elements in all containers */
+		size_t m_Size;
+
+		/**
+		 * Elements are stored as 32 bits, flipping the sign bit of signed
+		 * types so that unsigned order of the bits is the order of T.
+		 */
+		static const uint32_t signFlip = std::is_signed<T>::value ? 0x80000000u
+				: 0;
+		static uint32_t encode(T element);
+		static T decode(uint16_t key, int low);
+
+		/** Index of the first container whose key is not less than key */
+		size_t lowerContainer(uint16_t key) const;
+		bitmap_set combine(bitmap_set const& other, Operation operation) const;
+
+		/** Bit tricks, mapped to the instructions where available */
+		static int popcount(uint64_t word);
+		static int lowestBit(uint64_t word);
+		static int highestBit(uint64_t word);
+		/** First set bit at or after from, -1 if none */
+		static int nextBit(std::vector<uint64_t> const& words, int from);
+		/** Last set bit at or before from, -1 if none */
+		static int previousBit(std::vector<uint64_t> const& words, int from);
+
+		/** Index of the run holding low, -1 if none */
+		static int findRun(Container const& container, int low);
+		/**
+		 * Position of low in the container, used by iterators: the index of
+		 * the element in an array, low itself in a bitmap, the index of the
+		 * run holding it in a run container. Returns false if low is not in
+		 * the container.
+		 */
+		static bool locate(Container const& container, int low, int& index);
+		static bool contains(Container const& container, int low);
+		/** Adds or removes low, and returns false if nothing changed */
+		static bool add(Container& container, int low);
+		static bool remove(Container& container, int low);
+
+		/**
+		 * Container iteration. index and low are as in locate(), and seekNext
+		 * and seekPrevious return false when they pass the end or the
+		 * beginning of the container.
+		 */
+		static void seekFirst(Container const& container, int& index, int& low);
+		static void seekLast(Container const& container, int& index, int& low);
+		static bool seekNext(Container const& container, int& index, int& low);
+		static bool seekPrevious(Container const& container, int& index,
+				int& low);
+
+		/** Conversions between the representations */
+		static void toBitmap(Container& container);
+		static void toArray(Container& container);
+		/** Converts a run container to an array or to a bitmap */
+		static void expand(Container& container);
+		static int countRuns(Container const& container);
+		static void optimize(Container& container);
+
+		/** The words of a container, converted to scratch unless a bitmap */
+		static uint64_t const* wordsOf(Container const& container,
+				std::vector<uint64_t>& scratch);
+		/** Result of operation on two containers with the same key */
+		static Container combine(Container const& left, Container const& right,
+				Operation operation);
+		/** Combines two bitmaps word by word into words */
+		static void combineWords(uint64_t* MTM_BITMAP_SET_RESTRICT words,
+				uint64_t const* MTM_BITMAP_SET_RESTRICT left,
+				uint64_t const* MTM_BITMAP_SET_RESTRICT right,
+				Operation operation);
+		/** Which elements an operation keeps */
+		static bool keepsLeft(Operation operation);
+		static bool keepsRight(Operation operation);
+		static bool keepsBoth(Operation operation);
+	};
+
+	///////////
+	// iterator
+	///////////
+
+	/**
+	 * Const iterator class for the bitmap set. Holds the container of the
+	 * element and its position there, and decodes the element when it is
+	 * dereferenced.
+	 */
+	template<class T>
+	class bitmap_set<T>::const_iterator
+	{
+	public:
+		/** Iterator traits. Elements are computed, so reference is a value */
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T const* pointer;
+		typedef T reference;
+
+		/** Prefix and postfix operators to advance the iterator */
+		const_iterator & operator++()
+		{
+			std::vector<Container> const& containers = m_Owner->m_Containers;
+			if (m_Container < containers.size()
+					&& !seekNext(containers[m_Container], m_Index, m_Low)) {
+				moveTo(m_Container + 1, true);
+			}
+			return *this;
+		}
+		const_iterator operator++(int)
+		{
+			const_iterator newIterator(*this);
+			++*this;
+			return newIterator;
+		}
+
+		/**
+		 * Prefix and postfix operators to move the iterator back. Moving
+		 * back from end() reaches the last element, and from the first
+		 * element reaches end().
+		 */
+		const_iterator & operator--()
+		{
+			std::vector<Container> const& containers = m_Owner->m_Containers;
+			if (m_Container == containers.size()) {
+				moveTo(containers.size() - 1, false);
+			} else if (!seekPrevious(containers[m_Container], m_Index, m_Low)) {
+				moveTo(m_Container - 1, false);
+			}
+			return *this;
+		}
+		const_iterator operator--(int)
+		{
+			const_iterator newIterator(*this);
+			--*this;
+			return newIterator;
+		}
+
+		/**
+		 * Dereference operator to obtain value the iterator points to.
+		 * Throws InvalidIterator() if the iterator does not point to an
+		 * element.
+		 */
+		T operator*() const
+		{
+			if (m_Container >= m_Owner->m_Containers.size()) {
+				throw InvalidIterator();
+			}
+			return decode(m_Owner->m_Containers[m_Container].key, m_Low);
+		}
+
+		const_iterator(const_iterator const&) = default;
+		const_iterator& operator=(const_iterator const&) = default;
+		~const_iterator() = default;
+
+		bool operator==(const_iterator const& other) const
+		{
+			return m_Container == other.m_Container && m_Low == other.m_Low;
+		}
+		bool operator!=(const_iterator const& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		friend class bitmap_set;
+
+		/** Set object the iterator belongs to */
+		bitmap_set<T> const* m_Owner;
+
+		/** Index of the container, the number of containers at end() */
+		size_t m_Container;
+
+		/** Position of the element in the container, as in locate() */
+		int m_Index;
+
+		/** Low 16 bits of the element, 0 at end() */
+		int m_Low;
+
+		const_iterator(bitmap_set<T> const* owner, size_t container, int index,
+				int low) :
+				m_Owner(owner), m_Container(container), m_Index(index),
+				m_Low(low)
+		{
+		}
+
+		/**
+		 * Moves to the first or the last element of a container, or to end()
+		 * if there is no such container.
+		 */
+		void moveTo(size_t container, bool first)
+		{
+			std::vector<Container> const& containers = m_Owner->m_Containers;
+			m_Container = container;
+			if (container >= containers.size()) {
+				m_Container = containers.size();
+				m_Index = 0;
+				m_Low = 0;
+			} else if (first) {
+				seekFirst(containers[container], m_Index, m_Low);
+			} else {
+				seekLast(containers[container], m_Index, m_Low);
+			}
+		}
+	};
+
+	///////////
+	// bitmap_set funcs
+	///////////
+
+	template<class T>
+	bitmap_set<T>::bitmap_set() :
+			m_Size(0)
+	{
+	}
+
+	template<class T>
+	template<class InputIterator>
+	bitmap_set<T>::bitmap_set(InputIterator first, InputIterator last) :
+			m_Size(0)
+	{
+		for (; first != last; ++first) {
+			insert(*first);
+		}
+	}
+
+	template<class T>
+	typename bitmap_set<T>::const_iterator bitmap_set<T>::begin() const
+	{
+		const_iterator iterator(this, 0, 0, 0);
+		iterator.moveTo(0, true);
+		return iterator;
+	}
+
+	template<class T>
+	typename bitmap_set<T>::const_iterator bitmap_set<T>::end() const
+	{
+		return const_iterator(this, m_Containers.size(), 0, 0);
+	}
+
+	template<class T>
+	typename bitmap_set<T>::const_iterator bitmap_set<T>::cbegin() const
+	{
+		return begin();
+	}
+
+	template<class T>
+	typename bitmap_set<T>::const_iterator bitmap_set<T>::cend() const
+	{
+		return end();
+	}
+
+	template<class T>
+	int bitmap_set<T>::size() const
+	{
+		return static_cast<int>(m_Size);
+	}
+
+	template<class T>
+	size_t bitmap_set<T>::memory_usage() const
+	{
+		size_t bytes = sizeof(*this)
+				+ m_Containers.capacity() * sizeof(Container);
+		for (size_t i = 0; i < m_Containers.size(); i++) {
+			bytes += m_Containers[i].values.capacity() * sizeof(uint16_t)
+					+ m_Containers[i].words.capacity() * sizeof(uint64_t);
+		}
+		return bytes;
+	}
+
+	template<class T>
+	void bitmap_set<T>::optimize()
+	{
+		for (size_t i = 0; i < m_Containers.size(); i++) {
+			optimize(m_Containers[i]);
+		}
+		m_Containers.shrink_to_fit();
+	}
+
+	template<class T>
+	typename bitmap_set<T>::const_iterator bitmap_set<T>::find(
+			T const& element) const
+	{
+		uint32_t bits = encode(element);
+		size_t container = lowerContainer(static_cast<uint16_t>(bits >> 16));
+		int low = static_cast<int>(bits & 0xFFFF);
+		int index;
+		if (container == m_Containers.size()
+				|| m_Containers[container].key != bits >> 16
+				|| !locate(m_Containers[container], low, index)) {
+			return end();
+		}
+		return const_iterator(this, container, index, low);
+	}
+
+	template<class T>
+	bool bitmap_set<T>::contains(T const& element) const
+	{
+		uint32_t bits = encode(element);
+		size_t container = lowerContainer(static_cast<uint16_t>(bits >> 16));
+		return container < m_Containers.size()
+				&& m_Containers[container].key == bits >> 16
+				&& contains(m_Containers[container],
+						static_cast<int>(bits & 0xFFFF));
+	}
+
+	template<class T>
+	int bitmap_set<T>::count(T const& element) const
+	{
+		return contains(element) ? 1 : 0;
+	}
+
+	template<class T>
+	typename bitmap_set<T>::result_type bitmap_set<T>::insert(T const& data)
+	{
+		uint32_t bits = encode(data);
+		uint16_t key = static_cast<uint16_t>(bits >> 16);
+		int low = static_cast<int>(bits & 0xFFFF);
+		size_t container = lowerContainer(key);
+		if (container == m_Containers.size()
+				|| m_Containers[container].key != key) {
+			Container created;
+			created.key = key;
+			created.type = ARRAY;
+			created.cardinality = 0;
+			m_Containers.insert(m_Containers.begin() + container,
+					std::move(created));
+		}
+		bool inserted;
+		try {
+			inserted = add(m_Containers[container], low);
+		} catch (...) {
+			if (m_Containers[container].cardinality == 0) {
+				m_Containers.erase(m_Containers.begin() + container);
+			}
+			throw;
+		}
+		if (inserted) {
+			m_Size++;
+		}
+		int index;
+		locate(m_Containers[container], low, index);
+		return result_type(const_iterator(this, container, index, low),
+				inserted);
+	}
+
+	template<class T>
+	void bitmap_set<T>::erase(T const& element)
+	{
+		uint32_t bits = encode(element);
+		uint16_t key = static_cast<uint16_t>(bits >> 16);
+		size_t container = lowerContainer(key);
+		if (container == m_Containers.size()
+				|| m_Containers[container].key != key
+				|| !remove(m_Containers[container],
+						static_cast<int>(bits & 0xFFFF))) {
+			throw ElementNotFound();
+		}
+		m_Size--;
+		if (m_Containers[container].cardinality == 0) {
+			m_Containers.erase(m_Containers.begin() + container);
+		}
+	}
+
+	template<class T>
+	void bitmap_set<T>::erase(const_iterator iter)
+	{
+		erase(*iter);
+		// if iter does not point to an element, *iter will throw InvalidIterator()
+	}
+
+	template<class T>
+	void bitmap_set<T>::clear()
+	{
+		m_Containers.clear();
+		m_Size = 0;
+	}
+
+	template<class T>
+	bitmap_set<T> bitmap_set<T>::operator|(bitmap_set const& other) const
+	{
+		return combine(other, UNION);
+	}
+
+	template<class T>
+	bitmap_set<T> bitmap_set<T>::operator&(bitmap_set const& other) const
+	{
+		return combine(other, INTERSECTION);
+	}
+
+	template<class T>
+	bitmap_set<T> bitmap_set<T>::operator-(bitmap_set const& other) const
+	{
+		return combine(other, DIFFERENCE);
+	}
+
+	template<class T>
+	bitmap_set<T> bitmap_set<T>::operator^(bitmap_set const& other) const
+	{
+		return combine(other, SYMMETRIC_DIFFERENCE);
+	}
+
+	template<class T>
+	bitmap_set<T>& bitmap_set<T>::operator|=(bitmap_set const& other)
+	{
+		*this = combine(other, UNION);
+		return *this;
+	}
+
+	template<class T>
+	bitmap_set<T>& bitmap_set<T>::operator&=(bitmap_set const& other)
+	{
+		*this = combine(other, INTERSECTION);
+		return *this;
+	}
+
+	template<class T>
+	bitmap_set<T>& bitmap_set<T>::operator-=(bitmap_set const& other)
+	{
+		*this = combine(other, DIFFERENCE);
+		return *this;
+	}
+
+	template<class T>
+	bitmap_set<T>& bitmap_set<T>::operator^=(bitmap_set const& other)
+	{
+		*this = combine(other, SYMMETRIC_DIFFERENCE);
+		return *this;
+	}
+
+	///////////
+	// private bitmap_set funcs
+	///////////
+
+	template<class T>
+	uint32_t bitmap_set<T>::encode(T element)
+	{
+		return static_cast<uint32_t>(element) ^ signFlip;
+	}
+
+	template<class T>
+	T bitmap_set<T>::decode(uint16_t key, int low)
+	{
+		// the conversion of the bits to a signed T wraps around
+		return static_cast<T>(
+				((static_cast<uint32_t>(key) << 16 | static_cast<uint32_t>(low))
+						^ signFlip));
+	}
+
+	template<class T>
+	size_t bitmap_set<T>::lowerContainer(uint16_t key) const
+	{
+		size_t low = 0;
+		size_t high = m_Containers.size();
+		while (low < high) {
+			size_t middle = low + (high - low) / 2;
+			if (m_Containers[middle].key < key) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		return low;
+	}
+
+	template<class T>
+	bitmap_set<T> bitmap_set<T>::combine(bitmap_set const& other,
+			Operation operation) const
+	{
+		std::vector<Container> const& left = m_Containers;
+		std::vector<Container> const& right = other.m_Containers;
+		bitmap_set result;
+		size_t i = 0;
+		size_t j = 0;
+		while (i < left.size() || j < right.size()) {
+			if (j == right.size()
+					|| (i < left.size() && left[i].key < right[j].key)) {
+				if (keepsLeft(operation)) {
+					result.m_Containers.push_back(left[i]);
+				}
+				i++;
+			} else if (i == left.size() || right[j].key < left[i].key) {
+				if (keepsRight(operation)) {
+					result.m_Containers.push_back(right[j]);
+				}
+				j++;
+			} else {
+				Container combined = combine(left[i], right[j], operation);
+				if (combined.cardinality > 0) {
+					result.m_Containers.push_back(std::move(combined));
+				}
+				i++;
+				j++;
+			}
+		}
+		for (size_t k = 0; k < result.m_Containers.size(); k++) {
+			result.m_Size += result.m_Containers[k].cardinality;
+		}
+		return result;
+	}
+
+	template<class T>
+	int bitmap_set<T>::popcount(uint64_t word)
+	{
+#if defined(__GNUC__) && defined(__POPCNT__)
+		return __builtin_popcountll(word);
+#else
+		// without the instruction the builtin is a library call, while this
+		// vectorizes in the loops over whole bitmaps
+		word -= (word >> 1) & 0x5555555555555555ull;
+		word = (word & 0x3333333333333333ull)
+				+ ((word >> 2) & 0x3333333333333333ull);
+		word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return static_cast<int>((word * 0x0101010101010101ull) >> 56);
+#endif
+	}
+
+	template<class T>
+	int bitmap_set<T>::lowestBit(uint64_t word)
+	{
+		assert(word != 0);
+#if defined(__GNUC__)
+		return __builtin_ctzll(word);
+#else
+		int bit = 0;
+		while ((word & 1) == 0) {
+			word >>= 1;
+			bit++;
+		}
+		return bit;
+#endif
+	}
+
+	template<class T>
+	int bitmap_set<T>::highestBit(uint64_t word)
+	{
+		assert(word != 0);
+#if defined(__GNUC__)
+		return 63 - __builtin_clzll(word);
+#else
+		int bit = 63;
+		while ((word >> 63) == 0) {
+			word <<= 1;
+			bit--;
+		}
+		return bit;
+#endif
+	}
+
+	template<class T>
+	int bitmap_set<T>::nextBit(std::vector<uint64_t> const& words, int from)
+	{
+		int w = from >> 6;
+		uint64_t word = words[w] & (~0ull << (from & 63));
+		while (word == 0) {
+			if (++w == bitmapWords) {
+				return -1;
+			}
+			word = words[w];
+		}
+		return w * 64 + lowestBit(word);
+	}
+
+	template<class T>
+	int bitmap_set<T>::previousBit(std::vector<uint64_t> const& words, int from)
+	{
+		int w = from >> 6;
+		uint64_t word = words[w] & (~0ull >> (63 - (from & 63)));
+		while (word == 0) {
+			if (w == 0) {
+				return -1;
+			}
+			word = words[--w];
+		}
+		return w * 64 + highestBit(word);
+	}
+
+	template<class T>
+	int bitmap_set<T>::findRun(Container const& container, int low)
+	{
+		std::vector<uint16_t> const& runs = container.values;
+		// find the last run starting at or before low
+		int first = 0;
+		int last = static_cast<int>(runs.size() / 2);
+		while (first < last) {
+			int middle = first + (last - first) / 2;
+			if (runs[2 * middle] <= low) {
+				first = middle + 1;
+			} else {
+				last = middle;
+			}
+		}
+		int run = first - 1;
+		if (run >= 0 && low - runs[2 * run] <= runs[2 * run + 1]) {
+			return run;
+		}
+		return -1;
+	}
+
+	template<class T>
+	bool bitmap_set<T>::locate(Container const& container, int low, int& index)
+	{
+		switch (container.type) {
+		case ARRAY: {
+			std::vector<uint16_t>::const_iterator position = std::lower_bound(
+					container.values.begin(), container.values.end(), low);
+			index = static_cast<int>(position - container.values.begin());
+			return position != container.values.end() && *position == low;
+		}
+		case BITMAP:
+			index = low;
+			return (container.words[low >> 6] >> (low & 63) & 1) != 0;
+		default:
+			index = findRun(container, low);
+			return index >= 0;
+		}
+	}
+
+	template<class T>
+	bool bitmap_set<T>::contains(Container const& container, int low)
+	{
+		int index;
+		return locate(container, low, index);
+	}
+
+	template<class T>
+	bool bitmap_set<T>::add(Container& container, int low)
+	{
+		if (container.type == RUN) {
+			if (findRun(container, low) >= 0) {
+				return false;
+			}
+			expand(container);
+		}
+		if (container.type == ARRAY) {
+			std::vector<uint16_t>::iterator position = std::lower_bound(
+					container.values.begin(), container.values.end(), low);
+			if (position != container.values.end() && *position == low) {
+				return false;
+			}
+			if (container.cardinality < arrayMax) {
+				container.values.insert(position, static_cast<uint16_t>(low));
+				container.cardinality++;
+				return true;
+			}
+			toBitmap(container);
+		}
+		uint64_t& word = container.words[low >> 6];
+		uint64_t bit = 1ull << (low & 63);
+		if ((word & bit) != 0) {
+			return false;
+		}
+		word |= bit;
+		container.cardinality++;
+		return true;
+	}
+
+	template<class T>
+	bool bitmap_set<T>::remove(Container& container, int low)
+	{
+		if (container.type == RUN) {
+			if (findRun(container, low) < 0) {
+				return false;
+			}
+			expand(container);
+		}
+		if (container.type == ARRAY) {
+			std::vector<uint16_t>::iterator position = std::lower_bound(
+					container.values.begin(), container.values.end(), low);
+			if (position == container.values.end() || *position != low) {
+				return false;
+			}
+			container.values.erase(position);
+			container.cardinality--;
+			return true;
+		}
+		uint64_t& word = container.words[low >> 6];
+		uint64_t bit = 1ull << (low & 63);
+		if ((word & bit) == 0) {
+			return false;
+		}
+		word &= ~bit;
+		container.cardinality--;
+		// converting at half the array limit keeps a container hovering
+		// around the limit from being converted back and forth
+		if (container.cardinality <= arrayMax / 2) {
+			try {
+				toArray(container);
+			} catch (std::bad_alloc&) {
+				// the element is gone either way, the container stays a bitmap
+			}
+		}
+		return true;
+	}
+
+	template<class T>
+	void bitmap_set<T>::seekFirst(Container const& container, int& index,
+			int& low)
+	{
+		assert(container.cardinality > 0);
+		if (container.type == BITMAP) {
+			index = low = nextBit(container.words, 0);
+		} else {
+			index = 0;
+			low = container.values[0];
+		}
+	}
+
+	template<class T>
+	void bitmap_set<T>::seekLast(Container const& container, int& index,
+			int& low)
+	{
+		assert(container.cardinality > 0);
+		switch (container.type) {
+		case ARRAY:
+			index = container.cardinality - 1;
+			low = container.values[index];
+			break;
+		case BITMAP:
+			index = low = previousBit(container.words, 0xFFFF);
+			break;
+		default:
+			index = static_cast<int>(container.values.size() / 2) - 1;
+			low = container.values[2 * index] + container.values[2 * index + 1];
+			break;
+		}
+	}
+
+	template<class T>
+	bool bitmap_set<T>::seekNext(Container const& container, int& index,
+			int& low)
+	{
+		switch (container.type) {
+		case ARRAY:
+			if (++index >= container.cardinality) {
+				return false;
+			}
+			low = container.values[index];
+			return true;
+		case BITMAP: {
+			int next = low < 0xFFFF ? nextBit(container.words, low + 1) : -1;
+			if (next < 0) {
+				return false;
+			}
+			index = low = next;
+			return true;
+		}
+		default:
+			if (low < container.values[2 * index] + container.values[2 * index + 1]) {
+				low++;
+				return true;
+			}
+			if (2 * ++index >= static_cast<int>(container.values.size())) {
+				return false;
+			}
+			low = container.values[2 * index];
+			return true;
+		}
+	}
+
+	template<class T>
+	bool bitmap_set<T>::seekPrevious(Container const& container, int& index,
+			int& low)
+	{
+		switch (container.type) {
+		case ARRAY:
+			if (index == 0) {
+				return false;
+			}
+			low = container.values[--index];
+			return true;
+		case BITMAP: {
+			int previous = low > 0 ? previousBit(container.words, low - 1) : -1;
+			if (previous < 0) {
+				return false;
+			}
+			index = low = previous;
+			return true;
+		}
+		default:
+			if (low > container.values[2 * index]) {
+				low--;
+				return true;
+			}
+			if (index == 0) {
+				return false;
+			}
+			index--;
+			low = container.values[2 * index] + container.values[2 * index + 1];
+			return true;
+		}
+	}
+
+	template<class T>
+	void bitmap_set<T>::toBitmap(Container& container)
+	{
+		assert(container.type == ARRAY);
+		container.words.assign(bitmapWords, 0);
+		for (size_t i = 0; i < container.values.size(); i++) {
+			int low = container.values[i];
+			container.words[low >> 6] |= 1ull << (low & 63);
+		}
+		std::vector<uint16_t>().swap(container.values);
+		container.type = BITMAP;
+	}
+
+	template<class T>
+	void bitmap_set<T>::toArray(Container& container)
+	{
+		assert(container.type == BITMAP);
+		container.values.reserve(container.cardinality);
+		for (int w = 0; w < bitmapWords; w++) {
+			for (uint64_t word = container.words[w]; word != 0;
+					word &= word - 1) {
+				container.values.push_back(
+						static_cast<uint16_t>(w * 64 + lowestBit(word)));
+			}
+		}
+		std::vector<uint64_t>().swap(container.words);
+		container.type = ARRAY;
+	}
+
+	template<class T>
+	void bitmap_set<T>::expand(Container& container)
+	{
+		assert(container.type == RUN);
+		std::vector<uint16_t> runs;
+		runs.swap(container.values);
+		if (container.cardinality <= arrayMax) {
+			container.values.reserve(container.cardinality);
+			for (size_t i = 0; i < runs.size(); i += 2) {
+				for (int low = runs[i]; low <= runs[i] + runs[i + 1]; low++) {
+					container.values.push_back(static_cast<uint16_t>(low));
+				}
+			}
+			container.type = ARRAY;
+			return;
+		}
+		container.words.assign(bitmapWords, 0);
+		for (size_t i = 0; i < runs.size(); i += 2) {
+			for (int low = runs[i]; low <= runs[i] + runs[i + 1]; low++) {
+				container.words[low >> 6] |= 1ull << (low & 63);
+			}
+		}
+		container.type = BITMAP;
+	}
+
+	template<class T>
+	int bitmap_set<T>::countRuns(Container const& container)
+	{
+		switch (container.type) {
+		case ARRAY: {
+			int runs = container.cardinality > 0 ? 1 : 0;
+			for (int i = 1; i < container.cardinality; i++) {
+				runs += container.values[i] != container.values[i - 1] + 1;
+			}
+			return runs;
+		}
+		case BITMAP: {
+			// a run starts at every set bit whose lower neighbour is clear
+			int runs = 0;
+			uint64_t carry = 0;
+			for (int w = 0; w < bitmapWords; w++) {
+				uint64_t word = container.words[w];
+				runs += popcount(word & ~(word << 1 | carry));
+				carry = word >> 63;
+			}
+			return runs;
+		}
+		default:
+			return static_cast<int>(container.values.size() / 2);
+		}
+	}
+
+	template<class T>
+	void bitmap_set<T>::optimize(Container& container)
+	{
+		size_t runBytes = countRuns(container) * 2 * sizeof(uint16_t);
+		size_t otherBytes = container.cardinality <= arrayMax ?
+				container.cardinality * sizeof(uint16_t)
+				: bitmapWords * sizeof(uint64_t);
+		if (runBytes < otherBytes) {
+			if (container.type == RUN) {
+				return;
+			}
+			std::vector<uint16_t> runs;
+			runs.reserve(runBytes / sizeof(uint16_t));
+			int index;
+			int low;
+			seekFirst(container, index, low);
+			do {
+				if (!runs.empty() && low == runs[runs.size() - 2] + runs.back() + 1) {
+					runs.back()++;
+				} else {
+					runs.push_back(static_cast<uint16_t>(low));
+					runs.push_back(0);
+				}
+			} while (seekNext(container, index, low));
+			container.values.swap(runs);
+			std::vector<uint64_t>().swap(container.words);
+			container.type = RUN;
+		} else if (container.type == RUN) {
+			expand(container);
+		} else if (container.type == BITMAP
+				&& container.cardinality <= arrayMax) {
+			toArray(container);
+		}
+		container.values.shrink_to_fit();
+	}
+
+	template<class T>
+	uint64_t const* bitmap_set<T>::wordsOf(Container const& container,
+			std::vector<uint64_t>& scratch)
+	{
+		if (container.type == BITMAP) {
+			return &container.words[0];
+		}
+		scratch.assign(bitmapWords, 0);
+		int index;
+		int low;
+		seekFirst(container, index, low);
+		do {
+			scratch[low >> 6] |= 1ull << (low & 63);
+		} while (seekNext(container, index, low));
+		return &scratch[0];
+	}
+
+	template<class T>
+	typename bitmap_set<T>::Container bitmap_set<T>::combine(
+			Container const& left, Container const& right, Operation operation)
+	{
+		Container result;
+		result.key = left.key;
+		result.type = ARRAY;
+		if (left.type == ARRAY && right.type == ARRAY) {
+			// merge the sorted arrays
+			std::vector<uint16_t> const& a = left.values;
+			std::vector<uint16_t> const& b = right.values;
+			result.values.reserve(keepsRight(operation) ? a.size() + b.size()
+					: a.size());
+			size_t i = 0;
+			size_t j = 0;
+			while (i < a.size() && j < b.size()) {
+				if (a[i] < b[j]) {
+					if (keepsLeft(operation)) {
+						result.values.push_back(a[i]);
+					}
+					i++;
+				} else if (b[j] < a[i]) {
+					if (keepsRight(operation)) {
+						result.values.push_back(b[j]);
+					}
+					j++;
+				} else {
+					if (keepsBoth(operation)) {
+						result.values.push_back(a[i]);
+					}
+					i++;
+					j++;
+				}
+			}
+			if (keepsLeft(operation)) {
+				result.values.insert(result.values.end(), a.begin() + i, a.end());
+			}
+			if (keepsRight(operation)) {
+				result.values.insert(result.values.end(), b.begin() + j, b.end());
+			}
+			result.cardinality = static_cast<int>(result.values.size());
+			if (result.cardinality > arrayMax) {
+				toBitmap(result);
+			}
+			return result;
+		}
+		if (right.type == ARRAY && operation == INTERSECTION) {
+			return combine(right, left, operation);
+		}
+		if (left.type == ARRAY
+				&& (operation == INTERSECTION || operation == DIFFERENCE)) {
+			// the result is a subset of the array, probe the other container
+			bool keep = operation == INTERSECTION;
+			for (size_t i = 0; i < left.values.size(); i++) {
+				if (contains(right, left.values[i]) == keep) {
+					result.values.push_back(left.values[i]);
+				}
+			}
+			result.cardinality = static_cast<int>(result.values.size());
+			return result;
+		}
+		std::vector<uint64_t> leftScratch;
+		std::vector<uint64_t> rightScratch;
+		uint64_t const* a = wordsOf(left, leftScratch);
+		uint64_t const* b = wordsOf(right, rightScratch);
+		result.words.resize(bitmapWords);
+		combineWords(&result.words[0], a, b, operation);
+		int cardinality = 0;
+		for (int w = 0; w < bitmapWords; w++) {
+			cardinality += popcount(result.words[w]);
+		}
+		result.type = BITMAP;
+		result.cardinality = cardinality;
+		if (cardinality <= arrayMax) {
+			toArray(result);
+		}
+		return result;
+	}
+
+	template<class T>
+	void bitmap_set<T>::combineWords(uint64_t* MTM_BITMAP_SET_RESTRICT words,
+			uint64_t const* MTM_BITMAP_SET_RESTRICT left,
+			uint64_t const* MTM_BITMAP_SET_RESTRICT right, Operation operation)
+	{
+		// one loop per operation, so that each is a plain vectorizable loop
+		switch (operation) {
+		case UNION:
+			for (int w = 0; w < bitmapWords; w++) {
+				words[w] = left[w] | right[w];
+			}
+			break;
+		case INTERSECTION:
+			for (int w = 0; w < bitmapWords; w++) {
+				words[w] = left[w] & right[w];
+			}
+			break;
+		case DIFFERENCE:
+			for (int w = 0; w < bitmapWords; w++) {
+				words[w] = left[w] & ~right[w];
+			}
+			break;
+		case SYMMETRIC_DIFFERENCE:
+			for (int w = 0; w < bitmapWords; w++) {
+				words[w] = left[w] ^ right[w];
+			}
+			break;
+		}
+	}
+
+	template<class T>
+	bool bitmap_set<T>::keepsLeft(Operation operation)
+	{
+		return operation != INTERSECTION;
+	}
+
+	template<class T>
+	bool bitmap_set<T>::keepsRight(Operation operation)
+	{
+		return operation == UNION || operation == SYMMETRIC_DIFFERENCE;
+	}
+
+	template<class T>
+	bool bitmap_set<T>::keepsBoth(Operation operation)
+	{
+		return operation == UNION || operation == INTERSECTION;
+	}
+}
+
+#undef MTM_BITMAP_SET_RESTRICT
+
+#endif // #ifndef MTM_BITMAP_SET_HPP_
@@ -0,0 +1,651 @@
+#ifndef MTM_CONCURRENT_SET_HPP_
+#define MTM_CONCURRENT_SET_HPP_
+
+/* The minimum of headers required */
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace mtm {
+
+	namespace detail {
+
+		/**
+		 * Epoch based memory reclamation, shared by all concurrent sets.
+		 *
+		 * A thread announces the global epoch while it reads shared nodes (a
+		 * critical section, see guard). A node removed from a structure is
+		 * retired with the epoch of its removal, and freed once the global
+		 * epoch is two ahead: the epoch only advances when every thread in a
+		 * critical section has announced the current one, so by then no
+		 * thread can still hold a pointer to the node.
+		 *
+		 * Every thread takes one of MAX_THREADS slots on its first critical
+		 * section and returns it when it exits, after its retired nodes are
+		 * freed. A thread beyond MAX_THREADS waits for a slot.
+		 */
+		class epoch_domain
+		{
+		public:
+			/** Keeps the calling thread in a critical section. May be nested */
+			class guard
+			{
+			public:
+				guard()
+				{
+					instance().enter();
+				}
+				~guard()
+				{
+					instance().exit();
+				}
+				guard(guard const&) = delete;
+				guard& operator=(guard const&) = delete;
+			};
+
+			static epoch_domain& instance()
+			{
+				static epoch_domain domain;
+				return domain;
+			}
+
+			/**
+			 * Frees pointer with deleter once no thread can reach it. Must be
+			 * called in a critical section, after pointer was unlinked.
+			 */
+			void retire(void* pointer, void (*deleter)(void*))
+			{
+				thread_record& rec = record();
+				rec.limbo.push_back(retired(pointer, deleter,
+						m_Epoch.load(std::memory_order_relaxed)));
+				if (++rec.sinceCollect >= COLLECT_PERIOD) {
+					rec.sinceCollect = 0;
+					tryAdvance();
+					collect(rec);
+				}
+			}
+
+		private:
+			enum {
+				MAX_THREADS = 512, COLLECT_PERIOD = 64
+			};
+			/* Announced epoch of one thread, alone in its cache line */
+			struct alignas(64) slot {
+				std::atomic<uint64_t> local; // epoch << 1 | 1 when active, or 0
+				std::atomic<bool> used;
+			};
+			struct retired {
+				void* pointer;
+				void (*deleter)(void*);
+				uint64_t epoch;
+				retired(void* p, void (*d)(void*), uint64_t e) :
+						pointer(p), deleter(d), epoch(e)
+				{
+				}
+			};
+			struct thread_record {
+				int slot;
+				int depth;
+				int sinceCollect;
+				std::vector<retired> limbo;
+				thread_record() :
+						slot(instance().claimSlot()), depth(0), sinceCollect(0)
+				{
+				}
+				~thread_record()
+				{
+					epoch_domain& domain = instance();
+					while (!limbo.empty()) {
+						domain.tryAdvance();
+						domain.collect(*this);
+						if (!limbo.empty()) {
+							std::this_thread::yield();
+						}
+					}
+					domain.m_Slots[slot].used.store(false,
+							std::memory_order_release);
+				}
+			};
+
+			std::atomic<uint64_t> m_Epoch;
+			slot m_Slots[MAX_THREADS];
+
+			epoch_domain() :
+					m_Epoch(0)
+			{
+				for (int i = 0; i < MAX_THREADS; i++) {
+					m_Slots[i].local.store(0, std::memory_order_relaxed);
+					m_Slots[i].used.store(false, std::memory_order_relaxed);
+				}
+			}
+
+			static thread_record& record()
+			{
+				static thread_local thread_record rec;
+				return rec;
+			}
+
+			int claimSlot()
+			{
+				while (true) {
+					for (int i = 0; i < MAX_THREADS; i++) {
+						bool expected = false;
+						if (!m_Slots[i].used.load(std::memory_order_relaxed)
+								&& m_Slots[i].used.compare_exchange_strong(
+										expected, true)) {
+							return i;
+						}
+					}
+					std::this_thread::yield();
+				}
+			}
+
+			void enter()
+			{
+				thread_record& rec = record();
+				if (rec.depth++ > 0) {
+					return;
+				}
+				std::atomic<uint64_t>& local = m_Slots[rec.slot].local;
+				uint64_t epoch = m_Epoch.load(std::memory_order_relaxed);
+				// the announcement must be seen before the epoch moves on
+				while (true) {
+					local.store(epoch << 1 | 1, std::memory_order_release);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					uint64_t current = m_Epoch.load(std::memory_order_relaxed);
+					if (current == epoch) {
+						return;
+					}
+					epoch = current;
+				}
+			}
+
+			void exit()
+			{
+				thread_record& rec = record();
+				assert(rec.depth > 0);
+				if (--rec.depth == 0) {
+					m_Slots[rec.slot].local.store(0, std::memory_order_release);
+				}
+			}
+
+			/* Advances the epoch if all active threads have announced it */
+			void tryAdvance()
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				uint64_t epoch = m_Epoch.load(std::memory_order_relaxed);
+				for (int i = 0; i < MAX_THREADS; i++) {
+					if (!m_Slots[i].used.load(std::memory_order_relaxed)) {
+						continue;
+					}
+					// acquire, so what the thread read comes before any free
+					uint64_t local = m_Slots[i].local.load(
+							std::memory_order_acquire);
+					if ((local & 1) != 0 && (local >> 1) != epoch) {
+						return;
+					}
+				}
+				m_Epoch.compare_exchange_strong(epoch, epoch + 1);
+			}
+
+			/* Frees the retired pointers of rec that are no longer reachable */
+			void collect(thread_record& rec)
+			{
+				uint64_t epoch = m_Epoch.load(std::memory_order_acquire);
+				size_t kept = 0;
+				for (size_t i = 0; i < rec.limbo.size(); i++) {
+					if (rec.limbo[i].epoch + 2 <= epoch) {
+						rec.limbo[i].deleter(rec.limbo[i].pointer);
+					} else {
+						rec.limbo[kept++] = rec.limbo[i];
+					}
+				}
+				rec.limbo.erase(rec.limbo.begin() + kept, rec.limbo.end());
+			}
+		};
+	}
+
+	/**
+	 * Concurrent Set Class
+	 *
+	 * template <class T, class CmpFcn = std::less<T> >
+	 * class concurrent_set
+	 *
+	 * T - Stored data type
+	 * CmpFcn - Function object class performing comparison. Default is
+	 * 	   std::less<T>.
+	 *
+	 * A set that many threads may insert into, erase from and search at the
+	 * same time, without locks. The elements are kept in a lock-free skiplist
+	 * (Herlihy and Shavit): an element is removed by marking the links out of
+	 * its node, and any thread passing a marked node unlinks it. Nodes are
+	 * freed by epoch based reclamation once no thread can reach them.
+	 *
+	 * insert, erase and contains are linearizable and take O(log n) expected
+	 * time. Readers never write shared memory, and writers only write the
+	 * links around their own element, so threads working on different parts
+	 * of the set do not contend.
+	 *
+	 * The set cannot be copied, and has no iterators since elements may be
+	 * freed under them. for_each visits the elements instead. Destruction
+	 * must not race with other operations.
+	 *
+	 * The following public members are available:
+	 *
+	 * Functions:
+	 *  concurrent_set - constructor. initializes empty set.
+	 *  ~concurrent_set - destroys the set. Nodes retired by erase may be
+	 *                    freed later.
+	 *  insert - inserts element. Returns true if it was inserted, false if
+	 *           an equal element was in the set.
+	 *  erase - erases given value. Returns true if it was in the set.
+	 *  contains - true if an equal element is in the set.
+	 *  for_each - calls a function on every element, in ascending order.
+	 *             Elements inserted or erased meanwhile may or may not be
+	 *             visited.
+	 *  size - number of elements in set, counted in O(n) as in for_each.
+	 */
+	template<class T, class CmpFcn = std::less<T> >
+	class concurrent_set
+	{
+	public:
+		/** element data type */
+		typedef T value_type;
+		/** const reference to element data type */
+		typedef T const& const_reference;
+
+		concurrent_set();
+		explicit concurrent_set(CmpFcn const& cmp);
+		concurrent_set(concurrent_set const&) = delete;
+		concurrent_set& operator=(concurrent_set const&) = delete;
+		~concurrent_set();
+
+		bool insert(T const& data);
+		bool erase(T const& element);
+		bool contains(T const& element) const;
+		template<class Function>
+		void for_each(Function function) const;
+		int size() const;
+		//--------------- Exception types: -------------
+		class Exception: public std::exception
+		{
+		};
+
+	private:
+		/** Levels of the skiplist, enough for 2^32 elements */
+		enum {
+			MAX_LEVEL = 32
+		};
+		/**
+		 * Skiplist node. The links, one per level of the node, follow it in
+		 * the same allocation. The low bit of a link marks the node as
+		 * removed from that level.
+		 */
+		struct Node {
+			std::atomic<uintptr_t>* next;
+			int topLevel;
+			/* Owners of the node: its inserter until the node is linked at
+			 * all its levels, and its remover. The last one retires it */
+			std::atomic<int> owners;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+			T const& value() const
+			{
+				return *reinterpret_cast<T const*>(&storage);
+			}
+		};
+
+		Node* m_Head;
+		CmpFcn m_Cmp;
+
+		static bool isMarked(uintptr_t link);
+		static Node* pointer(uintptr_t link);
+		static Node* createNode(int topLevel);
+		static void destroyNode(Node* node, bool hasValue);
+		static void retireNode(void* node);
+		static int randomLevel();
+
+		bool less(T const& left, T const& right) const;
+		/**
+		 * Finds the predecessor and successor of element at every level,
+		 * unlinking marked nodes on the way. Returns true if succs[0] holds
+		 * an element equal to element.
+		 */
+		bool find(T const& element, Node** preds, Node** succs) const;
+		/**
+		 * Unlinks a marked node from every level. Unlike find it looks past
+		 * equal elements, since an element erased and inserted again may be
+		 * linked in front of the old node.
+		 */
+		void unlink(Node* node) const;
+		/** Gives up one owner of node, retiring it if that was the last */
+		void release(Node* node);
+	};
+
+	///////////
+	// concurrent_set funcs
+	///////////
+
+	template<class T, class CmpFcn>
+	concurrent_set<T, CmpFcn>::concurrent_set() :
+			concurrent_set(CmpFcn())
+	{
+	}
+
+	template<class T, class CmpFcn>
+	concurrent_set<T, CmpFcn>::concurrent_set(CmpFcn const& cmp) :
+			m_Head(createNode(MAX_LEVEL)), m_Cmp(cmp)
+	{
+	}
+
+	template<class T, class CmpFcn>
+	concurrent_set<T, CmpFcn>::~concurrent_set()
+	{
+		Node* node = pointer(m_Head->next[0].load(std::memory_order_acquire));
+		while (node != NULL) {
+			Node* next = pointer(node->next[0].load(std::memory_order_relaxed));
+			destroyNode(node, true);
+			node = next;
+		}
+		destroyNode(m_Head, false);
+	}
+
+	template<class T, class CmpFcn>
+	bool concurrent_set<T, CmpFcn>::insert(T const& data)
+	{
+		Node* preds[MAX_LEVEL];
+		Node* succs[MAX_LEVEL];
+		detail::epoch_domain::guard guard;
+		if (find(data, preds, succs)) {
+			return false;
+		}
+		Node* node = createNode(randomLevel());
+		try {
+			new (&node->storage) T(data);
+		} catch (...) {
+			destroyNode(node, false);
+			throw;
+		}
+		// link the bottom level, which puts the element in the set
+		while (true) {
+			for (int level = 0; level < node->topLevel; level++) {
+				node->next[level].store(reinterpret_cast<uintptr_t>(succs[level]),
+						std::memory_order_relaxed);
+			}
+			uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+			if (preds[0]->next[0].compare_exchange_strong(expected,
+					reinterpret_cast<uintptr_t>(node),
+					std::memory_order_release)) {
+				break;
+			}
+			if (find(data, preds, succs)) {
+				// never published, so no other thread has seen it
+				destroyNode(node, true);
+				return false;
+			}
+		}
+		// the upper levels only speed up searches, a concurrent erase stops
+		// linking them
+		for (int level = 1; level < node->topLevel; level++) {
+			while (true) {
+				uintptr_t link = node->next[level].load(std::memory_order_acquire);
+				if (isMarked(link)) {
+					release(node);
+					return true;
+				}
+				uintptr_t succ = reinterpret_cast<uintptr_t>(succs[level]);
+				if (link != succ && !node->next[level].compare_exchange_strong(
+						link, succ)) {
+					continue;
+				}
+				if (preds[level]->next[level].compare_exchange_strong(succ,
+						reinterpret_cast<uintptr_t>(node),
+						std::memory_order_release)) {
+					break;
+				}
+				find(data, preds, succs);
+				if (succs[0] != node) {
+					release(node); // erased meanwhile
+					return true;
+				}
+			}
+		}
+		release(node);
+		return true;
+	}
+
+	template<class T, class CmpFcn>
+	bool concurrent_set<T, CmpFcn>::erase(T const& element)
+	{
+		Node* preds[MAX_LEVEL];
+		Node* succs[MAX_LEVEL];
+		detail::epoch_domain::guard guard;
+		while (true) {
+			if (!find(element, preds, succs)) {
+				return false;
+			}
+			Node* node = succs[0];
+			for (int level = node->topLevel - 1; level > 0; level--) {
+				node->next[level].fetch_or(1);
+			}
+			// whoever marks the bottom level removes the element
+			uintptr_t link = node->next[0].load(std::memory_order_acquire);
+			while (!isMarked(link)) {
+				if (node->next[0].compare_exchange_weak(link, link | 1)) {
+					release(node);
+					return true;
+				}
+			}
+			// erased by another thread, but an equal element may be back
+		}
+	}
+
+	template<class T, class CmpFcn>
+	bool concurrent_set<T, CmpFcn>::contains(T const& element) const
+	{
+		detail::epoch_domain::guard guard;
+		Node* pred = m_Head;
+		Node* curr = NULL;
+		// like find, but steps over marked nodes instead of unlinking them
+		for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+			curr = pointer(pred->next[level].load(std::memory_order_acquire));
+			while (curr != NULL) {
+				uintptr_t link = curr->next[level].load(std::memory_order_acquire);
+				if (isMarked(link)) {
+					curr = pointer(link);
+				} else if (less(curr->value(), element)) {
+					pred = curr;
+					curr = pointer(link);
+				} else {
+					break;
+				}
+			}
+		}
+		return curr != NULL && !less(element, curr->value());
+	}
+
+	template<class T, class CmpFcn>
+	template<class Function>
+	void concurrent_set<T, CmpFcn>::for_each(Function function) const
+	{
+		detail::epoch_domain::guard guard;
+		Node* node = pointer(m_Head->next[0].load(std::memory_order_acquire));
+		while (node != NULL) {
+			uintptr_t link = node->next[0].load(std::memory_order_acquire);
+			if (!isMarked(link)) {
+				function(node->value());
+			}
+			node = pointer(link);
+		}
+	}
+
+	template<class T, class CmpFcn>
+	int concurrent_set<T, CmpFcn>::size() const
+	{
+		int count = 0;
+		for_each([&count](T const&) {
+			count++;
+		});
+		return count;
+	}
+
+	///////////
+	// private concurrent_set funcs
+	///////////
+
+	template<class T, class CmpFcn>
+	bool concurrent_set<T, CmpFcn>::isMarked(uintptr_t link)
+	{
+		return (link & 1) != 0;
+	}
+
+	template<class T, class CmpFcn>
+	typename concurrent_set<T, CmpFcn>::Node* concurrent_set<T, CmpFcn>::pointer(
+			uintptr_t link)
+	{
+		return reinterpret_cast<Node*>(link & ~static_cast<uintptr_t>(1));
+	}
+
+	template<class T, class CmpFcn>
+	typename concurrent_set<T, CmpFcn>::Node* concurrent_set<T, CmpFcn>::createNode(
+			int topLevel)
+	{
+		void* memory;
+		try {
+			memory = ::operator new(sizeof(Node)
+					+ topLevel * sizeof(std::atomic<uintptr_t>));
+		} catch (std::bad_alloc&) {
+			throw Exception();
+		}
+		Node* node = new (memory) Node;
+		node->next = reinterpret_cast<std::atomic<uintptr_t>*>(node + 1);
+		for (int level = 0; level < topLevel; level++) {
+			new (&node->next[level]) std::atomic<uintptr_t>(0);
+		}
+		node->topLevel = topLevel;
+		node->owners.store(2, std::memory_order_relaxed);
+		return node;
+	}
+
+	template<class T, class CmpFcn>
+	void concurrent_set<T, CmpFcn>::destroyNode(Node* node, bool hasValue)
+	{
+		if (hasValue) {
+			reinterpret_cast<T*>(&node->storage)->~T();
+		}
+		node->~Node();
+		::operator delete(node);
+	}
+
+	template<class T, class CmpFcn>
+	void concurrent_set<T, CmpFcn>::retireNode(void* node)
+	{
+		destroyNode(static_cast<Node*>(node), true);
+	}
+
+	template<class T, class CmpFcn>
+	int concurrent_set<T, CmpFcn>::randomLevel()
+	{
+		// xorshift, seeded apart for every thread
+		static std::atomic<uint32_t> seeds(0);
+		static thread_local uint32_t state = (seeds.fetch_add(1) + 1)
+				* 0x9E3779B9u;
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		// every level holds half the nodes of the one below
+		int level = 1;
+		for (uint32_t bits = state; (bits & 1) != 0 && level < MAX_LEVEL;
+				bits >>= 1) {
+			level++;
+		}
+		return level;
+	}
+
+	template<class T, class CmpFcn>
+	bool concurrent_set<T, CmpFcn>::less(T const& left, T const& right) const
+	{
+		return m_Cmp(left, right);
+	}
+
+	template<class T, class CmpFcn>
+	bool concurrent_set<T, CmpFcn>::find(T const& element, Node** preds,
+			Node** succs) const
+	{
+		retry: Node* pred = m_Head;
+		for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+			Node* curr = pointer(pred->next[level].load(std::memory_order_acquire));
+			while (curr != NULL) {
+				uintptr_t link = curr->next[level].load(std::memory_order_acquire);
+				if (isMarked(link)) {
+					// unlink the removed node, unless pred was removed too
+					uintptr_t expected = reinterpret_cast<uintptr_t>(curr);
+					if (!pred->next[level].compare_exchange_strong(expected,
+							link & ~static_cast<uintptr_t>(1),
+							std::memory_order_acq_rel)) {
+						goto retry;
+					}
+					curr = pointer(link);
+				} else if (less(curr->value(), element)) {
+					pred = curr;
+					curr = pointer(link);
+				} else {
+					break;
+				}
+			}
+			preds[level] = pred;
+			succs[level] = curr;
+		}
+		return succs[0] != NULL && !less(element, succs[0]->value());
+	}
+
+	template<class T, class CmpFcn>
+	void concurrent_set<T, CmpFcn>::unlink(Node* node) const
+	{
+		T const& element = node->value();
+		retry: Node* lessPred = m_Head; // the last node less than element
+		for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+			Node* pred = lessPred;
+			Node* curr = pointer(pred->next[level].load(std::memory_order_acquire));
+			while (curr != NULL) {
+				uintptr_t link = curr->next[level].load(std::memory_order_acquire);
+				if (isMarked(link)) {
+					uintptr_t expected = reinterpret_cast<uintptr_t>(curr);
+					if (!pred->next[level].compare_exchange_strong(expected,
+							link & ~static_cast<uintptr_t>(1),
+							std::memory_order_acq_rel)) {
+						goto retry;
+					}
+					curr = pointer(link);
+				} else if (less(curr->value(), element)) {
+					lessPred = pred = curr;
+					curr = pointer(link);
+				} else if (!less(element, curr->value())) {
+					pred = curr;
+					curr = pointer(link);
+				} else {
+					break;
+				}
+			}
+		}
+	}
+
+	template<class T, class CmpFcn>
+	void concurrent_set<T, CmpFcn>::release(Node* node)
+	{
+		if (node->owners.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+			return;
+		}
+		// both are done, so no level will be linked again
+		unlink(node);
+		detail::epoch_domain::instance().retire(node, retireNode);
+	}
+}
+
+#endif // #ifndef MTM_CONCURRENT_SET_HPP_
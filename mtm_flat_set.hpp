@@ -0,0 +1,329 @@
+#ifndef MTM_FLAT_SET_HPP_
+#define MTM_FLAT_SET_HPP_
+
+/* The minimum of headers required */
+#include <utility>
+#include <iterator>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <type_traits>
+#include <stddef.h>
+#include <assert.h>
+
+namespace mtm {
+
+	/**
+	 * Flat Set Class
+	 *
+	 * template <class T, class CmpFcn = std::less<T> >
+	 * class flat_set
+	 *
+	 * T - Stored data type
+	 * CmpFcn - Function object class performing comparison. Default is
+	 * 	   std::less<T>. The set stores a CmpFcn object, so comparators may
+	 * 	   have state, as in mtm::set.
+	 *
+	 * A sibling of mtm::set with the same interface and semantics, that keeps
+	 * its elements sorted in one contiguous array instead of in tree nodes.
+	 * Lookups touch a few cache lines instead of one node per level, and
+	 * elements cost no memory beyond their own size, at the price of O(n)
+	 * insert and erase. Use it for sets that are read much more than they
+	 * are modified.
+	 *
+	 * For arithmetic T compared by std::less<T>, lookups use a branchless
+	 * binary search (the comparison selects the next half with a conditional
+	 * move instead of a jump), finished by a branch-free count over the last
+	 * few elements which the compiler vectorizes.
+	 *
+	 * Iterators are random access. Unlike mtm::set, insert and erase
+	 * invalidate all iterators.
+	 *
+	 * The following public members are available:
+	 *
+	 * Types:
+	 *  const_iterator, value_type, const_reference, result_type - as in
+	 *  mtm::set.
+	 *
+	 * Functions:
+	 *  flat_set - constructor. initializes empty set.
+	 *  flat_set(CmpFcn const& cmp) - initializes empty set ordered by cmp.
+	 *  flat_set(first, last, cmp = CmpFcn()) - range constructor, sorts the
+	 *         range once.
+	 *  begin, end, cbegin, cend - iteration, in ascending order.
+	 *  size - number of elements in set
+	 *  reserve - makes room for a number of elements
+	 *  find, contains, count - as in mtm::set.
+	 *  insert - as in mtm::set.
+	 *  erase(T const& element), erase(const_iterator iter) - as in mtm::set.
+	 *  clear() - erases all elements in the set.
+	 */
+	template<class T, class CmpFcn = std::less<T> >
+	class flat_set
+	{
+	public:
+		/** iterator type for the container */
+		typedef typename std::vector<T>::const_iterator const_iterator;
+		/** element data type */
+		typedef T value_type;
+		/** const reference to element data type */
+		typedef T const& const_reference;
+		/** set insert result type */
+		typedef std::pair<const_iterator, bool> result_type;
+
+		flat_set();
+		explicit flat_set(CmpFcn const& cmp);
+		template<class InputIterator>
+		flat_set(InputIterator first, InputIterator last,
+				CmpFcn const& cmp = CmpFcn());
+
+		const_iterator begin() const;
+		const_iterator end() const;
+		const_iterator cbegin() const;
+		const_iterator cend() const;
+		/** returns the number of elements in the set */
+		int size() const;
+		/** makes room for capacity elements */
+		void reserve(int capacity);
+		/**
+		 * find
+		 *  obtain const iterator to element, in O(log n). If element is not in the set,
+		 *  return value compares to end().
+		 */
+		const_iterator find(T const& element) const;
+		/**
+		 * contains, count
+		 *  contains returns true if element is in the set, and count
+		 *  returns 1 if it is and 0 otherwise.
+		 */
+		bool contains(T const& element) const;
+		int count(T const& element) const;
+		/**
+		 * insert
+		 *  inserts an element to the set, in O(n). Return value is as in
+		 *  mtm::set::insert.
+		 */
+		result_type insert(T const& data);
+		/**
+		 * erase(T const& element)
+		 *  erases given value from the set, in O(n).
+		 *  Throws ElementNotFound() if value does not exist in the set.
+		 */
+		void erase(T const& element);
+		/**
+		 * erase(const_iterator iter)
+		 *  erases element pointed to by iterator.
+		 *  Throws InvalidIterator() if iterator does not point to an element.
+		 */
+		void erase(const_iterator iter);
+		/** erases all elements in the set */
+		void clear();
+		//--------------- Exception types: -------------
+		class Exception: public std::exception
+		{
+		};
+		class ElementNotFound: public Exception
+		{
+		};
+		class InvalidIterator: public Exception
+		{
+		};
+
+	private:
+		/** The elements, sorted by m_Cmp and distinct */
+		std::vector<T> m_Elements;
+		/** The comparator */
+		mutable CmpFcn m_Cmp;
+
+		/** true when lowerBound may use the branchless search */
+		typedef std::integral_constant<bool, std::is_arithmetic<T>::value
+				&& std::is_same<CmpFcn, std::less<T> >::value> is_branchless;
+
+		/** first element not less than element */
+		const_iterator lowerBound(T const& element) const;
+		const_iterator lowerBound(T const& element, std::true_type) const;
+		const_iterator lowerBound(T const& element, std::false_type) const;
+		/** true if the element at position is equal to element */
+		bool isEqualAt(const_iterator position, T const& element) const;
+	};
+
+	///////////
+	// flat_set funcs
+	///////////
+
+	template<class T, class CmpFcn>
+	flat_set<T, CmpFcn>::flat_set() :
+			m_Cmp()
+	{
+	}
+
+	template<class T, class CmpFcn>
+	flat_set<T, CmpFcn>::flat_set(CmpFcn const& cmp) :
+			m_Cmp(cmp)
+	{
+	}
+
+	template<class T, class CmpFcn>
+	template<class InputIterator>
+	flat_set<T, CmpFcn>::flat_set(InputIterator first, InputIterator last,
+			CmpFcn const& cmp) :
+			m_Elements(first, last), m_Cmp(cmp)
+	{
+		std::stable_sort(m_Elements.begin(), m_Elements.end(), m_Cmp);
+		// keep the first of every group of equal elements
+		CmpFcn& less = m_Cmp;
+		m_Elements.erase(std::unique(m_Elements.begin(), m_Elements.end(),
+				[&less](T const& left, T const& right) {
+					return !less(left, right);
+				}), m_Elements.end());
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::begin() const
+	{
+		return m_Elements.begin();
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::end() const
+	{
+		return m_Elements.end();
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::cbegin() const
+	{
+		return begin();
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::cend() const
+	{
+		return end();
+	}
+
+	template<class T, class CmpFcn>
+	int flat_set<T, CmpFcn>::size() const
+	{
+		return static_cast<int>(m_Elements.size());
+	}
+
+	template<class T, class CmpFcn>
+	void flat_set<T, CmpFcn>::reserve(int capacity)
+	{
+		if (capacity > 0) {
+			m_Elements.reserve(static_cast<size_t>(capacity));
+		}
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::find(
+			T const& element) const
+	{
+		const_iterator position = lowerBound(element);
+		return isEqualAt(position, element) ? position : end();
+	}
+
+	template<class T, class CmpFcn>
+	bool flat_set<T, CmpFcn>::contains(T const& element) const
+	{
+		return isEqualAt(lowerBound(element), element);
+	}
+
+	template<class T, class CmpFcn>
+	int flat_set<T, CmpFcn>::count(T const& element) const
+	{
+		return contains(element) ? 1 : 0;
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::result_type flat_set<T, CmpFcn>::insert(
+			T const& data)
+	{
+		const_iterator position = lowerBound(data);
+		if (isEqualAt(position, data)) {
+			return result_type(position, false);
+		}
+		typename std::vector<T>::iterator inserted = m_Elements.insert(
+				m_Elements.begin() + (position - m_Elements.begin()), data);
+		return result_type(inserted, true);
+	}
+
+	template<class T, class CmpFcn>
+	void flat_set<T, CmpFcn>::erase(T const& element)
+	{
+		const_iterator position = lowerBound(element);
+		if (!isEqualAt(position, element)) {
+			throw ElementNotFound();
+		}
+		m_Elements.erase(m_Elements.begin() + (position - m_Elements.begin()));
+	}
+
+	template<class T, class CmpFcn>
+	void flat_set<T, CmpFcn>::erase(const_iterator iter)
+	{
+		if (iter == end()) {
+			throw InvalidIterator();
+		}
+		m_Elements.erase(m_Elements.begin() + (iter - m_Elements.begin()));
+	}
+
+	template<class T, class CmpFcn>
+	void flat_set<T, CmpFcn>::clear()
+	{
+		m_Elements.clear();
+	}
+
+	///////////
+	// private flat_set funcs
+	///////////
+
+	template<class T, class CmpFcn>
+	bool flat_set<T, CmpFcn>::isEqualAt(const_iterator position,
+			T const& element) const
+	{
+		return position != end() && !m_Cmp(element, *position);
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::lowerBound(
+			T const& element) const
+	{
+		return lowerBound(element, is_branchless());
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::lowerBound(
+			T const& element, std::false_type) const
+	{
+		return std::lower_bound(m_Elements.begin(), m_Elements.end(), element,
+				m_Cmp);
+	}
+
+	template<class T, class CmpFcn>
+	typename flat_set<T, CmpFcn>::const_iterator flat_set<T, CmpFcn>::lowerBound(
+			T const& element, std::true_type) const
+	{
+		/* Below this many candidates a linear count is cheaper than halving */
+		const size_t linearCount = 16;
+		if (m_Elements.empty()) {
+			return end();
+		}
+		T const* base = &m_Elements[0];
+		size_t count = m_Elements.size();
+		// the answer is always in [base, base + count]
+		while (count > linearCount) {
+			size_t half = count / 2;
+			base = base[half] < element ? base + half : base;
+			count -= half;
+		}
+		size_t less = 0;
+		for (size_t i = 0; i < count; i++) {
+			less += base[i] < element ? 1 : 0;
+		}
+		return begin() + ((base + less) - &m_Elements[0]);
+	}
+}
+
+#endif // #ifndef MTM_FLAT_SET_HPP_
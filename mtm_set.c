@@ -6,9 +6,14 @@
  */
 
 #include "mtm_set.h"
+#include "mtm_set_node.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #define IF_NULL_RETURN_NULL(var) { \
 		if ( (var) == NULL) return NULL; }
@@ -17,250 +22,2337 @@
 		if ( (var) == NULL) return SET_NULL_ARGUMENT; }
 
 #define IS_SET_VALID(set) assert(set != NULL);
-/*assert ( (set)->dummy != NULL && set->size >= 0 && (set)->copyFunc != NULL \
+/*assert ( (set)->size >= 0 && (set)->copyFunc != NULL \
 		&& (set)->freeFunc != NULL && (set)->cmpFunc != NULL );*/
 
-/* The set implementation will use a list, where every node saves setElement */
-struct Node_t {
-	SetElement data;
-	struct Node_t* next;
+/* The set implementation will use an AVL tree, where every node saves
+ * setElement (see mtm_set_node.h). In an inline set (setCreateInline) the
+ * element itself is stored right after the node, and data points to it.
+ * The in-order traversal of the tree is the order induced by the compare
+ * function, and the tree is kept balanced so add, remove and contains run in
+ * O(log n). The nodes are also threaded in that order through next, so a
+ * node is an iterator and advancing it is a single pointer hop. Going back
+ * follows the parent links instead, which is O(1) amortized over a walk. */
+typedef struct SetNode_t* Node;
+
+/* Nodes are carved out of slabs owned by the set. A slab is a header followed
+ * by its nodes; released nodes go to a free list and are reused before any
+ * new slab is allocated. Clearing the set frees whole slabs. */
+struct Slab_t {
+	struct Slab_t* next;
+	size_t size; // bytes, including this header
+};
+
+typedef struct Slab_t* Slab;
+
+#define SET_NODE_ALIGNMENT 16
+#define ALIGN_SIZE(size) \
+	(((size) + SET_NODE_ALIGNMENT - 1) & ~(size_t)(SET_NODE_ALIGNMENT - 1))
+#define SLAB_MIN_NODES 16
+#define SLAB_MAX_NODES 8192
+
+/* A blocked Bloom filter of the elements of a tree (see setEnableFilter).
+ * Every element sets hashes bits within a single 64 byte block, so a lookup
+ * reads one cache line. Bits of removed elements stay set until the filter
+ * is rebuilt, which happens when the stale elements get as many as half of
+ * the elements it was sized for, or when it grows */
+struct Filter_t {
+	uint64_t* words; // blockCount blocks of FILTER_BLOCK_WORDS, NULL if none
+	size_t blockCount; // a power of 2
+	int hashes; // bits set per element
+	int capacity; // number of elements the filter was sized for
+	int stale; // removed elements whose bits are still set
+};
+
+#define FILTER_BLOCK_WORDS 8
+#define FILTER_BLOCK_BITS (FILTER_BLOCK_WORDS * 64)
+#define FILTER_MIN_CAPACITY 64
+#define FILTER_MAX_HASHES 16
+
+/* The tree and the pool its nodes come from. setCopy shares the tree of a
+ * set instead of copying it, and a set gets its own copy of a shared tree
+ * only when it is first modified (see setUnshare). */
+struct SetTree_t {
+	Node root;
+	Node first;
+	Node last;
+	int size;
+	int refCount; // number of sets sharing the tree
+	/* node pool */
+	size_t nodeSize; // bytes per node inside a slab
+	Slab slabs; // all slabs of the set, newest first
+	char* slabCursor; // first never used node in the newest slab
+	int slabUnused; // number of never used nodes from slabCursor on
+	Node freeNodes; // released nodes, linked through next
+	int freeCount;
+	int poolCapacity; // total number of nodes in all slabs
+	struct Filter_t filter; // kept by the sets with a filter enabled
 };
 
-typedef struct Node_t* Node;
+typedef struct SetTree_t* Tree;
 
 struct Set_t {
-	Node dummy;
+	Tree tree;
 	Node current;
-	int size;
-	copySetElements copyFunc;
+	copySetElements copyFunc; // NULL for an inline set
+	copySetElementsInto copyIntoFunc; // NULL unless inline
+	size_t elementSize; // 0 unless inline
 	freeSetElements freeFunc;
-	compareSetElements cmpFunc;
+	compareSetElements cmpFunc; // NULL if cmpContextFunc is used
+	compareSetElementsWithContext cmpContextFunc;
+	void* cmpContext;
+	SetAllocator allocator; // all memory of the set comes from it
+	hashSetElementsWithContext hashFunc; // NULL unless a filter is enabled
+	double filterRate; // false positive rate the filter is sized for
+	size_t filterMaxBytes; // 0 if the filter may grow without limit
+#ifdef SET_ENABLE_STATS
+	SetStats stats; // counts the work done through this set, see setGetStats
+#endif
 };
 
-Set setCreate(copySetElements copyElement, freeSetElements freeElement,
-		compareSetElements compareElements)
+/* Number of lookups setContainsBatch keeps in flight */
+#define BATCH_WIDTH 16
+
+/* Starts loading a cache line, where the compiler supports it */
+#ifdef __GNUC__
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+/* Counters are only kept when built with SET_ENABLE_STATS, and cost nothing
+ * otherwise */
+#ifdef SET_ENABLE_STATS
+#define SET_STATS_ADD(set, counter, amount) ((set)->stats.counter += (amount))
+#else
+#define SET_STATS_ADD(set, counter, amount) ((void)(set))
+#endif
+
+/* Sets sharing a tree may be used from different threads, so its reference
+ * count is updated atomically where the compiler supports it */
+#ifdef __GNUC__
+#define REF_COUNT_LOAD(count) __atomic_load_n(&(count), __ATOMIC_ACQUIRE)
+#define REF_COUNT_INCREMENT(count) \
+	__atomic_add_fetch(&(count), 1, __ATOMIC_RELAXED)
+#define REF_COUNT_DECREMENT(count) \
+	__atomic_sub_fetch(&(count), 1, __ATOMIC_ACQ_REL)
+#else
+#define REF_COUNT_LOAD(count) (count)
+#define REF_COUNT_INCREMENT(count) (++(count))
+#define REF_COUNT_DECREMENT(count) (--(count))
+#endif
+
+/* Memory helpers. All memory goes through the allocator of the set, and
+ * the blocks a set allocates besides itself are counted */
+
+static void* defaultAllocate(size_t size, void* context)
+{
+	(void)context;
+	return malloc(size);
+}
+
+static void defaultDeallocate(void* block, size_t size, void* context)
+{
+	(void)size;
+	(void)context;
+	free(block);
+}
+
+static const SetAllocator defaultAllocator = { defaultAllocate,
+		defaultDeallocate, NULL };
+
+static void* memoryAlloc(Set set, size_t size)
+{
+	void* block = set->allocator.allocate(size, set->allocator.context);
+	if (block != NULL) {
+		SET_STATS_ADD(set, allocations, 1);
+	}
+	return block;
+}
+
+/* Frees a block of size bytes from memoryAlloc, or nothing if it is NULL */
+static void memoryFree(Set set, void* block, size_t size)
+{
+	if (block == NULL) {
+		return;
+	}
+	SET_STATS_ADD(set, deallocations, 1);
+	set->allocator.deallocate(block, size, set->allocator.context);
+}
+
+/* Pool helpers */
+
+/* Adds a slab of nodeCount nodes. Never used nodes of the previous slab are
+ * moved to the free list first so they are not lost */
+static bool poolGrow(Set set, int nodeCount)
+{
+	assert(nodeCount > 0);
+	size_t size = ALIGN_SIZE(sizeof(struct Slab_t))
+			+ (size_t)nodeCount * set->tree->nodeSize;
+	Slab slab = (Slab)memoryAlloc(set, size);
+	if (slab == NULL) {
+		return false;
+	}
+	slab->size = size;
+	while (set->tree->slabUnused > 0) {
+		Node node = (Node)set->tree->slabCursor;
+		node->next = set->tree->freeNodes;
+		set->tree->freeNodes = node;
+		set->tree->freeCount++;
+		set->tree->slabCursor += set->tree->nodeSize;
+		set->tree->slabUnused--;
+	}
+	slab->next = set->tree->slabs;
+	set->tree->slabs = slab;
+	set->tree->slabCursor = (char*)slab + ALIGN_SIZE(sizeof(*slab));
+	set->tree->slabUnused = nodeCount;
+	set->tree->poolCapacity += nodeCount;
+	return true;
+}
+
+static Node poolAllocNode(Set set)
+{
+	if (set->tree->freeNodes != NULL) {
+		Node node = set->tree->freeNodes;
+		set->tree->freeNodes = node->next;
+		set->tree->freeCount--;
+		return node;
+	}
+	if (set->tree->slabUnused == 0) {
+		// slabs grow geometrically, so a set of n nodes has O(log n) slabs
+		int nodeCount = set->tree->poolCapacity;
+		if (nodeCount < SLAB_MIN_NODES) {
+			nodeCount = SLAB_MIN_NODES;
+		} else if (nodeCount > SLAB_MAX_NODES) {
+			nodeCount = SLAB_MAX_NODES;
+		}
+		if (!poolGrow(set, nodeCount)) {
+			return NULL;
+		}
+	}
+	Node node = (Node)set->tree->slabCursor;
+	set->tree->slabCursor += set->tree->nodeSize;
+	set->tree->slabUnused--;
+	return node;
+}
+
+static void poolFreeNode(Set set, Node node)
+{
+	node->next = set->tree->freeNodes;
+	set->tree->freeNodes = node;
+	set->tree->freeCount++;
+}
+
+/* Makes sure nodeCount more nodes can be allocated without a malloc */
+static bool poolReserve(Set set, int nodeCount)
+{
+	int available = set->tree->slabUnused + set->tree->freeCount;
+	if (nodeCount <= available) {
+		return true;
+	}
+	return poolGrow(set, nodeCount - available);
+}
+
+/* Frees all slabs. Every node of the set is released by this */
+static void poolRelease(Set set)
+{
+	while (set->tree->slabs != NULL) {
+		Slab nextSlab = set->tree->slabs->next;
+		memoryFree(set, set->tree->slabs, set->tree->slabs->size);
+		set->tree->slabs = nextSlab;
+	}
+	set->tree->slabCursor = NULL;
+	set->tree->slabUnused = 0;
+	set->tree->freeNodes = NULL;
+	set->tree->freeCount = 0;
+	set->tree->poolCapacity = 0;
+}
+
+/* Compares two elements by whichever compare function the set has, without
+ * counting it. Tasks running concurrently count their own comparisons */
+static inline int cmpElementsUncounted(Set set, SetElement left,
+		SetElement right)
+{
+	return set->cmpFunc != NULL ? set->cmpFunc(left, right)
+			: set->cmpContextFunc(left, right, set->cmpContext);
+}
+
+static inline int cmpElements(Set set, SetElement left, SetElement right)
+{
+	SET_STATS_ADD(set, comparisons, 1);
+	return cmpElementsUncounted(set, left, right);
+}
+
+/* Copies source into node (inline sets) or into a new element pointed to by
+ * node. Returns the new element, or NULL if copying failed. Not counted, as
+ * in cmpElementsUncounted */
+static SetElement nodeCopyElementUncounted(Set set, Node node,
+		SetElement source)
+{
+	if (set->elementSize == 0) {
+		node->data = set->copyFunc(source);
+	} else {
+		SetElement storage = (char*)node + ALIGN_SIZE(sizeof(*node));
+		node->data = set->copyIntoFunc(storage, source) == NULL ? NULL
+				: storage;
+	}
+	return node->data;
+}
+
+static SetElement nodeCopyElement(Set set, Node node, SetElement source)
+{
+	SET_STATS_ADD(set, elementCopies, 1);
+	return nodeCopyElementUncounted(set, node, source);
+}
+
+/* Frees the element held by node */
+static void nodeFreeElement(Set set, Node node)
+{
+	SET_STATS_ADD(set, elementFrees, 1);
+	set->freeFunc(node->data);
+}
+
+/* Filter helpers */
+
+/* Tells if set keeps the filter of its tree up to date. Other sets sharing
+ * the tree may keep it even after this set disabled its own */
+static bool filterIsActive(Set set)
+{
+	return set->hashFunc != NULL && set->tree->filter.words != NULL;
+}
+
+/* Hash of element with its bits mixed, as user hashes are often weak (like
+ * the identity hash of integers) */
+static uint64_t filterHash(Set set, SetElement element)
+{
+	uint64_t hash = (uint64_t)set->hashFunc(element, set->cmpContext);
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/* The low bits of hash select the block. The bits within it are picked by
+ * 9 bit windows of a second hash, rotated for every further bit */
+static void filterInsert(struct Filter_t* filter, uint64_t hash)
+{
+	uint64_t* block = filter->words
+			+ (hash & (filter->blockCount - 1)) * FILTER_BLOCK_WORDS;
+	uint64_t probe = hash * 0x9E3779B97F4A7C15ULL;
+	for (int i = 0; i < filter->hashes; i++) {
+		unsigned bit = (unsigned)(probe >> 55); // 0..FILTER_BLOCK_BITS-1
+		block[bit / 64] |= 1ULL << (bit % 64);
+		probe = (probe << 9) | (probe >> 55);
+	}
+}
+
+static bool filterTest(struct Filter_t const* filter, uint64_t hash)
+{
+	uint64_t const* block = filter->words
+			+ (hash & (filter->blockCount - 1)) * FILTER_BLOCK_WORDS;
+	uint64_t probe = hash * 0x9E3779B97F4A7C15ULL;
+	bool present = true;
+	for (int i = 0; i < filter->hashes; i++) {
+		unsigned bit = (unsigned)(probe >> 55);
+		present &= (block[bit / 64] >> (bit % 64)) & 1;
+		probe = (probe << 9) | (probe >> 55);
+	}
+	return present;
+}
+
+/* Number of blocks of a filter for capacity elements at set's false positive
+ * rate, within its memory budget. A rate of 2^-k takes k hashes and about
+ * 1.44 k bits per element */
+static size_t filterBlockCount(Set set, int capacity, int* hashes)
+{
+	int k = 0;
+	for (double rate = set->filterRate; rate < 1 && k < FILTER_MAX_HASHES;
+			rate *= 2) {
+		k++;
+	}
+	*hashes = k > 0 ? k : 1;
+	double bits = 1.44 * *hashes * capacity;
+	size_t blockCount = 1;
+	while ((double)blockCount * FILTER_BLOCK_BITS < bits) {
+		blockCount *= 2;
+	}
+	size_t blockSize = FILTER_BLOCK_WORDS * sizeof(uint64_t);
+	while (set->filterMaxBytes > 0 && blockCount > 1
+			&& blockCount * blockSize > set->filterMaxBytes) {
+		blockCount /= 2;
+	}
+	return blockCount;
+}
+
+/* Refills the filter of the tree of set with its elements, sized for
+ * capacity elements. If a filter of a new size can not be allocated the
+ * old one is refilled instead, so the filter stays correct. Returns false
+ * only if the tree had no filter and none could be allocated */
+static bool filterBuild(Set set, int capacity)
+{
+	struct Filter_t* filter = &set->tree->filter;
+	if (capacity < FILTER_MIN_CAPACITY) {
+		capacity = FILTER_MIN_CAPACITY;
+	}
+	int hashes;
+	size_t blockCount = filterBlockCount(set, capacity, &hashes);
+	size_t blockSize = FILTER_BLOCK_WORDS * sizeof(uint64_t);
+	if (filter->words == NULL || blockCount != filter->blockCount) {
+		uint64_t* words = (uint64_t*)memoryAlloc(set, blockCount * blockSize);
+		if (words != NULL) {
+			memoryFree(set, filter->words, filter->blockCount * blockSize);
+			filter->words = words;
+			filter->blockCount = blockCount;
+		} else if (filter->words == NULL) {
+			return false;
+		}
+	}
+	filter->hashes = hashes;
+	filter->capacity = capacity;
+	filter->stale = 0;
+	memset(filter->words, 0, filter->blockCount * blockSize);
+	for (Node node = set->tree->first; node != NULL; node = node->next) {
+		filterInsert(filter, filterHash(set, node->data));
+	}
+	return true;
+}
+
+/* Frees the filter of the tree of set */
+static void filterFree(Set set)
+{
+	struct Filter_t* filter = &set->tree->filter;
+	memoryFree(set, filter->words,
+			filter->blockCount * FILTER_BLOCK_WORDS * sizeof(uint64_t));
+	filter->words = NULL;
+	filter->blockCount = 0;
+}
+
+/* Adds an element just linked to the tree of set. The filter doubles its
+ * capacity when the tree outgrows it */
+static void filterAdd(Set set, SetElement element)
+{
+	if (!filterIsActive(set)) {
+		return;
+	}
+	if (set->tree->size > set->tree->filter.capacity) {
+		filterBuild(set, set->tree->size * 2); // includes element
+		return;
+	}
+	filterInsert(&set->tree->filter, filterHash(set, element));
+}
+
+/* Accounts for an element just removed from the tree of set */
+static void filterRemove(Set set)
+{
+	if (!filterIsActive(set)) {
+		return;
+	}
+	if (++set->tree->filter.stale * 2 >= set->tree->filter.capacity) {
+		filterBuild(set, set->tree->size * 2);
+	}
+}
+
+/* Tells if element may be in set. False only if the filter rules it out */
+static bool filterMayContain(Set set, SetElement element)
+{
+	if (!filterIsActive(set)) {
+		return true;
+	}
+	SET_STATS_ADD(set, filterChecks, 1);
+	if (filterTest(&set->tree->filter, filterHash(set, element))) {
+		return true;
+	}
+	SET_STATS_ADD(set, filterRejections, 1);
+	return false;
+}
+
+/* Tree helpers */
+
+static int nodeHeight(Node node)
+{
+	return node == NULL ? 0 : node->height;
+}
+
+static int nodeCount(Node node)
+{
+	return node == NULL ? 0 : node->count;
+}
+
+/* Recomputes the height and subtree size of node from its children */
+static void nodeUpdate(Node node)
+{
+	int leftHeight = nodeHeight(node->left);
+	int rightHeight = nodeHeight(node->right);
+	node->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+	node->count = 1 + nodeCount(node->left) + nodeCount(node->right);
+}
+
+/* Makes newChild take oldChild's place under oldChild's parent (or as root) */
+static void nodeReplaceChild(Set set, Node oldChild, Node newChild)
+{
+	Node parent = oldChild->parent;
+	if (parent == NULL) {
+		set->tree->root = newChild;
+	} else if (parent->left == oldChild) {
+		parent->left = newChild;
+	} else {
+		parent->right = newChild;
+	}
+	if (newChild != NULL) {
+		newChild->parent = parent;
+	}
+}
+
+static Node nodeRotateLeft(Set set, Node node)
+{
+	Node pivot = node->right;
+	nodeReplaceChild(set, node, pivot);
+	node->right = pivot->left;
+	if (node->right != NULL) {
+		node->right->parent = node;
+	}
+	pivot->left = node;
+	node->parent = pivot;
+	nodeUpdate(node);
+	nodeUpdate(pivot);
+	return pivot;
+}
+
+static Node nodeRotateRight(Set set, Node node)
+{
+	Node pivot = node->left;
+	nodeReplaceChild(set, node, pivot);
+	node->left = pivot->right;
+	if (node->left != NULL) {
+		node->left->parent = node;
+	}
+	pivot->right = node;
+	node->parent = pivot;
+	nodeUpdate(node);
+	nodeUpdate(pivot);
+	return pivot;
+}
+
+/* Restores the AVL invariant on the path from node up to the root, and the
+ * subtree sizes along it */
+static void treeRebalance(Set set, Node node)
+{
+	while (node != NULL) {
+		nodeUpdate(node);
+		int balance = nodeHeight(node->left) - nodeHeight(node->right);
+		if (balance > 1) {
+			if (nodeHeight(node->left->left) < nodeHeight(node->left->right)) {
+				nodeRotateLeft(set, node->left);
+			}
+			node = nodeRotateRight(set, node);
+		} else if (balance < -1) {
+			if (nodeHeight(node->right->right) < nodeHeight(node->right->left)) {
+				nodeRotateRight(set, node->right);
+			}
+			node = nodeRotateLeft(set, node);
+		}
+		node = node->parent;
+	}
+}
+
+static Node treeMinimum(Node node)
+{
+	if (node == NULL) {
+		return NULL;
+	}
+	while (node->left != NULL) {
+		node = node->left;
+	}
+	return node;
+}
+
+static Node treeMaximum(Node node)
+{
+	if (node == NULL) {
+		return NULL;
+	}
+	while (node->right != NULL) {
+		node = node->right;
+	}
+	return node;
+}
+
+static Node treePredecessor(Node node)
+{
+	if (node->left != NULL) {
+		return treeMaximum(node->left);
+	}
+	while (node->parent != NULL && node->parent->left == node) {
+		node = node->parent;
+	}
+	return node->parent;
+}
+
+static Node treeSuccessor(Node node)
+{
+	if (node->right != NULL) {
+		return treeMinimum(node->right);
+	}
+	while (node->parent != NULL && node->parent->right == node) {
+		node = node->parent;
+	}
+	return node->parent;
+}
+
+/* Rebuilds the next links of the whole tree by an in-order walk */
+static void treeThread(Set set)
+{
+	Node last = NULL;
+	Node node = treeMinimum(set->tree->root);
+	set->tree->first = node;
+	while (node != NULL) {
+		last = node;
+		node = treeSuccessor(node);
+		last->next = node;
+	}
+	set->tree->last = last;
+}
+
+/* Returns the node whose data equals element. Otherwise returns NULL, and
+ * element belongs under *parent, on its left if *goLeft is true */
+static Node treeLocate(Set set, SetElement element, Node* parent, bool* goLeft)
+{
+	Node node = set->tree->root;
+	*parent = NULL;
+	*goLeft = false;
+	while (node != NULL) {
+		assert(node->data != NULL);
+		SET_STATS_ADD(set, nodesVisited, 1);
+		int cmpResult = cmpElements(set, node->data, element);
+		if (cmpResult == 0) {
+			return node;
+		}
+		*parent = node;
+		// element goes left of a greater node and right of a smaller one
+		*goLeft = cmpResult > 0;
+		node = *goLeft ? node->left : node->right;
+	}
+	return NULL;
+}
+
+/* Returns the node whose data equals element, or NULL */
+static Node treeFind(Set set, SetElement element)
+{
+	Node parent;
+	bool goLeft;
+	return treeLocate(set, element, &parent, &goLeft);
+}
+
+/* Returns the first node whose data is not less than element, or greater
+ * than element if strict, or NULL if there is none. Sets *rank to the
+ * number of nodes before it */
+static Node treeBound(Set set, SetElement element, bool strict, int* rank)
+{
+	Node node = set->tree->root;
+	Node bound = NULL;
+	*rank = 0;
+	while (node != NULL) {
+		SET_STATS_ADD(set, nodesVisited, 1);
+		int cmpResult = cmpElements(set, node->data, element);
+		if (cmpResult > 0 || (cmpResult == 0 && !strict)) {
+			bound = node;
+			node = node->left;
+		} else {
+			*rank += nodeCount(node->left) + 1;
+			node = node->right;
+		}
+	}
+	return bound;
+}
+
+/* Links a detached node as a leaf under parent (as located by treeLocate),
+ * threads it between its neighbours and rebalances */
+static void treeLink(Set set, Node node, Node parent, bool goLeft)
+{
+	Node predecessor;
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = parent;
+	node->height = 1;
+	node->count = 1;
+	if (parent == NULL) {
+		set->tree->root = node;
+		predecessor = NULL;
+		node->next = NULL;
+	} else if (goLeft) {
+		assert(parent->left == NULL);
+		parent->left = node;
+		predecessor = treePredecessor(node);
+		node->next = parent;
+	} else {
+		assert(parent->right == NULL);
+		parent->right = node;
+		predecessor = parent;
+		node->next = parent->next;
+	}
+	if (predecessor == NULL) {
+		set->tree->first = node;
+	} else {
+		predecessor->next = node;
+	}
+	if (node->next == NULL) {
+		set->tree->last = node;
+	}
+	treeRebalance(set, parent);
+	set->tree->size++;
+	set->current = NULL;
+	filterAdd(set, node->data);
+}
+
+/* Returns the node holding an element of an inline set */
+static Node elementToNode(SetElement element)
+{
+	return (Node)((char*)element - ALIGN_SIZE(sizeof(struct SetNode_t)));
+}
+
+/* Unlinks node from the tree and rebalances, without freeing it */
+static void treeUnlink(Set set, Node node)
+{
+	Node predecessor = treePredecessor(node);
+	if (predecessor == NULL) {
+		set->tree->first = node->next;
+	} else {
+		predecessor->next = node->next;
+	}
+	if (node->next == NULL) {
+		set->tree->last = predecessor;
+	}
+	Node rebalanceFrom;
+	if (node->left == NULL) {
+		rebalanceFrom = node->parent;
+		nodeReplaceChild(set, node, node->right);
+	} else if (node->right == NULL) {
+		rebalanceFrom = node->parent;
+		nodeReplaceChild(set, node, node->left);
+	} else {
+		// two children - the successor takes node's place in the tree
+		Node successor = treeMinimum(node->right);
+		if (successor->parent != node) {
+			rebalanceFrom = successor->parent;
+			nodeReplaceChild(set, successor, successor->right);
+			successor->right = node->right;
+			successor->right->parent = successor;
+		} else {
+			rebalanceFrom = successor;
+		}
+		nodeReplaceChild(set, node, successor);
+		successor->left = node->left;
+		successor->left->parent = successor;
+		successor->height = node->height;
+		successor->count = node->count;
+	}
+	treeRebalance(set, rebalanceFrom);
+}
+
+/* Frees the elements of a subtree. The nodes themselves belong to the pool.
+ * Recursion depth is the tree height */
+static void treeFreeElements(Set set, Node node)
+{
+	if (node == NULL) {
+		return;
+	}
+	treeFreeElements(set, node->left);
+	treeFreeElements(set, node->right);
+	if (node->data != NULL) {
+		nodeFreeElement(set, node);
+	}
+}
+
+/* Copies a subtree (of another tree) into the tree of set keeping its shape.
+ * On error *failed is set, and the returned subtree holds only successfully
+ * copied elements */
+static Node treeCopy(Set set, Node node, Node parent, bool* failed)
+{
+	if (node == NULL || *failed) {
+		return NULL;
+	}
+	Node newNode = poolAllocNode(set);
+	if (newNode == NULL) {
+		*failed = true;
+		return NULL;
+	}
+	if (nodeCopyElement(set, newNode, node->data) == NULL) {
+		poolFreeNode(set, newNode);
+		*failed = true;
+		return NULL;
+	}
+	newNode->parent = parent;
+	newNode->height = node->height;
+	newNode->count = node->count;
+	newNode->left = NULL;
+	newNode->right = NULL;
+	newNode->left = treeCopy(set, node->left, newNode, failed);
+	newNode->right = treeCopy(set, node->right, newNode, failed);
+	return newNode;
+}
+
+/* Builds a perfectly balanced subtree out of count sorted nodes in O(count).
+ * Recursion depth is the tree height */
+static Node treeBuild(Node* nodes, int count, Node parent)
+{
+	if (count == 0) {
+		return NULL;
+	}
+	int middle = count / 2;
+	Node node = nodes[middle];
+	node->parent = parent;
+	node->left = treeBuild(nodes, middle, node);
+	node->right = treeBuild(nodes + middle + 1, count - middle - 1, node);
+	nodeUpdate(node);
+	return node;
+}
+
+/* Makes root the root of the tree of set. Its count nodes are sorted (and
+ * distinct) in nodes, and already threaded through next */
+static void treeReplace(Set set, Node root, Node* nodes, int count)
+{
+	set->tree->root = root;
+	set->tree->first = count > 0 ? nodes[0] : NULL;
+	set->tree->last = count > 0 ? nodes[count - 1] : NULL;
+	set->tree->size = count;
+	set->current = NULL;
+	if (filterIsActive(set)) {
+		filterBuild(set, count * 2);
+	}
+}
+
+/* Replaces the tree of set with count sorted (and distinct) nodes */
+static void treeRebuild(Set set, Node* nodes, int count)
+{
+	Node root = treeBuild(nodes, count, NULL);
+	for (int i = 0; i < count; i++) {
+		nodes[i]->next = i + 1 < count ? nodes[i + 1] : NULL;
+	}
+	treeReplace(set, root, nodes, count);
+}
+
+/* Merge sort of elements by the set's compare function. buffer must have
+ * room for count elements. Adds the comparisons made to *comparisons */
+static void sortElements(Set set, SetElement* elements, SetElement* buffer,
+		int count, unsigned long long* comparisons)
+{
+	if (count < 2) {
+		return;
+	}
+	int middle = count / 2;
+	sortElements(set, elements, buffer, middle, comparisons);
+	sortElements(set, elements + middle, buffer, count - middle, comparisons);
+	(*comparisons)++;
+	if (cmpElementsUncounted(set, elements[middle - 1], elements[middle]) <= 0) {
+		return; // already in order
+	}
+	int left = 0, right = middle, out = 0;
+	while (left < middle && right < count) {
+		// take from the left on ties, keeping the sort stable
+		(*comparisons)++;
+		if (cmpElementsUncounted(set, elements[right], elements[left]) < 0) {
+			buffer[out++] = elements[right++];
+		} else {
+			buffer[out++] = elements[left++];
+		}
+	}
+	while (left < middle) {
+		buffer[out++] = elements[left++];
+	}
+	// the rest of the right half is already in place
+	for (int i = 0; i < out; i++) {
+		elements[i] = buffer[i];
+	}
+}
+
+/* Sorts elements and removes the duplicates (keeping the first of every
+ * group of equal elements). Returns the number of elements left, or -1 if an
+ * allocation failed. A sorted input is detected in a single pass */
+static int sortUniqueElements(Set set, SetElement* elements, int count)
+{
+	bool sorted = true;
+	for (int i = 1; i < count && sorted; i++) {
+		sorted = cmpElements(set, elements[i - 1], elements[i]) < 0;
+	}
+	if (sorted) {
+		return count;
+	}
+	SetElement* buffer = (SetElement*)memoryAlloc(set,
+			sizeof(*buffer) * count);
+	if (buffer == NULL) {
+		return -1;
+	}
+	unsigned long long comparisons = 0;
+	sortElements(set, elements, buffer, count, &comparisons);
+	SET_STATS_ADD(set, comparisons, comparisons);
+	memoryFree(set, buffer, sizeof(*buffer) * count);
+	int unique = count > 0 ? 1 : 0;
+	for (int i = 1; i < count; i++) {
+		if (cmpElements(set, elements[unique - 1], elements[i]) != 0) {
+			elements[unique++] = elements[i];
+		}
+	}
+	return unique;
+}
+
+/* Allocates an empty tree for set, not shared yet */
+static Tree treeCreate(Set set, size_t nodeSize)
+{
+	Tree tree = (Tree)memoryAlloc(set, sizeof(*tree));
+	IF_NULL_RETURN_NULL(tree)
+	tree->root = NULL; // empty tree
+	tree->first = NULL;
+	tree->last = NULL;
+	tree->size = 0;
+	tree->refCount = 1;
+	tree->nodeSize = nodeSize;
+	tree->slabs = NULL;
+	tree->slabCursor = NULL;
+	tree->slabUnused = 0;
+	tree->freeNodes = NULL;
+	tree->freeCount = 0;
+	tree->poolCapacity = 0;
+	tree->filter.words = NULL;
+	tree->filter.blockCount = 0;
+	tree->filter.hashes = 0;
+	tree->filter.capacity = 0;
+	tree->filter.stale = 0;
+	return tree;
+}
+
+/* Frees the elements and nodes of the tree of set, and the tree itself */
+static void treeDestroy(Set set)
+{
+	treeFreeElements(set, set->tree->root);
+	poolRelease(set); // frees the nodes slab by slab
+	filterFree(set);
+	memoryFree(set, set->tree, sizeof(*set->tree));
+	set->tree = NULL;
+}
+
+/* Gives up the tree of set, destroying it if no other set shares it */
+static void setDropTree(Set set)
+{
+	if (REF_COUNT_DECREMENT(set->tree->refCount) == 0) {
+		treeDestroy(set);
+	}
+	set->tree = NULL;
+}
+
+/* Tells if other sets share the tree of set */
+static bool treeIsShared(Set set)
+{
+	return REF_COUNT_LOAD(set->tree->refCount) > 1;
+}
+
+/* Returns the node of the tree of set holding the element held by node,
+ * which belongs to the tree set had before setUnshare (an equal tree) */
+static Node setTranslateNode(Set set, Node node)
+{
+	return node == NULL ? NULL : treeFind(set, node->data);
+}
+
+/* Allocates an empty set. Exactly one of copyElement and copyElementInto is
+ * used, according to elementSize, and exactly one of compareElements and
+ * compareWithContext. A NULL allocator stands for malloc and free */
+static Set setCreateInternal(copySetElements copyElement,
+		copySetElementsInto copyElementInto, size_t elementSize,
+		freeSetElements freeElement, compareSetElements compareElements,
+		compareSetElementsWithContext compareWithContext, void* context,
+		SetAllocator const* allocator)
+{
+	if (allocator == NULL) {
+		allocator = &defaultAllocator;
+	}
+	// allocated memory for the new set
+	Set set = (Set)allocator->allocate(sizeof(*set), allocator->context);
+	IF_NULL_RETURN_NULL(set)
+	set->allocator = *allocator;
+	setResetStats(set);
+	set->tree = treeCreate(set, ALIGN_SIZE(sizeof(struct SetNode_t))
+			+ ALIGN_SIZE(elementSize));
+	if (set->tree == NULL) {
+		allocator->deallocate(set, sizeof(*set), allocator->context);
+		return NULL;
+	}
+	set->current = NULL; // current (set's iterator) is NULL when undefined
+	set->copyFunc = copyElement;
+	set->copyIntoFunc = copyElementInto;
+	set->elementSize = elementSize;
+	set->freeFunc = freeElement;
+	set->cmpFunc = compareElements;
+	set->cmpContextFunc = compareWithContext;
+	set->cmpContext = context;
+	set->hashFunc = NULL;
+	set->filterRate = 0;
+	set->filterMaxBytes = 0;
+	return set;
+}
+
+Set setCreate(copySetElements copyElement, freeSetElements freeElement,
+		compareSetElements compareElements)
+{
+	// if one of the client's function pointers is NULL return SET_NULL_ARGUMENT
+	IF_NULL_RETURN_NULL(copyElement)
+	IF_NULL_RETURN_NULL(freeElement)
+	IF_NULL_RETURN_NULL(compareElements)
+	return setCreateInternal(copyElement, NULL, 0, freeElement,
+			compareElements, NULL, NULL, NULL);
+}
+
+/* Tells if both functions of an allocator are given */
+static bool allocatorIsValid(SetAllocator const* allocator)
+{
+	return allocator != NULL && allocator->allocate != NULL
+			&& allocator->deallocate != NULL;
+}
+
+Set setCreateWithAllocator(copySetElements copyElement,
+		freeSetElements freeElement, compareSetElements compareElements,
+		SetAllocator const* allocator)
+{
+	IF_NULL_RETURN_NULL(copyElement)
+	IF_NULL_RETURN_NULL(freeElement)
+	IF_NULL_RETURN_NULL(compareElements)
+	if (!allocatorIsValid(allocator)) {
+		return NULL;
+	}
+	return setCreateInternal(copyElement, NULL, 0, freeElement,
+			compareElements, NULL, NULL, allocator);
+}
+
+Set setCreateInline(size_t elementSize, copySetElementsInto copyElement,
+		freeSetElements destroyElement, compareSetElements compareElements)
+{
+	IF_NULL_RETURN_NULL(copyElement)
+	IF_NULL_RETURN_NULL(destroyElement)
+	IF_NULL_RETURN_NULL(compareElements)
+	if (elementSize == 0) {
+		return NULL;
+	}
+	return setCreateInternal(NULL, copyElement, elementSize, destroyElement,
+			compareElements, NULL, NULL, NULL);
+}
+
+Set setCreateInlineWithContext(size_t elementSize,
+		copySetElementsInto copyElement, freeSetElements destroyElement,
+		compareSetElementsWithContext compareElements, void* context)
+{
+	IF_NULL_RETURN_NULL(copyElement)
+	IF_NULL_RETURN_NULL(destroyElement)
+	IF_NULL_RETURN_NULL(compareElements)
+	if (elementSize == 0) {
+		return NULL;
+	}
+	return setCreateInternal(NULL, copyElement, elementSize, destroyElement,
+			NULL, compareElements, context, NULL);
+}
+
+Set setCreateInlineWithAllocator(size_t elementSize,
+		copySetElementsInto copyElement, freeSetElements destroyElement,
+		compareSetElementsWithContext compareElements, void* context,
+		SetAllocator const* allocator)
+{
+	IF_NULL_RETURN_NULL(copyElement)
+	IF_NULL_RETURN_NULL(destroyElement)
+	IF_NULL_RETURN_NULL(compareElements)
+	if (elementSize == 0 || !allocatorIsValid(allocator)) {
+		return NULL;
+	}
+	return setCreateInternal(NULL, copyElement, elementSize, destroyElement,
+			NULL, compareElements, context, allocator);
+}
+
+SetResult setSetCompareContext(Set set, void* context)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	set->cmpContext = context;
+	return SET_SUCCESS;
+}
+
+SetResult setSetAllocatorContext(Set set, void* context)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	set->allocator.context = context;
+	return SET_SUCCESS;
+}
+
+Set setCreateWithCapacity(copySetElements copyElement,
+		freeSetElements freeElement, compareSetElements compareElements,
+		int capacity)
+{
+	Set set = setCreate(copyElement, freeElement, compareElements);
+	IF_NULL_RETURN_NULL(set)
+	if (setReserve(set, capacity) != SET_SUCCESS) {
+		setDestroy(set);
+		return NULL;
+	}
+	return set;
+}
+
+SetResult setReserve(Set set, int capacity)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IS_SET_VALID(set)
+	if (capacity <= set->tree->size) {
+		return SET_SUCCESS;
+	}
+	if (setUnshare(set) != SET_SUCCESS) {
+		return SET_OUT_OF_MEMORY;
+	}
+	return poolReserve(set, capacity - set->tree->size) ? SET_SUCCESS
+			: SET_OUT_OF_MEMORY;
+}
+
+Set setCopy(Set set)
+{
+	IF_NULL_RETURN_NULL(set)
+	IS_SET_VALID(set)
+	Set newSet = (Set)set->allocator.allocate(sizeof(*newSet),
+			set->allocator.context);
+	IF_NULL_RETURN_NULL(newSet)
+	*newSet = *set;
+	REF_COUNT_INCREMENT(set->tree->refCount); // the elements are copied lazily
+	newSet->current = NULL; // the copy's iterator is undefined
+	setResetStats(newSet); // the work done so far was not the copy's
+	return newSet;
+}
+
+int setIsShared(Set set)
+{
+	return set != NULL && treeIsShared(set);
+}
+
+SetResult setUnshare(Set set)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	if (!treeIsShared(set)) {
+		return SET_SUCCESS;
+	}
+	Tree shared = set->tree;
+	set->tree = treeCreate(set, shared->nodeSize);
+	// all the nodes of the copy come from a single slab
+	if (set->tree == NULL || !poolReserve(set, shared->size)) {
+		memoryFree(set, set->tree, sizeof(*set->tree));
+		set->tree = shared;
+		return SET_OUT_OF_MEMORY;
+	}
+	bool failed = false;
+	set->tree->root = treeCopy(set, shared->root, NULL, &failed);
+	if (failed) {
+		treeDestroy(set); // frees the elements copied so far
+		set->tree = shared;
+		return SET_OUT_OF_MEMORY;
+	}
+	treeThread(set);
+	set->tree->size = shared->size;
+	set->current = NULL;
+	if (set->hashFunc != NULL && shared->filter.words != NULL) {
+		// same elements, so the copy takes the same bits
+		size_t filterSize = shared->filter.blockCount * FILTER_BLOCK_WORDS
+				* sizeof(uint64_t);
+		set->tree->filter = shared->filter;
+		set->tree->filter.words = (uint64_t*)memoryAlloc(set, filterSize);
+		if (set->tree->filter.words == NULL) {
+			treeDestroy(set);
+			set->tree = shared;
+			return SET_OUT_OF_MEMORY;
+		}
+		memcpy(set->tree->filter.words, shared->filter.words, filterSize);
+	}
+	// the other sets may have given up the tree meanwhile
+	Tree copy = set->tree;
+	set->tree = shared;
+	setDropTree(set);
+	set->tree = copy;
+	return SET_SUCCESS;
+}
+
+SetResult setGetStats(Set set, SetStats* stats)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(stats)
+#ifdef SET_ENABLE_STATS
+	*stats = set->stats;
+#else
+	SetStats none = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	*stats = none;
+#endif
+	return SET_SUCCESS;
+}
+
+SetResult setResetStats(Set set)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+#ifdef SET_ENABLE_STATS
+	SetStats none = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	set->stats = none;
+#endif
+	return SET_SUCCESS;
+}
+
+SetResult setEnableFilter(Set set, hashSetElementsWithContext hashElement,
+		double falsePositiveRate, size_t maxBytes)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(hashElement)
+	// sets sharing the tree may be read concurrently, the filter is our own
+	if (setUnshare(set) != SET_SUCCESS) {
+		return SET_OUT_OF_MEMORY;
+	}
+	set->hashFunc = hashElement;
+	set->filterRate = falsePositiveRate;
+	set->filterMaxBytes = maxBytes;
+	if (!filterBuild(set, set->tree->size * 2)) {
+		set->hashFunc = NULL;
+		return SET_OUT_OF_MEMORY;
+	}
+	return SET_SUCCESS;
+}
+
+SetResult setDisableFilter(Set set)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	if (!treeIsShared(set)) {
+		filterFree(set);
+	}
+	set->hashFunc = NULL;
+	return SET_SUCCESS;
+}
+
+int setFilterMayContain(Set set, SetElement element)
+{
+	if (set == NULL || element == NULL) {
+		return 0;
+	}
+	return filterMayContain(set, element) ? 1 : 0;
+}
+
+int setGetSize(Set set)
+{
+	if (set == NULL) {
+		return -1;
+	}
+	assert(set->tree->size >= 0);
+	return set->tree->size;
+}
+
+SetIterator setGetFirst(Set set)
+{
+	if (set == NULL || setGetSize(set) == 0) {
+		return NULL;
+	}
+	set->current = set->tree->first;
+	return set->current;
+}
+
+SetIterator setGetLast(Set set)
+{
+	if (set == NULL || setGetSize(set) == 0) {
+		return NULL;
+	}
+	set->current = set->tree->last;
+	return set->current;
+}
+
+/**
+*	setGetNext: Advances the iterator to the next element
+*	The next element is determined by the comparison function induced order.
+* @param set - The set for which to advance the iterator
+* @param iter - The iterator to advance
+* @return
+* 	NULL if reached the end of the set, or the iterator is at an invalid state
+* 	or a NULL sent as argument
+* 	Iterator t onext element in the set in case of success
+*/
+SetIterator setGetNext(Set set, SetIterator iter)
+{
+	if (set == NULL || iter == NULL) {
+		return NULL;
+	}
+	set->current = ((Node)iter)->next;
+	return set->current;
+}
+
+SetIterator setGetPrevious(Set set, SetIterator iter)
+{
+	if (set == NULL || iter == NULL) {
+		return NULL;
+	}
+	set->current = treePredecessor((Node)iter);
+	return set->current;
+}
+
+/**
+*	setGetElement: Returns the element pointed to by the iterator
+* @param set - The set for which to advance the iterator
+* @param iter - The iterator to dereference.
+* @return
+* 	NULL if reached the end of the set, or the iterator is at an invalid state
+* 	or a NULL sent as argument
+* 	The element of the set pointed to by iter in case of success
+*/
+SetElement setGetElement(Set set, SetIterator iter)
+{
+	if (set == NULL || iter == NULL) {
+		return NULL;
+	}
+	return ((Node)iter)->data;
+}
+
+SetIterator setFind(Set set, SetElement element)
+{
+	IF_NULL_RETURN_NULL(set)
+	IF_NULL_RETURN_NULL(element)
+	IS_SET_VALID(set)
+	if (!filterMayContain(set, element)) {
+		return NULL;
+	}
+	Node foundNode = treeFind(set, element);
+	IF_NULL_RETURN_NULL(foundNode)
+	set->current = foundNode;
+	return foundNode;
+}
+
+SetElement setContains(Set set, SetElement element)
+{
+	SetIterator iter = setFind(set, element);
+	IF_NULL_RETURN_NULL(iter)
+	return ((Node)iter)->data;
+}
+
+/* Batch lookups */
+
+/* One lookup of setContainsBatch, at node on the way down the tree */
+struct BatchLookup_t {
+	Node node;
+	int index; // of the element looked up
+};
+
+/* Starts fetching node and, in an inline set, the element after it */
+static void nodePrefetch(Set set, Node node)
+{
+	PREFETCH(node);
+	if (set->elementSize > 0) {
+		PREFETCH((char*)node + ALIGN_SIZE(sizeof(*node)));
+	}
+}
+
+/* Starts the lookup of the next element the filter does not rule out.
+ * Returns false if no elements are left */
+static bool batchStart(Set set, struct BatchLookup_t* lookup,
+		SetElement* elements, int count, int* next, SetElement* found)
+{
+	while (*next < count) {
+		int index = (*next)++;
+		if (filterMayContain(set, elements[index])) {
+			lookup->node = set->tree->root;
+			lookup->index = index;
+			return true;
+		}
+		found[index] = NULL;
+	}
+	return false;
+}
+
+/* Looks up the elements BATCH_WIDTH at a time, taking one step of every
+ * lookup in turn. The child a lookup goes to next is prefetched, and is
+ * usually in the cache by the time its turn comes again, so the cache misses
+ * of different lookups overlap instead of following each other */
+static void batchInterleave(Set set, SetElement* elements, int count,
+		SetElement* found)
+{
+	struct BatchLookup_t lookups[BATCH_WIDTH];
+	int next = 0, active = 0;
+	while (active < BATCH_WIDTH
+			&& batchStart(set, &lookups[active], elements, count, &next,
+					found)) {
+		active++;
+	}
+	while (active > 0) {
+		for (int slot = 0; slot < active;) {
+			struct BatchLookup_t* lookup = &lookups[slot];
+			Node node = lookup->node;
+			int cmpResult = 0;
+			if (node != NULL) {
+				SET_STATS_ADD(set, nodesVisited, 1);
+				cmpResult = cmpElements(set, node->data,
+						elements[lookup->index]);
+			}
+			if (node != NULL && cmpResult != 0) {
+				lookup->node = cmpResult > 0 ? node->left : node->right;
+				if (lookup->node != NULL) {
+					nodePrefetch(set, lookup->node);
+				}
+				slot++;
+				continue;
+			}
+			found[lookup->index] = node == NULL ? NULL : node->data;
+			if (batchStart(set, lookup, elements, count, &next, found)) {
+				slot++;
+			} else {
+				*lookup = lookups[--active];
+			}
+		}
+	}
+}
+
+/* Looks up sorted elements in a single walk over the set, in
+ * O(size + count) */
+static void batchMerge(Set set, SetElement* elements, int count,
+		SetElement* found)
+{
+	Node node = set->tree->first;
+	for (int i = 0; i < count; i++) {
+		int cmpResult = 1;
+		while (node != NULL
+				&& (cmpResult = cmpElements(set, node->data, elements[i])) < 0) {
+			node = node->next;
+		}
+		found[i] = node != NULL && cmpResult == 0 ? node->data : NULL;
+	}
+}
+
+SetResult setContainsBatch(Set set, SetElement* elements, int count,
+		SetElement* found)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(elements)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(found)
+	for (int i = 0; i < count; i++) {
+		IF_NULL_RETURN_SET_NULL_ARGUMENT(elements[i])
+	}
+	set->current = NULL;
+	if (count <= 0) {
+		return SET_SUCCESS;
+	}
+	bool sorted = true;
+	for (int i = 1; i < count && sorted; i++) {
+		sorted = cmpElements(set, elements[i - 1], elements[i]) <= 0;
+	}
+	// a walk costs O(size), searching costs O(log size) per element
+	int size = set->tree->size;
+	if (sorted && size > 0 && count >= size / nodeHeight(set->tree->root)) {
+		batchMerge(set, elements, count, found);
+	} else {
+		batchInterleave(set, elements, count, found);
+	}
+	return SET_SUCCESS;
+}
+
+SetIterator setLowerBound(Set set, SetElement element)
+{
+	IF_NULL_RETURN_NULL(set)
+	IF_NULL_RETURN_NULL(element)
+	int rank;
+	set->current = treeBound(set, element, false, &rank);
+	return set->current;
+}
+
+SetIterator setUpperBound(Set set, SetElement element)
+{
+	IF_NULL_RETURN_NULL(set)
+	IF_NULL_RETURN_NULL(element)
+	int rank;
+	set->current = treeBound(set, element, true, &rank);
+	return set->current;
+}
+
+int setRank(Set set, SetElement element)
+{
+	if (set == NULL || element == NULL) {
+		return -1;
+	}
+	int rank;
+	treeBound(set, element, false, &rank);
+	return rank;
+}
+
+SetIterator setGetNth(Set set, int index)
+{
+	if (set == NULL || index < 0 || index >= set->tree->size) {
+		return NULL;
+	}
+	Node node = set->tree->root;
+	// the subtree sizes tell on which side of node the index is
+	while (index != nodeCount(node->left)) {
+		if (index < nodeCount(node->left)) {
+			node = node->left;
+		} else {
+			index -= nodeCount(node->left) + 1;
+			node = node->right;
+		}
+	}
+	set->current = node;
+	return node;
+}
+
+int setCountRange(Set set, SetElement low, SetElement high)
+{
+	if (set == NULL || low == NULL || high == NULL) {
+		return -1;
+	}
+	int lowRank, highRank;
+	treeBound(set, low, false, &lowRank);
+	treeBound(set, high, false, &highRank);
+	return highRank > lowRank ? highRank - lowRank : 0;
+}
+
+SetResult setAdd(Set set, SetElement element)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
+	Node parent;
+	bool goLeft;
+	if (treeLocate(set, element, &parent, &goLeft) != NULL) {
+		return SET_ITEM_ALREADY_EXISTS;
+	}
+	if (treeIsShared(set)) {
+		if (setUnshare(set) != SET_SUCCESS) {
+			return SET_OUT_OF_MEMORY;
+		}
+		treeLocate(set, element, &parent, &goLeft);
+	}
+	Node newNode = poolAllocNode(set);
+	if (newNode == NULL) {
+		return SET_OUT_OF_MEMORY;
+	}
+	if (nodeCopyElement(set, newNode, element) == NULL) {
+		poolFreeNode(set, newNode);
+		return SET_OUT_OF_MEMORY;
+	}
+	treeLink(set, newNode, parent, goLeft);
+	return SET_SUCCESS;
+}
+
+SetResult setLocate(Set set, SetElement element, SetIterator* position)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(position)
+	Node parent;
+	bool goLeft;
+	Node foundNode = treeLocate(set, element, &parent, &goLeft);
+	if (foundNode != NULL) {
+		*position = foundNode;
+		return SET_ITEM_ALREADY_EXISTS;
+	}
+	// a link is expected next, the position must be in the set's own tree
+	if (treeIsShared(set)) {
+		if (setUnshare(set) != SET_SUCCESS) {
+			return SET_OUT_OF_MEMORY;
+		}
+		treeLocate(set, element, &parent, &goLeft);
+	}
+	*position = parent;
+	return SET_ITEM_DOES_NOT_EXIST;
+}
+
+SetElement setAllocateElement(Set set)
 {
-	// if one of the client's function pointers is NULL return SET_NULL_ARGUMENT
-	IF_NULL_RETURN_NULL(copyElement)
-	IF_NULL_RETURN_NULL(freeElement)
-	IF_NULL_RETURN_NULL(compareElements)
-	Set set = (Set)malloc(sizeof(*set)); // allocated memory for the new set
 	IF_NULL_RETURN_NULL(set)
-	set->dummy = (Node)malloc(sizeof(*set->dummy)); // allocate memory for the list
-	if (set->dummy == NULL) { // if allocation fails free previous malloced mem
-		free(set);
+	assert(set->elementSize > 0);
+	if (setUnshare(set) != SET_SUCCESS) {
 		return NULL;
 	}
-	set->dummy->data = NULL; // list is allocated, assign NULL to dummy node's data
-	set->dummy->next = NULL; // dummy's next is NULL
-	set->current = NULL; // current (set's iterator) is NULL when undefined
-	set->copyFunc = copyElement;
-	set->freeFunc = freeElement;
-	set->cmpFunc = compareElements;
-	set->size = 0;
-	return set;
+	Node node = poolAllocNode(set);
+	IF_NULL_RETURN_NULL(node)
+	node->data = (char*)node + ALIGN_SIZE(sizeof(*node));
+	return node->data;
 }
 
-Set setCopy(Set set)
+void setDeallocateElement(Set set, SetElement element)
+{
+	if (set == NULL || element == NULL) {
+		return;
+	}
+	assert(set->elementSize > 0);
+	poolFreeNode(set, elementToNode(element));
+}
+
+SetIterator setLinkElement(Set set, SetElement element, SetIterator position)
 {
 	IF_NULL_RETURN_NULL(set)
-	IS_SET_VALID(set)
-	Set newSet = setCreate(set->copyFunc, set->freeFunc, set->cmpFunc);
-	IF_NULL_RETURN_NULL(newSet)
-	Node nodeToCopy = set->dummy->next;
-	Node lastCopiedNode = newSet->dummy;
-	newSet->current = NULL; // in case current was undefined in original set
-	while (nodeToCopy != NULL) {
-		Node currNode = (Node)malloc(sizeof(*currNode));
-		if (currNode == NULL) {
-			setDestroy(newSet);
+	IF_NULL_RETURN_NULL(element)
+	Node parent = (Node)position;
+	// the position tells the parent, one comparison tells the side
+	bool goLeft = parent != NULL
+			&& cmpElements(set, parent->data, element) > 0;
+	return setLinkElementAt(set, element, position, goLeft);
+}
+
+SetIterator setLinkElementAt(Set set, SetElement element, SetIterator parent,
+		int asLeftChild)
+{
+	IF_NULL_RETURN_NULL(set)
+	IF_NULL_RETURN_NULL(element)
+	assert(set->elementSize > 0);
+	if (treeIsShared(set)) {
+		// the set was copied after the element was located
+		if (setUnshare(set) != SET_SUCCESS) {
 			return NULL;
 		}
-		if (nodeToCopy->data == NULL) {
-			currNode->data = NULL;
-		} else {
-			currNode->data = set->copyFunc(nodeToCopy->data);
-			if (currNode->data == NULL) {
-				free(currNode);
-				setDestroy(newSet);
-				return NULL;
-			}
+		parent = setTranslateNode(set, (Node)parent);
+	}
+	Node node = elementToNode(element);
+	treeLink(set, node, (Node)parent, asLeftChild != 0);
+	return node;
+}
+
+SetIterator setGetRoot(Set set)
+{
+	IF_NULL_RETURN_NULL(set)
+	return set->tree->root;
+}
+
+SetResult setInsertElement(Set set, SetElement element, SetIterator* position)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(position)
+	assert(set->elementSize > 0);
+	Node parent;
+	bool goLeft;
+	Node foundNode = treeLocate(set, element, &parent, &goLeft);
+	if (foundNode != NULL) {
+		*position = foundNode;
+		return SET_ITEM_ALREADY_EXISTS;
+	}
+	if (treeIsShared(set)) {
+		if (setUnshare(set) != SET_SUCCESS) {
+			return SET_OUT_OF_MEMORY;
 		}
-		if (nodeToCopy == set->current) {
-			newSet->current = currNode;
+		treeLocate(set, element, &parent, &goLeft);
+	}
+	Node node = elementToNode(element);
+	treeLink(set, node, parent, goLeft);
+	*position = node;
+	return SET_SUCCESS;
+}
+
+SetResult setRemove(Set set, SetElement element)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
+	set->current = NULL; // iterator is undefined for every setRemove result
+	if (!filterMayContain(set, element)) {
+		return SET_ITEM_DOES_NOT_EXIST;
+	}
+	Node nodeToDelete = treeFind(set, element);
+	if (nodeToDelete == NULL) {
+		return SET_ITEM_DOES_NOT_EXIST;
+	}
+	return setRemoveIterator(set, nodeToDelete);
+}
+
+SetResult setRemoveIterator(Set set, SetIterator iter)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(iter)
+	Node nodeToDelete = (Node)iter;
+	set->current = NULL;
+	if (treeIsShared(set)) {
+		if (setUnshare(set) != SET_SUCCESS) {
+			return SET_OUT_OF_MEMORY;
 		}
-		currNode->next = NULL;
-		lastCopiedNode->next = currNode;
-		lastCopiedNode = currNode;
-		nodeToCopy = nodeToCopy->next;
+		nodeToDelete = setTranslateNode(set, nodeToDelete);
 	}
-	newSet->size = setGetSize(set);
-	return newSet;
+	treeUnlink(set, nodeToDelete);
+	nodeFreeElement(set, nodeToDelete);
+	poolFreeNode(set, nodeToDelete);
+	set->tree->size--;
+	filterRemove(set);
+	return SET_SUCCESS;
 }
 
-int setGetSize(Set set)
+/* setAddBatch with a sorted, distinct batch. The set's nodes and new nodes
+ * for the batch are merged by order, and the tree is rebuilt from them.
+ * New nodes are marked by a height of 0 until the tree is rebuilt */
+static SetResult setMergeSorted(Set set, SetElement* elements, int count)
 {
-	if (set == NULL) {
-		return -1;
+	size_t nodesSize = sizeof(Node) * ((size_t)set->tree->size + count);
+	Node* nodes = (Node*)memoryAlloc(set, nodesSize);
+	if (nodes == NULL || !poolReserve(set, count)) {
+		memoryFree(set, nodes, nodesSize);
+		return SET_OUT_OF_MEMORY;
+	}
+	int merged = 0, index = 0;
+	Node node = set->tree->first;
+	while (node != NULL || index < count) {
+		int cmpResult = node == NULL ? 1 : index == count ? -1
+				: cmpElements(set, node->data, elements[index]);
+		if (cmpResult <= 0) {
+			nodes[merged++] = node;
+			node = node->next;
+			index += cmpResult == 0 ? 1 : 0; // already in the set
+			continue;
+		}
+		Node newNode = poolAllocNode(set);
+		assert(newNode != NULL); // reserved above
+		if (nodeCopyElement(set, newNode, elements[index]) == NULL) {
+			poolFreeNode(set, newNode);
+			// the tree was not touched yet, drop the copies made so far
+			for (int i = 0; i < merged; i++) {
+				if (nodes[i]->height == 0) {
+					nodeFreeElement(set, nodes[i]);
+					poolFreeNode(set, nodes[i]);
+				}
+			}
+			memoryFree(set, nodes, nodesSize);
+			return SET_OUT_OF_MEMORY;
+		}
+		newNode->height = 0;
+		nodes[merged++] = newNode;
+		index++;
 	}
-	assert(set->size >= 0);
-	return set->size;
+	treeRebuild(set, nodes, merged);
+	memoryFree(set, nodes, nodesSize);
+	return SET_SUCCESS;
 }
 
-SetIterator setGetFirst(Set set)
+/* Adds a sorted, distinct batch, merging it with the set unless it is small
+ * enough to be added one by one */
+static SetResult setAddSorted(Set set, SetElement* elements, int count)
 {
-	if (set == NULL || setGetSize(set) == 0) {
-		return NULL;
+	if (set->tree->size > 0
+			&& count < set->tree->size / nodeHeight(set->tree->root)) {
+		// a rebuild costs O(size), adding one by one is cheaper here
+		SetResult result = SET_SUCCESS;
+		for (int i = 0; i < count && result != SET_OUT_OF_MEMORY; i++) {
+			result = setAdd(set, elements[i]);
+		}
+		return result == SET_OUT_OF_MEMORY ? result : SET_SUCCESS;
 	}
-	set->current = set->dummy->next;
-	return set->current->data;
+	return setMergeSorted(set, elements, count);
 }
 
-static SetIterator setGetNextOld(Set set)
+SetResult setAddBatch(Set set, SetElement* elements, int count)
 {
-	if (set == NULL || set->current == NULL) {
-		return NULL;
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(elements)
+	for (int i = 0; i < count; i++) {
+		IF_NULL_RETURN_SET_NULL_ARGUMENT(elements[i])
 	}
-	set->current = set->current->next;
-	return set->current != NULL ? set->current->data : NULL;
+	if (count <= 0) {
+		return SET_SUCCESS;
+	}
+	if (setUnshare(set) != SET_SUCCESS) {
+		return SET_OUT_OF_MEMORY;
+	}
+	size_t batchSize = sizeof(SetElement) * count;
+	SetElement* batch = (SetElement*)memoryAlloc(set, batchSize);
+	if (batch == NULL) {
+		return SET_OUT_OF_MEMORY;
+	}
+	for (int i = 0; i < count; i++) {
+		batch[i] = elements[i];
+	}
+	count = sortUniqueElements(set, batch, count);
+	SetResult result = count < 0 ? SET_OUT_OF_MEMORY
+			: setAddSorted(set, batch, count);
+	memoryFree(set, batch, batchSize);
+	return result;
 }
 
-/**
-*	setGetNext: Advances the iterator to the next element
-*	The next element is determined by the comparison function induced order.
-* @param set - The set for which to advance the iterator
-* @param iter - The iterator to advance
-* @return
-* 	NULL if reached the end of the set, or the iterator is at an invalid state
-* 	or a NULL sent as argument
-* 	Iterator t onext element in the set in case of success
-*/
-SetIterator setGetNext(Set set, SetIterator iter)
+/* Parallel batches. Every phase of setAddBatchParallel is split into tasks
+ * that the runner may run concurrently. A task only writes its own part of
+ * the arrays below and counts its own comparisons, so tasks need no locks.
+ * All allocations are made between phases, by the calling thread */
+
+/* Batches with fewer elements than this per task are added by setAddBatch */
+#define PARALLEL_MIN_PART 4096
+/* Subtrees built per task, so that slower tasks are balanced by others */
+#define PARALLEL_SUBTREES_PER_TASK 4
+
+struct ParallelBatch_t {
+	Set set;
+	SetElement* source; // the caller's elements
+	SetElement* elements; // the sorted runs of the current merge round
+	SetElement* buffer; // the output of the current merge round
+	int count;
+	int parts; // tasks of the sort and copy phases, one part of count each
+	int runParts; // parts in every sorted run of the current merge round
+	int* offsets; // where the distinct elements of every part go
+	unsigned long long* comparisons; // by every part
+	Node* nodes;
+	int* copied; // elements copied by every part, fewer if a copy failed
+	int* subtrees; // the first node and node count of every subtree
+	Node* roots; // of every subtree
+};
+typedef struct ParallelBatch_t* ParallelBatch;
+
+/* Index of the first element of part in the batch */
+static int parallelPartStart(ParallelBatch batch, int part)
 {
-	if (set == NULL || iter == NULL) {
-		return NULL;
+	return (int)((long long)batch->count * part / batch->parts);
+}
+
+/* Copies part of the caller's elements and sorts them */
+static void parallelSortTask(void* argument, int part)
+{
+	ParallelBatch batch = (ParallelBatch)argument;
+	int start = parallelPartStart(batch, part);
+	int end = parallelPartStart(batch, part + 1);
+	for (int i = start; i < end; i++) {
+		batch->elements[i] = batch->source[i];
 	}
-	for (setGetFirst(set); set->current != NULL; setGetNextOld(set)) {
-		if (set->current->data == iter) {
-			return setGetNextOld(set);
+	sortElements(batch->set, batch->elements + start, batch->buffer + start,
+			end - start, &batch->comparisons[part]);
+}
+
+/* Number of elements taken from first when merging the first rank elements
+ * of the sorted first and second, ties taken from first */
+static int parallelMergeSplit(ParallelBatch batch, SetElement* first,
+		int firstCount, SetElement* second, int secondCount, int rank,
+		unsigned long long* comparisons)
+{
+	int low = rank > secondCount ? rank - secondCount : 0;
+	int high = rank < firstCount ? rank : firstCount;
+	while (low < high) {
+		int taken = low + (high - low) / 2;
+		(*comparisons)++;
+		if (cmpElementsUncounted(batch->set, first[taken],
+				second[rank - taken - 1]) <= 0) {
+			low = taken + 1;
+		} else {
+			high = taken;
 		}
 	}
-	return NULL;
+	return low;
 }
 
-/**
-*	setGetElement: Returns the element pointed to by the iterator
-* @param set - The set for which to advance the iterator
-* @param iter - The iterator to dereference.
-* @return
-* 	NULL if reached the end of the set, or the iterator is at an invalid state
-* 	or a NULL sent as argument
-* 	The element of the set pointed to by iter in case of success
-*/
-SetElement setGetElement(Set set, SetIterator iter)
+/* Merges every pair of sorted runs into one. The output of every pair is
+ * split by rank between the tasks of its parts, so every task writes to its
+ * own part of buffer */
+static void parallelMergeTask(void* argument, int part)
 {
-	if (set == NULL || iter == NULL) {
-		return NULL;
+	ParallelBatch batch = (ParallelBatch)argument;
+	int pair = part / (2 * batch->runParts) * 2 * batch->runParts;
+	int middlePart = pair + batch->runParts;
+	int endPart = pair + 2 * batch->runParts;
+	int pairStart = parallelPartStart(batch, pair);
+	int middle = parallelPartStart(batch, middlePart < batch->parts
+			? middlePart : batch->parts);
+	int pairEnd = parallelPartStart(batch, endPart < batch->parts
+			? endPart : batch->parts);
+	SetElement* first = batch->elements + pairStart;
+	SetElement* second = batch->elements + middle;
+	int firstCount = middle - pairStart, secondCount = pairEnd - middle;
+	int start = parallelPartStart(batch, part) - pairStart;
+	int end = parallelPartStart(batch, part + 1) - pairStart;
+	unsigned long long* comparisons = &batch->comparisons[part];
+	int left = parallelMergeSplit(batch, first, firstCount, second,
+			secondCount, start, comparisons);
+	int leftEnd = parallelMergeSplit(batch, first, firstCount, second,
+			secondCount, end, comparisons);
+	int right = start - left, rightEnd = end - leftEnd;
+	SetElement* out = batch->buffer + pairStart + start;
+	while (left < leftEnd && right < rightEnd) {
+		(*comparisons)++;
+		if (cmpElementsUncounted(batch->set, second[right], first[left]) < 0) {
+			*out++ = second[right++];
+		} else {
+			*out++ = first[left++];
+		}
+	}
+	while (left < leftEnd) {
+		*out++ = first[left++];
+	}
+	while (right < rightEnd) {
+		*out++ = second[right++];
 	}
-	return iter;
 }
 
-SetElement setContains(Set set, SetIterator iter)
+/* Moves the distinct elements of part to the start of its part of buffer,
+ * keeping the first of every group of equal elements as setAddBatch does */
+static void parallelUniqueTask(void* argument, int part)
 {
-	IF_NULL_RETURN_NULL(set)
-	IF_NULL_RETURN_NULL(iter)
-	IS_SET_VALID(set)
-	Node iteratingNode = set->dummy->next;
-	while (iteratingNode != NULL) {
-		if (iteratingNode->data != NULL
-				&& set->cmpFunc(iteratingNode->data, iter) == 0) {
-			set->current = iteratingNode;
-			return iteratingNode->data;
+	ParallelBatch batch = (ParallelBatch)argument;
+	int start = parallelPartStart(batch, part);
+	int end = parallelPartStart(batch, part + 1);
+	int unique = 0;
+	for (int i = start; i < end; i++) {
+		batch->comparisons[part] += i > 0 ? 1 : 0;
+		if (i == 0 || cmpElementsUncounted(batch->set, batch->elements[i - 1],
+				batch->elements[i]) != 0) {
+			batch->buffer[start + unique++] = batch->elements[i];
 		}
-		iteratingNode = iteratingNode->next;
 	}
-	return NULL;
+	batch->offsets[part + 1] = unique;
 }
 
-SetResult setAdd(Set set, SetElement element)
+/* Moves the distinct elements of part from buffer to their final offset */
+static void parallelGatherTask(void* argument, int part)
 {
-	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
-	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
-	Node iteratingNode = set->dummy->next;
-	Node beforeNode = set->dummy;
-	while (iteratingNode != NULL) {
-		assert(iteratingNode->data != NULL);
-		int cmpResult = set->cmpFunc(iteratingNode->data, element);
-		if (cmpResult > 0) {
-			break; // Need to add element before iteratingNode
-		}
-		if (cmpResult < 0) { // add element after iterating Node
-			iteratingNode = iteratingNode->next;
-			beforeNode = beforeNode->next;
-			continue;
+	ParallelBatch batch = (ParallelBatch)argument;
+	int start = parallelPartStart(batch, part);
+	int offset = batch->offsets[part];
+	for (int i = 0; i < batch->offsets[part + 1] - offset; i++) {
+		batch->elements[offset + i] = batch->buffer[start + i];
+	}
+}
+
+/* Copies the elements of part into their nodes and threads them through
+ * next. Stops at the first copy that fails */
+static void parallelCopyTask(void* argument, int part)
+{
+	ParallelBatch batch = (ParallelBatch)argument;
+	int start = parallelPartStart(batch, part);
+	int end = parallelPartStart(batch, part + 1);
+	int i = start;
+	for (; i < end; i++) {
+		Node node = batch->nodes[i];
+		if (nodeCopyElementUncounted(batch->set, node,
+				batch->elements[i]) == NULL) {
+			break;
 		}
-		return SET_ITEM_ALREADY_EXISTS; // cmpResult == 0
+		node->next = i + 1 < batch->count ? batch->nodes[i + 1] : NULL;
 	}
-	Node newNode = (Node)malloc(sizeof(*newNode));
-	if (newNode == NULL) {
+	batch->copied[part] = i - start;
+}
+
+/* Builds one of the subtrees listed by treeSplit */
+static void parallelBuildTask(void* argument, int subtree)
+{
+	ParallelBatch batch = (ParallelBatch)argument;
+	batch->roots[subtree] = treeBuild(batch->nodes
+			+ batch->subtrees[2 * subtree], batch->subtrees[2 * subtree + 1],
+			NULL);
+}
+
+/* Lists, in order, the subtrees that treeBuild would make at depth below
+ * count nodes starting at offset */
+static void treeSplit(int offset, int count, int depth, int* subtrees,
+		int* subtreeCount)
+{
+	if (count == 0) {
+		return;
+	}
+	if (depth == 0) {
+		subtrees[2 * *subtreeCount] = offset;
+		subtrees[2 * *subtreeCount + 1] = count;
+		(*subtreeCount)++;
+		return;
+	}
+	int middle = count / 2;
+	treeSplit(offset, middle, depth - 1, subtrees, subtreeCount);
+	treeSplit(offset + middle + 1, count - middle - 1, depth - 1, subtrees,
+			subtreeCount);
+}
+
+/* treeBuild for the levels above depth, taking the subtrees below it in
+ * order from roots. Gives the same tree as treeBuild */
+static Node treeBuildTop(Node* nodes, int count, Node parent, int depth,
+		Node* roots, int* next)
+{
+	if (count == 0) {
+		return NULL;
+	}
+	if (depth == 0) {
+		Node root = roots[(*next)++];
+		root->parent = parent;
+		return root;
+	}
+	int middle = count / 2;
+	Node node = nodes[middle];
+	node->parent = parent;
+	node->left = treeBuildTop(nodes, middle, node, depth - 1, roots, next);
+	node->right = treeBuildTop(nodes + middle + 1, count - middle - 1, node,
+			depth - 1, roots, next);
+	nodeUpdate(node);
+	return node;
+}
+
+/* Builds the tree of the empty set out of the sorted, distinct elements of
+ * batch. Nodes are taken from the pool by the calling thread, then filled and
+ * linked by tasks */
+static SetResult parallelBuildTree(ParallelBatch batch,
+		SetTaskRunner const* runner)
+{
+	Set set = batch->set;
+	int count = batch->count;
+	size_t nodesSize = sizeof(Node) * count;
+	batch->nodes = (Node*)memoryAlloc(set, nodesSize);
+	if (batch->nodes == NULL || !poolReserve(set, count)) {
+		memoryFree(set, batch->nodes, nodesSize);
 		return SET_OUT_OF_MEMORY;
 	}
-	newNode->data = set->copyFunc(element);
-	if (newNode->data == NULL) {
-		free(newNode);
+	for (int i = 0; i < count; i++) {
+		batch->nodes[i] = poolAllocNode(set);
+		assert(batch->nodes[i] != NULL); // reserved above
+	}
+	runner->run(parallelCopyTask, batch, batch->parts, runner->context);
+	bool failed = false;
+	for (int part = 0; part < batch->parts; part++) {
+		int start = parallelPartStart(batch, part);
+		if (batch->copied[part] < parallelPartStart(batch, part + 1) - start) {
+			failed = true;
+		}
+		SET_STATS_ADD(set, elementCopies, batch->copied[part]);
+	}
+	int depth = 0;
+	while ((1 << depth) < batch->parts * PARALLEL_SUBTREES_PER_TASK) {
+		depth++;
+	}
+	size_t subtreesSize = sizeof(int) * 2 << depth;
+	size_t rootsSize = sizeof(Node) << depth;
+	if (!failed) {
+		batch->subtrees = (int*)memoryAlloc(set, subtreesSize);
+		batch->roots = (Node*)memoryAlloc(set, rootsSize);
+		failed = batch->subtrees == NULL || batch->roots == NULL;
+	}
+	if (failed) {
+		for (int part = 0; part < batch->parts; part++) {
+			int start = parallelPartStart(batch, part);
+			for (int i = start; i < start + batch->copied[part]; i++) {
+				nodeFreeElement(set, batch->nodes[i]);
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			poolFreeNode(set, batch->nodes[i]);
+		}
+		memoryFree(set, batch->subtrees, subtreesSize);
+		memoryFree(set, batch->roots, rootsSize);
+		memoryFree(set, batch->nodes, nodesSize);
 		return SET_OUT_OF_MEMORY;
 	}
-	newNode->next = iteratingNode;
-	beforeNode->next = newNode;
-	set->size++;
-	set->current = NULL;
+	int subtreeCount = 0;
+	treeSplit(0, count, depth, batch->subtrees, &subtreeCount);
+	runner->run(parallelBuildTask, batch, subtreeCount, runner->context);
+	int next = 0;
+	Node root = treeBuildTop(batch->nodes, count, NULL, depth, batch->roots,
+			&next);
+	assert(next == subtreeCount);
+	treeReplace(set, root, batch->nodes, count);
+	memoryFree(set, batch->subtrees, subtreesSize);
+	memoryFree(set, batch->roots, rootsSize);
+	memoryFree(set, batch->nodes, nodesSize);
 	return SET_SUCCESS;
 }
 
-SetResult setRemove(Set set, SetElement element)
+SetResult setAddBatchParallel(Set set, SetElement* elements, int count,
+		SetTaskRunner const* runner)
 {
 	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
-	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
-	set->current = NULL; // iterator is undefined for every setRemove result
-	Node iteratingNode = set->dummy->next;
-	Node beforeNode = set->dummy;
-	while (iteratingNode != NULL) {
-		assert(iteratingNode->data != NULL);
-		int cmpResult = set->cmpFunc(iteratingNode->data, element);
-		if (cmpResult > 0) {
-			return SET_ITEM_DOES_NOT_EXIST; // current element greater
-		}
-		if (cmpResult < 0) { // add element after iterating Node
-			iteratingNode = iteratingNode->next;
-			beforeNode = beforeNode->next;
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(elements)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(runner)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(runner->run)
+	int parts = count / PARALLEL_MIN_PART;
+	parts = runner->parallelism < parts ? runner->parallelism : parts;
+	if (parts <= 1) {
+		return setAddBatch(set, elements, count);
+	}
+	for (int i = 0; i < count; i++) {
+		IF_NULL_RETURN_SET_NULL_ARGUMENT(elements[i])
+	}
+	if (setUnshare(set) != SET_SUCCESS) {
+		return SET_OUT_OF_MEMORY;
+	}
+	struct ParallelBatch_t batch;
+	memset(&batch, 0, sizeof(batch));
+	batch.set = set;
+	batch.source = elements;
+	batch.count = count;
+	batch.parts = parts;
+	size_t elementsSize = sizeof(SetElement) * count;
+	size_t offsetsSize = sizeof(int) * (parts + 1);
+	size_t comparisonsSize = sizeof(unsigned long long) * parts;
+	size_t copiedSize = sizeof(int) * parts;
+	SetElement* elementsBlock = (SetElement*)memoryAlloc(set, elementsSize);
+	SetElement* bufferBlock = (SetElement*)memoryAlloc(set, elementsSize);
+	batch.offsets = (int*)memoryAlloc(set, offsetsSize);
+	batch.comparisons = (unsigned long long*)memoryAlloc(set, comparisonsSize);
+	batch.copied = (int*)memoryAlloc(set, copiedSize);
+	SetResult result = SET_OUT_OF_MEMORY;
+	if (elementsBlock != NULL && bufferBlock != NULL && batch.offsets != NULL
+			&& batch.comparisons != NULL && batch.copied != NULL) {
+		batch.elements = elementsBlock;
+		batch.buffer = bufferBlock;
+		for (int part = 0; part < parts; part++) {
+			batch.comparisons[part] = 0;
+		}
+		runner->run(parallelSortTask, &batch, parts, runner->context);
+		for (batch.runParts = 1; batch.runParts < parts; batch.runParts *= 2) {
+			runner->run(parallelMergeTask, &batch, parts, runner->context);
+			SetElement* merged = batch.buffer;
+			batch.buffer = batch.elements;
+			batch.elements = merged;
+		}
+		runner->run(parallelUniqueTask, &batch, parts, runner->context);
+		batch.offsets[0] = 0;
+		for (int part = 0; part < parts; part++) {
+			batch.offsets[part + 1] += batch.offsets[part];
+			SET_STATS_ADD(set, comparisons, batch.comparisons[part]);
+		}
+		runner->run(parallelGatherTask, &batch, parts, runner->context);
+		batch.count = batch.offsets[parts];
+		if (set->tree->size > 0) {
+			result = setAddSorted(set, batch.elements, batch.count);
+		} else {
+			// the parts of the copy phase are taken from the distinct count
+			int distinctParts = batch.count / PARALLEL_MIN_PART;
+			batch.parts = distinctParts < 1 ? 1 : distinctParts < parts
+					? distinctParts : parts;
+			result = parallelBuildTree(&batch, runner);
+		}
+	}
+	memoryFree(set, elementsBlock, elementsSize);
+	memoryFree(set, bufferBlock, elementsSize);
+	memoryFree(set, batch.offsets, offsetsSize);
+	memoryFree(set, batch.comparisons, comparisonsSize);
+	memoryFree(set, batch.copied, copiedSize);
+	return result;
+}
+
+int setToArray(Set set, SetElement* elements, int capacity)
+{
+	if (set == NULL || elements == NULL) {
+		return -1;
+	}
+	int count = 0;
+	for (Node node = set->tree->first; node != NULL && count < capacity;
+			node = node->next) {
+		elements[count++] = node->data;
+	}
+	return count;
+}
+
+/* Set algebra. Both sets are walked in order, side by side, and every element
+ * is classified as being only in the first set, in both, or only in the
+ * second. An operation is the set of classes it keeps */
+#define KEEP_FIRST_ONLY 1
+#define KEEP_BOTH 2
+#define KEEP_SECOND_ONLY 4
+
+#define SET_UNION (KEEP_FIRST_ONLY | KEEP_BOTH | KEEP_SECOND_ONLY)
+#define SET_INTERSECTION KEEP_BOTH
+#define SET_DIFFERENCE KEEP_FIRST_ONLY
+#define SET_SYMMETRIC_DIFFERENCE (KEEP_FIRST_ONLY | KEEP_SECOND_ONLY)
+
+/* Classifies the next element of the walk over first and second. Advances
+ * *first and/or *second past it, and returns the node holding it in *node
+ * (from first if it is in both) */
+static int mergeStep(Set set, Node* first, Node* second, Node* node)
+{
+	int cmpResult = *first == NULL ? 1 : *second == NULL ? -1
+			: cmpElements(set, (*first)->data, (*second)->data);
+	if (cmpResult < 0) {
+		*node = *first;
+		*first = (*first)->next;
+		return KEEP_FIRST_ONLY;
+	}
+	if (cmpResult > 0) {
+		*node = *second;
+		*second = (*second)->next;
+		return KEEP_SECOND_ONLY;
+	}
+	*node = *first;
+	*first = (*first)->next;
+	*second = (*second)->next;
+	return KEEP_BOTH;
+}
+
+/* Releases nodes[0..count) that were copied for a failed operation (the ones
+ * marked with height 0, see setMergeSorted) */
+static void releaseCopiedNodes(Set set, Node* nodes, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (nodes[i]->height == 0) {
+			nodeFreeElement(set, nodes[i]);
+			poolFreeNode(set, nodes[i]);
+		}
+	}
+}
+
+/* Returns a new set with the elements of first and second kept by operation,
+ * built in O(size of first + size of second) */
+static Set setCombine(Set first, Set second, int operation)
+{
+	IF_NULL_RETURN_NULL(first)
+	IF_NULL_RETURN_NULL(second)
+	assert(first->cmpFunc == second->cmpFunc
+			&& first->cmpContextFunc == second->cmpContextFunc
+			&& first->elementSize == second->elementSize);
+	Set result = setCreateInternal(first->copyFunc, first->copyIntoFunc,
+			first->elementSize, first->freeFunc, first->cmpFunc,
+			first->cmpContextFunc, first->cmpContext, &first->allocator);
+	IF_NULL_RETURN_NULL(result)
+	int maxCount = (operation & KEEP_SECOND_ONLY) ? first->tree->size + second->tree->size
+			: first->tree->size;
+	size_t nodesSize = sizeof(Node) * ((size_t)maxCount + 1);
+	Node* nodes = (Node*)memoryAlloc(result, nodesSize);
+	if (nodes == NULL || !poolReserve(result, maxCount)) {
+		memoryFree(result, nodes, nodesSize);
+		setDestroy(result);
+		return NULL;
+	}
+	int count = 0;
+	Node firstNode = first->tree->first, secondNode = second->tree->first;
+	while (firstNode != NULL || secondNode != NULL) {
+		Node source;
+		if ((mergeStep(first, &firstNode, &secondNode, &source) & operation) == 0) {
 			continue;
 		}
-		// cmpResult == 0 => delete the node
-		beforeNode->next = iteratingNode->next;
-		set->freeFunc(iteratingNode->data);
-		free(iteratingNode);
-		set->size--;
-		return SET_SUCCESS;
+		Node newNode = poolAllocNode(result);
+		assert(newNode != NULL); // reserved above
+		if (nodeCopyElement(result, newNode, source->data) == NULL) {
+			poolFreeNode(result, newNode);
+			releaseCopiedNodes(result, nodes, count);
+			memoryFree(result, nodes, nodesSize);
+			setDestroy(result);
+			return NULL;
+		}
+		newNode->height = 0;
+		nodes[count++] = newNode;
 	}
-	return SET_ITEM_DOES_NOT_EXIST;
+	treeRebuild(result, nodes, count);
+	memoryFree(result, nodes, nodesSize);
+	if (filterIsActive(first)) {
+		// the result is filtered like first, if there is memory for it
+		result->hashFunc = first->hashFunc;
+		result->filterRate = first->filterRate;
+		result->filterMaxBytes = first->filterMaxBytes;
+		if (!filterBuild(result, count * 2)) {
+			result->hashFunc = NULL;
+		}
+	}
+	return result;
+}
+
+/* Replaces the elements of set by the ones kept by operation, in
+ * O(size of set + size of other). Nodes of set are reused, and only elements
+ * of other that are kept are copied. Leaves set unchanged on failure */
+static SetResult setCombineWith(Set set, Set other, int operation)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(other)
+	assert(set->cmpFunc == other->cmpFunc
+			&& set->cmpContextFunc == other->cmpContextFunc
+			&& set->elementSize == other->elementSize);
+	if (set->tree == other->tree) { // the same set, or copies
+		return (operation & KEEP_BOTH) ? SET_SUCCESS : setClear(set);
+	}
+	if (setUnshare(set) != SET_SUCCESS) {
+		return SET_OUT_OF_MEMORY;
+	}
+	int addedCount = (operation & KEEP_SECOND_ONLY) ? other->tree->size : 0;
+	size_t nodesSize = sizeof(Node)
+			* ((size_t)set->tree->size + addedCount + 1);
+	Node* nodes = (Node*)memoryAlloc(set, nodesSize);
+	if (nodes == NULL || !poolReserve(set, addedCount)) {
+		memoryFree(set, nodes, nodesSize);
+		return SET_OUT_OF_MEMORY;
+	}
+	int count = 0;
+	Node dropped = NULL; // nodes of set to release, linked through next
+	Node setNode = set->tree->first, otherNode = other->tree->first;
+	while (setNode != NULL || otherNode != NULL) {
+		Node source;
+		int kind = mergeStep(set, &setNode, &otherNode, &source);
+		if (kind != KEEP_SECOND_ONLY) { // source is a node of set
+			if (kind & operation) {
+				nodes[count++] = source;
+			} else {
+				source->next = dropped;
+				dropped = source;
+			}
+			continue;
+		}
+		if ((kind & operation) == 0) {
+			continue;
+		}
+		Node newNode = poolAllocNode(set);
+		assert(newNode != NULL); // reserved above
+		if (nodeCopyElement(set, newNode, source->data) == NULL) {
+			poolFreeNode(set, newNode);
+			releaseCopiedNodes(set, nodes, count);
+			memoryFree(set, nodes, nodesSize);
+			treeThread(set); // restores the next links of dropped nodes
+			return SET_OUT_OF_MEMORY;
+		}
+		newNode->height = 0;
+		nodes[count++] = newNode;
+	}
+	while (dropped != NULL) {
+		Node nextDropped = dropped->next;
+		nodeFreeElement(set, dropped);
+		poolFreeNode(set, dropped);
+		dropped = nextDropped;
+	}
+	treeRebuild(set, nodes, count);
+	memoryFree(set, nodes, nodesSize);
+	return SET_SUCCESS;
+}
+
+Set setUnion(Set first, Set second)
+{
+	return setCombine(first, second, SET_UNION);
+}
+
+Set setIntersection(Set first, Set second)
+{
+	return setCombine(first, second, SET_INTERSECTION);
+}
+
+Set setDifference(Set first, Set second)
+{
+	return setCombine(first, second, SET_DIFFERENCE);
+}
+
+Set setSymmetricDifference(Set first, Set second)
+{
+	return setCombine(first, second, SET_SYMMETRIC_DIFFERENCE);
+}
+
+SetResult setUnionWith(Set set, Set other)
+{
+	return setCombineWith(set, other, SET_UNION);
+}
+
+SetResult setIntersectWith(Set set, Set other)
+{
+	return setCombineWith(set, other, SET_INTERSECTION);
+}
+
+SetResult setDifferenceWith(Set set, Set other)
+{
+	return setCombineWith(set, other, SET_DIFFERENCE);
+}
+
+SetResult setSymmetricDifferenceWith(Set set, Set other)
+{
+	return setCombineWith(set, other, SET_SYMMETRIC_DIFFERENCE);
 }
 
 SetResult setClear(Set set)
 {
 	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
 	IS_SET_VALID(set)
-	Node nodeToDelete = set->dummy->next;
-	while (nodeToDelete != NULL) {
-		if (nodeToDelete->data != NULL) {
-			set->freeFunc(nodeToDelete->data);
+	set->current = NULL;
+	if (treeIsShared(set)) {
+		// leave the elements to the other sets, nothing needs copying
+		Tree empty = treeCreate(set, set->tree->nodeSize);
+		if (empty == NULL) {
+			return SET_OUT_OF_MEMORY;
 		}
-		Node nextNode = nodeToDelete->next;
-		free(nodeToDelete);
-		nodeToDelete = nextNode;
+		setDropTree(set);
+		set->tree = empty;
+		if (set->hashFunc != NULL && !filterBuild(set, 0)) {
+			set->hashFunc = NULL; // the set is usable without its filter
+		}
+		return SET_SUCCESS;
+	}
+	treeFreeElements(set, set->tree->root);
+	poolRelease(set); // frees the nodes slab by slab
+	set->tree->root = NULL;
+	set->tree->first = NULL;
+	set->tree->last = NULL;
+	set->tree->size = 0;
+	if (filterIsActive(set)) {
+		filterBuild(set, set->tree->filter.capacity); // zeroes its bits
 	}
-	set->dummy->next = NULL;
-	set->current = NULL;
-	set->size = 0;
 	return SET_SUCCESS;
 }
 
@@ -269,7 +2361,7 @@ void setDestroy(Set set)
 	if (set == NULL) {
 		return; // mimic free() behavior
 	}
-	setClear(set);
-	free(set->dummy);
-	free(set);
+	setDropTree(set);
+	SetAllocator allocator = set->allocator;
+	allocator.deallocate(set, sizeof(*set), allocator.context);
 }
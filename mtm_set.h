@@ -1,6 +1,8 @@
 #ifndef SET_H_
 #define SET_H_
 
+#include <stddef.h>
+
 #ifdef __cplusplus 
 extern "C" {
 #endif
@@ -15,20 +17,66 @@ extern "C" {
  *
  * The following functions are available:
  *   setCreate		- Creates a new empty set
- *   setCopy		- Copies an existing set
+ *   setCreateInline	- Creates a new empty set storing elements inside its nodes
+ *   setCreateInlineWithContext - Same, with a compare function taking a context
+ *   setSetCompareContext - Replaces the context of the compare function
+ *   setCreateWithAllocator - Creates a new empty set taking its memory from
+ *   				  given allocation functions
+ *   setCreateInlineWithAllocator - Same, for an inline set with a compare
+ *   				  function taking a context
+ *   setSetAllocatorContext - Replaces the context of the allocation functions
+ *   setCreateWithCapacity - Creates a new empty set with room for a given
+ *   				  number of elements
+ *   setReserve		- Makes room for a given number of elements
+ *   setCopy		- Copies an existing set, in O(1)
+ *   setIsShared	- Tells if a set shares its elements with copies of it
+ *   setUnshare		- Gives a set its own copy of elements it shares
  *   setDestroy		- Deletes an existing set and frees all resources
  *   setGetSize		- Returns the size of a given set
  *   setContains		- Searches an item exists inside the set and returns it
  *					  found.
  *					  This resets the internal iterator.
+ *   setFind		- Like setContains, but returns an iterator to the item.
+ *   setContainsBatch - Like setContains, for an array of items at once.
+ *   setLowerBound	- Returns an iterator to the first item not less than an item.
+ *   setUpperBound	- Returns an iterator to the first item greater than an item.
+ *   setRank		- Returns the number of items less than an item.
+ *   setGetNth		- Returns an iterator to the item at a given index.
+ *   setCountRange	- Returns the number of items in a range.
  *   setGetFirst	-  Returns an iterator to the first element in the set.
  *   setGetNext		- Advances the iterator to the next element
+ *   setGetLast		- Returns an iterator to the last element in the set.
+ *   setGetPrevious	- Moves the iterator back to the previous element
  *   setGetElement  - Returns the element pointed to by the iterator received as argument
  *   setAdd			- Adds a new element to the set.
+ *   setAddBatch	- Adds an array of elements to the set.
+ *   setAddBatchParallel - Same, sorting and building with several threads.
+ *   setToArray		- Lists the elements of the set in an array.
+ *   setLocate		- Finds an element, or the position where it belongs.
+ *   setAllocateElement - Allocates a node for constructing an element in place.
+ *   setDeallocateElement - Releases a node that was not linked to the set.
+ *   setLinkElement	- Links an element constructed in place at a position
+ *   				  found by setLocate.
+ *   setLinkElementAt - Same, with the side of the position already known.
+ *   setInsertElement - Links an element constructed in place, unless an
+ *   				  equal element exists.
  *   setRemove		- Removes an element which matches a given element (by the
  *   				  compare function). Resets the internal iterator.
+ *   setRemoveIterator - Removes the element pointed to by an iterator.
+ *   setGetRoot		- Returns the root node of the set's tree.
+ *   setUnion, setIntersection, setDifference, setSymmetricDifference
+ *   				- Create a new set out of two sets.
+ *   setUnionWith, setIntersectWith, setDifferenceWith,
+ *   setSymmetricDifferenceWith
+ *   				- Update a set by another set.
  *	 setClear		- Clears the contents of the set. Frees all the elements of
  *	 				  the set using the free function.
+ *	 setGetStats	- Returns the operation counters of a set.
+ *	 setResetStats	- Zeroes the operation counters of a set.
+ *	 setEnableFilter	- Keeps a Bloom filter of the elements, so that most
+ *	 				  lookups of absent elements skip the tree.
+ *	 setDisableFilter - Drops the filter of a set.
+ *	 setFilterMayContain - Tells if the filter of a set may hold an element.
  * 	 SET_FOREACH	- A macro for iterating over the set's elements.
  */
 
@@ -47,12 +95,23 @@ typedef enum SetResult_t {
 /** Element data type for set container */
 typedef void* SetElement;
 
-/** Node type for iteration over container */
+/**
+ * Node type for iteration over container.
+ * An iterator is the node holding the element, so it stays valid until that
+ * element is removed from the set.
+ */
 typedef void* SetIterator;
 
 /** Type of function for copying an element of the set */
 typedef SetElement(*copySetElements)(SetElement);
 
+/**
+ * Type of function for copying an element into memory owned by the set
+ * (see setCreateInline). Should construct a copy of the second argument at
+ * the first argument, and return the first argument, or NULL on failure.
+ */
+typedef SetElement(*copySetElementsInto)(SetElement, SetElement);
+
 /** Type of function for deallocating an element of the set */
 typedef void(*freeSetElements)(SetElement);
 
@@ -66,6 +125,65 @@ typedef void(*freeSetElements)(SetElement);
  */
 typedef int(*compareSetElements)(SetElement, SetElement);
 
+/**
+ * Same as compareSetElements, for comparisons that need some state. The third
+ * argument is the context given to setCreateInlineWithContext.
+ */
+typedef int(*compareSetElementsWithContext)(SetElement, SetElement, void*);
+
+/**
+ * Type of function used to hash an element (see mtm_unordered_set.h).
+ * Elements which are equal by the comparison function must have equal hashes.
+ */
+typedef size_t(*hashSetElements)(SetElement);
+
+/**
+ * Same as hashSetElements, for the filter of a set (see setEnableFilter).
+ * The second argument is the context of the set's compare function.
+ */
+typedef size_t(*hashSetElementsWithContext)(SetElement, void*);
+
+/**
+ * Allocation functions of a set (see setCreateWithAllocator). allocate
+ * returns a block of at least the given size aligned to 16 bytes, or NULL if
+ * there is no memory. deallocate receives a block from allocate and the size
+ * it was allocated with. Both are given context, which may be NULL.
+ */
+typedef struct SetAllocator_t {
+	void* (*allocate)(size_t size, void* context);
+	void (*deallocate)(void* block, size_t size, void* context);
+	void* context;
+} SetAllocator;
+
+/**
+ * Operation counters of a set (see setGetStats). They are only kept when the
+ * set is built with SET_ENABLE_STATS defined, and are all 0 otherwise.
+ */
+typedef struct SetStats_t {
+	unsigned long long comparisons; // calls of the compare function
+	unsigned long long nodesVisited; // tree nodes visited by searches
+	unsigned long long allocations; // memory blocks allocated by the set
+	unsigned long long deallocations; // memory blocks freed by the set
+	unsigned long long elementCopies; // calls of the copy function
+	unsigned long long elementFrees; // calls of the free function
+	unsigned long long filterChecks; // lookups that consulted the filter
+	unsigned long long filterRejections; // lookups the filter answered alone
+} SetStats;
+
+/**
+ * Runs tasks for setAddBatchParallel, possibly concurrently. run calls
+ * task(argument, index) once for every index from 0 to count - 1, in any
+ * order and on any threads, and returns once all of them returned. context
+ * is passed to run. parallelism is the number of threads run uses, and
+ * decides how many tasks the work is split into.
+ */
+typedef struct SetTaskRunner_t {
+	void (*run)(void (*task)(void*, int), void* argument, int count,
+			void* context);
+	int parallelism;
+	void* context;
+} SetTaskRunner;
+
 
 
 /**
@@ -84,7 +202,132 @@ typedef int(*compareSetElements)(SetElement, SetElement);
 Set setCreate(copySetElements copyElement, freeSetElements freeElement, compareSetElements compareElements);
 
 /**
- * setCopy: Creates a copy of target set.
+ * setCreateInline: Allocates a new empty set that stores its elements inside
+ * its own nodes, instead of holding pointers to elements allocated by the
+ * copy function. Every element then costs a single (pooled) allocation.
+ * Elements must not require an alignment stricter than 16 bytes.
+ *
+ * @param elementSize - The size in bytes of an element.
+ * @param copyElement - Function pointer used to construct a copy of an element
+ * 		in memory provided by the set.
+ * @param destroyElement - Function pointer used when an element is removed.
+ * 		Should release the resources held by the element, but not the memory of
+ * 		the element itself, which belongs to the set.
+ * @param compareElements - As in setCreate.
+ * @return
+ * 	NULL - if one of the parameters is NULL or 0, or allocations failed.
+ * 	A new Set in case of success.
+ */
+Set setCreateInline(size_t elementSize, copySetElementsInto copyElement,
+		freeSetElements destroyElement, compareSetElements compareElements);
+
+/**
+ * setCreateInlineWithContext: Same as setCreateInline, with a compare
+ * function that is given context as its third argument on every call.
+ * Copies of the set (setCopy, set algebra) share the context.
+ *
+ * @param context - Passed to compareElements. May be NULL.
+ * @return
+ * 	NULL - if one of the function parameters is NULL, elementSize is 0 or
+ * 	allocations failed.
+ * 	A new Set in case of success.
+ */
+Set setCreateInlineWithContext(size_t elementSize,
+		copySetElementsInto copyElement, freeSetElements destroyElement,
+		compareSetElementsWithContext compareElements, void* context);
+
+/**
+ * setSetCompareContext: Replaces the context passed to the compare function
+ * of a set created by setCreateInlineWithContext. The new context must order
+ * the elements the same way as the old one; this is meant for when the state
+ * the context points to moves.
+ *
+ * @param set - Target set.
+ * @param context - The new context.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setSetCompareContext(Set set, void* context);
+
+/**
+ * setCreateWithAllocator: Same as setCreate, except that all the memory of
+ * the set (the set itself, its nodes, which come in slabs, and temporary
+ * buffers) is taken from allocator instead of malloc. Elements are still
+ * allocated by copyElement. Copies of the set (setCopy, set algebra) use the
+ * same allocator, as they share its memory.
+ * An allocator whose deallocate does nothing, like a per-request arena, lets
+ * a set be dropped without freeing it: the memory is released with the arena.
+ *
+ * @param allocator - The allocation functions, copied into the set.
+ * @return
+ * 	NULL - if one of the parameters (or functions of allocator) is NULL or
+ * 	allocations failed.
+ * 	A new Set in case of success.
+ */
+Set setCreateWithAllocator(copySetElements copyElement,
+		freeSetElements freeElement, compareSetElements compareElements,
+		SetAllocator const* allocator);
+
+/**
+ * setCreateInlineWithAllocator: Same as setCreateInlineWithContext, taking
+ * all the memory of the set, including the elements stored in its nodes,
+ * from allocator (see setCreateWithAllocator).
+ */
+Set setCreateInlineWithAllocator(size_t elementSize,
+		copySetElementsInto copyElement, freeSetElements destroyElement,
+		compareSetElementsWithContext compareElements, void* context,
+		SetAllocator const* allocator);
+
+/**
+ * setSetAllocatorContext: Replaces the context passed to the allocation
+ * functions of a set, as setSetCompareContext does for the compare function.
+ * The new context must allocate from the same memory as the old one.
+ *
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setSetAllocatorContext(Set set, void* context);
+
+/**
+ * setCreateWithCapacity: Allocates a new empty set, with room for capacity
+ * elements.
+ * Nodes are allocated from a pool owned by the set, so adding up to capacity
+ * elements does not allocate memory other than the one done by copyElement.
+ *
+ * @param copyElement, freeElement, compareElements - As in setCreate.
+ * @param capacity - The number of elements to make room for.
+ * @return
+ * 	NULL - if one of the parameters is NULL or allocations failed.
+ * 	A new Set in case of success.
+ */
+Set setCreateWithCapacity(copySetElements copyElement,
+		freeSetElements freeElement, compareSetElements compareElements,
+		int capacity);
+
+/**
+ * setReserve: Makes room in the set's node pool so that the set can hold
+ * capacity elements without allocating more nodes.
+ * Does nothing if the set already has room for capacity elements.
+ *
+ * @param set - Target set.
+ * @param capacity - The number of elements to make room for.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set
+ * 	SET_OUT_OF_MEMORY if an allocation failed
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setReserve(Set set, int capacity);
+
+/**
+ * setCopy: Creates a copy of target set, in O(1).
+ * The copy shares the elements of set. The first of them to be modified
+ * afterwards copies the elements (see setUnshare), so a copy that is never
+ * modified costs almost nothing. That modification invalidates the iterators
+ * of the modified set, except the ones passed to it, and may fail with
+ * SET_OUT_OF_MEMORY if copying fails. With GCC and Clang, copies may be used
+ * from different threads like independent sets.
  *
  * @param set - Target set.
  * @return
@@ -93,6 +336,30 @@ Set setCreate(copySetElements copyElement, freeSetElements freeElement, compareS
  */
 Set setCopy(Set set);
 
+/**
+ * setIsShared: Tells if set shares its elements with copies of it (or with
+ * the set it was copied from).
+ *
+ * @param set - Target set.
+ * @return
+ * 	Non zero if set shares its elements, 0 if not or if a NULL was sent.
+ */
+int setIsShared(Set set);
+
+/**
+ * setUnshare: Gives set its own copy of the elements it shares, if it shares
+ * them (see setCopy). Modifying functions do this themselves, it is only
+ * needed by callers that search the tree directly (see setGetRoot) before
+ * modifying it. The iterators of set are invalidated if a copy is made.
+ *
+ * @param set - Target set.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set
+ * 	SET_OUT_OF_MEMORY if copying the elements failed. set is unchanged.
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setUnshare(Set set);
+
 /**
  * setDestroy: Deallocates an existing set. Clears all elements by using the
  * stored free function.
@@ -130,8 +397,9 @@ SetIterator setGetFirst(Set set);
 /**
 *	setGetNext: Advances the iterator to the next element
 *	The next element is determined by the comparison function induced order.
+*	Runs in O(1).
 * @param set - The set for which to advance the iterator
-* @param iter - The iterator to advance
+* @param iter - The iterator to advance. Must be an iterator of set.
 * @return
 * 	NULL if reached the end of the set, or the iterator is at an invalid state
 * 	or a NULL sent as argument
@@ -139,6 +407,30 @@ SetIterator setGetFirst(Set set);
 */
 SetIterator setGetNext(Set set, SetIterator iter);
 
+/**
+ *	setGetLast: Returns an iterator to the last element in the set, the one
+ *	having the greatest value, in O(1). Use this with setGetPrevious to
+ *	iterate over the set backwards.
+ * @param set - The set for which to set the iterator and return the last
+ * 		element.
+ * @return
+ * 	NULL if a NULL pointer was sent or the set is empty.
+ * 	Iterator to last element of the set otherwise
+ */
+SetIterator setGetLast(Set set);
+
+/**
+ *	setGetPrevious: Moves the iterator back to the previous element.
+ *	Runs in O(1) amortized over a walk, so visiting the last k elements
+ *	costs O(k + log n).
+ * @param set - The set for which to move the iterator
+ * @param iter - The iterator to move. Must be an iterator of set.
+ * @return
+ * 	NULL if iter was the first element, or a NULL was sent as argument
+ * 	Iterator to the previous element in the set otherwise
+ */
+SetIterator setGetPrevious(Set set, SetIterator iter);
+
 /**
 *	setGetElement: Returns the element pointed to by the iterator
 * @param set - The set for which to advance the iterator
@@ -165,6 +457,87 @@ SetElement setGetElement(Set set, SetIterator iter);
  */
 SetElement setContains(Set set, SetElement element);
 
+/**
+ *	setFind: if the given element exists in the set, returns an iterator to
+ *  it and sets the internal iterator to it.
+ *	Matching is done as in setContains.
+ * @param set - The set to search in
+ * @param element - The element to look for. Will be compared using the
+ * 					comparison function.
+ * @return
+ * 	NULL if a NULL pointer was sent or if the element was not found.
+ * 	An iterator to the found element in case of success
+ */
+SetIterator setFind(Set set, SetElement element);
+
+/**
+ *	setContainsBatch: looks up an array of elements, as setContains does
+ *  for each of them, faster than one at a time. Sorted elements are looked
+ *  up in a single walk over the set when there are enough of them.
+ *  Otherwise the lookups are interleaved with prefetching, so the cache
+ *  misses of many lookups overlap. Resets the internal iterator.
+ * @param set - The set to search in
+ * @param elements - The elements to look for
+ * @param count - The number of elements
+ * @param found - Receives, for every element, the equal element of the set
+ * 		or NULL if there is none. Must have room for count elements.
+ * @return
+ * 	SET_NULL_ARGUMENT - if a NULL pointer was sent, in the arrays too.
+ * 	SET_SUCCESS - Otherwise.
+ */
+SetResult setContainsBatch(Set set, SetElement* elements, int count,
+		SetElement* found);
+
+/**
+ *	setLowerBound: returns an iterator to the first element of the set (in
+ *  the order induced by the comparison function) which is not less than
+ *  the given element, and sets the internal iterator to it. Runs in
+ *  O(log n).
+ * @param set - The set to search in
+ * @param element - The element to compare to.
+ * @return
+ * 	NULL if a NULL pointer was sent or if all elements are less than element.
+ * 	An iterator to the found element in case of success
+ */
+SetIterator setLowerBound(Set set, SetElement element);
+
+/**
+ *	setUpperBound: same as setLowerBound, for the first element which is
+ *  greater than the given element.
+ */
+SetIterator setUpperBound(Set set, SetElement element);
+
+/**
+ *	setRank: returns the number of elements of the set which are less than
+ *  the given element, which is the index of the element if it is in the
+ *  set. Runs in O(log n).
+ * @return
+ * 	-1 if a NULL pointer was sent.
+ * 	The number of smaller elements otherwise.
+ */
+int setRank(Set set, SetElement element);
+
+/**
+ *	setGetNth: returns an iterator to the element at the given index of the
+ *  iteration order (0 for the first element), and sets the internal
+ *  iterator to it. Runs in O(log n).
+ * @return
+ * 	NULL if a NULL pointer was sent or index is not in [0, size).
+ * 	An iterator to the element otherwise.
+ */
+SetIterator setGetNth(Set set, int index);
+
+/**
+ *	setCountRange: returns the number of elements of the set in the range
+ *  [low, high), that is not less than low and less than high. Runs in
+ *  O(log n).
+ * @return
+ * 	-1 if a NULL pointer was sent.
+ * 	The number of elements in the range otherwise (0 if high is not greater
+ * 	than low).
+ */
+int setCountRange(Set set, SetElement low, SetElement high);
+
 
 /**
  *	setAdd: Adds a new element to the set.
@@ -183,6 +556,174 @@ SetElement setContains(Set set, SetElement element);
  */
 SetResult setAdd(Set set, SetElement element);
 
+/**
+ *	setAddBatch: Adds an array of elements to the set. Elements which are
+ *	equal to an element of the set, or to an earlier element of the array,
+ *	are skipped.
+ *	A sorted batch (by the comparison function, without duplicates) is
+ *	merged with the set in O(size + count); any other batch is sorted first,
+ *	in O(count log count). Small batches are added one by one.
+ *  Iterator's value is undefined after this operation.
+ *
+ * @param set - The set for which to add the elements
+ * @param elements - The elements to insert. Copies of the elements are
+ * 		inserted, as in setAdd.
+ * @param count - The number of elements in the array
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set or elements, or one of the
+ * 		elements is NULL. No element is added in that case.
+ * 	SET_OUT_OF_MEMORY if an allocation failed. Some of the elements may have
+ * 		been added.
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setAddBatch(Set set, SetElement* elements, int count);
+
+/**
+ *	setAddBatchParallel: Same as setAddBatch, with the work split into tasks
+ *	run by runner. The batch is sorted and its duplicates removed by
+ *	runner->parallelism tasks. When the set is empty, the elements are then
+ *	copied into their nodes and the tree is built by tasks as well; otherwise
+ *	the batch is merged with the set as in setAddBatch.
+ *	The compare and copy functions of the set are called from the tasks, so
+ *	they must be safe to call concurrently. Batches too small to be worth
+ *	splitting are added by setAddBatch.
+ *  Iterator's value is undefined after this operation.
+ *
+ * @param set - The set for which to add the elements
+ * @param elements - The elements to insert, as in setAddBatch
+ * @param count - The number of elements in the array
+ * @param runner - Runs the tasks (see SetTaskRunner)
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set, elements, runner or its run
+ * 		function, or one of the elements is NULL. No element is added in that
+ * 		case.
+ * 	SET_OUT_OF_MEMORY if an allocation failed. Some of the elements may have
+ * 		been added.
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setAddBatchParallel(Set set, SetElement* elements, int count,
+		SetTaskRunner const* runner);
+
+/**
+ *	setToArray: Lists the elements of the set in iteration order. The
+ *	elements are not copied, they are still owned by the set.
+ *
+ * @param set - The set to list
+ * @param elements - Output array of at least capacity elements
+ * @param capacity - The maximal number of elements to list
+ * @return
+ * 	-1 if a NULL was sent as set or elements
+ * 	The number of elements written to the array otherwise
+ */
+int setToArray(Set set, SetElement* elements, int capacity);
+
+/*
+ * In-place construction (inline sets only, see setCreateInline).
+ * The following functions let the caller construct an element directly in
+ * the node that will hold it, instead of having it copied by the copy
+ * function. A typical insertion is:
+ *
+ *	SetIterator position;
+ *	if (setLocate(set, key, &position) == SET_ITEM_DOES_NOT_EXIST) {
+ *		SetElement storage = setAllocateElement(set);
+ *		... construct the element at storage ...
+ *		position = setLinkElement(set, storage, position);
+ *	}
+ */
+
+/**
+ *	setLocate: Searches the set for an element, reporting where it is, or
+ *	where it belongs if it is not in the set.
+ *
+ * @param set - The set to search in
+ * @param element - The element to look for.
+ * @param position - Output. The iterator of the equal element if there is
+ * 		one. Otherwise the insertion position, to be passed to setLinkElement.
+ * 		The insertion position is only valid until the set is next modified.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as one of the parameters
+ * 	SET_ITEM_ALREADY_EXISTS if an equal element exists in the set
+ * 	SET_OUT_OF_MEMORY if the element was not found, and the set shared its
+ * 		elements and copying them (ahead of the link) failed
+ * 	SET_ITEM_DOES_NOT_EXIST otherwise
+ */
+SetResult setLocate(Set set, SetElement element, SetIterator* position);
+
+/**
+ *	setAllocateElement: Allocates a node from the set's pool, which is not
+ *	yet part of the set, and returns the storage of its element.
+ *	The caller should construct an element there, and then pass it to
+ *	setLinkElement or setInsertElement, or destroy it and pass it to
+ *	setDeallocateElement. The set must not be copied meanwhile.
+ *
+ * @param set - The set to allocate a node for
+ * @return
+ * 	NULL if a NULL was sent or an allocation failed
+ * 	The element storage (of the set's element size) otherwise
+ */
+SetElement setAllocateElement(Set set);
+
+/**
+ *	setDeallocateElement: Returns a node allocated with setAllocateElement and
+ *	not linked to the set to the set's pool. The free function is not called.
+ *
+ * @param set - The set the node was allocated from
+ * @param element - The storage returned by setAllocateElement
+ */
+void setDeallocateElement(Set set, SetElement element);
+
+/**
+ *	setLinkElement: Links an element constructed with setAllocateElement at
+ *	the position returned by setLocate. The set must not have been modified
+ *	since that call. From now on the element is owned by the set.
+ *  Iterator's value is undefined after this operation.
+ *
+ * @param set - The set to link the element to
+ * @param element - The storage returned by setAllocateElement
+ * @param position - The insertion position returned by setLocate
+ * @return
+ * 	NULL if a NULL was sent as set or element
+ * 	An iterator to the linked element otherwise
+ */
+SetIterator setLinkElement(Set set, SetElement element, SetIterator position);
+
+/**
+ *	setLinkElementAt: Same as setLinkElement, for a caller that searched the
+ *	tree itself (see setGetRoot) and knows on which side of the parent the
+ *	element belongs. No comparison is made.
+ *
+ * @param set - The set to link the element to
+ * @param element - The storage returned by setAllocateElement
+ * @param parent - The leaf-side node to link the element under, NULL if the
+ * 		set is empty
+ * @param asLeftChild - Non zero to link element as the left child of parent
+ * @return
+ * 	NULL if a NULL was sent as set or element, or if the set shared its
+ * 		elements and copying them failed
+ * 	An iterator to the linked element otherwise
+ */
+SetIterator setLinkElementAt(Set set, SetElement element, SetIterator parent,
+		int asLeftChild);
+
+/**
+ *	setInsertElement: Links an element constructed with setAllocateElement
+ *	to the set, unless an equal element already exists.
+ *  Iterator's value is undefined after this operation.
+ *
+ * @param set - The set to link the element to
+ * @param element - The storage returned by setAllocateElement
+ * @param position - Output. Iterator to the linked element, or to the equal
+ * 		element already in the set.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as one of the parameters
+ * 	SET_ITEM_ALREADY_EXISTS if an equal element exists. The element is not
+ * 		linked and still belongs to the caller.
+ * 	SET_OUT_OF_MEMORY if the set shared its elements and copying them failed.
+ * 		The element still belongs to the caller.
+ * 	SET_SUCCESS if the element was linked to the set.
+ */
+SetResult setInsertElement(Set set, SetElement element, SetIterator* position);
+
 /**
  * 	setRemove: Removes an element from the set. The element is found using the
  * 	comparison function given at initialization. Once found, the element is
@@ -197,21 +738,207 @@ SetResult setAdd(Set set, SetElement element);
  * @return
  * 	SET_NULL_ARGUMENT if a NULL was sent as set
  * 	SET_ITEM_DOES_NOT_EXIST if the element doesn't exist in the set
+ * 	SET_OUT_OF_MEMORY if the set shared its elements and copying them failed
  * 	SET_SUCCESS if the element was successfully removed.
  */
 SetResult setRemove(Set set, SetElement element);
 
+/**
+ * 	setRemoveIterator: Removes the element pointed to by iter from the set,
+ * 	without searching for it. The element is deallocated using the free
+ * 	function, and iter becomes invalid.
+ *  Iterator's value is undefined after this operation.
+ *
+ * @param set - The set to remove the element from.
+ * @param iter - An iterator of set pointing to the element.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as one of the parameters
+ * 	SET_OUT_OF_MEMORY if the set shared its elements and copying them failed
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setRemoveIterator(Set set, SetIterator iter);
+
+/**
+ * 	setGetRoot: Returns the root node of the set's tree (see mtm_set_node.h),
+ * 	for code that searches the tree itself. The tree may be shared with
+ * 	copies of the set, see setUnshare.
+ *
+ * @param set - The set
+ * @return
+ * 	NULL if a NULL was sent or the set is empty
+ * 	The root node otherwise
+ */
+SetIterator setGetRoot(Set set);
+
+/*
+ * Set algebra.
+ * Both sets are walked once, side by side in iteration order, so every
+ * operation runs in O(n + m) for sets of sizes n and m. The two sets must
+ * have been created with the same comparison function and (for inline sets)
+ * the same element size.
+ */
+
+/**
+ * setUnion: Creates a set of the elements that are in first or in second.
+ * Elements are copied using the copy function of first.
+ * @param first, second - The sets to combine. Not modified.
+ * @return
+ * 	NULL if a NULL was sent or a memory allocation failed.
+ * 	The new set otherwise.
+ */
+Set setUnion(Set first, Set second);
+
+/**
+ * setIntersection: Creates a set of the elements that are in both first and
+ * second. Elements are copied from first.
+ * @param first, second - The sets to combine. Not modified.
+ * @return
+ * 	NULL if a NULL was sent or a memory allocation failed.
+ * 	The new set otherwise.
+ */
+Set setIntersection(Set first, Set second);
+
+/**
+ * setDifference: Creates a set of the elements of first that are not in
+ * second.
+ * @param first, second - The sets to combine. Not modified.
+ * @return
+ * 	NULL if a NULL was sent or a memory allocation failed.
+ * 	The new set otherwise.
+ */
+Set setDifference(Set first, Set second);
+
+/**
+ * setSymmetricDifference: Creates a set of the elements that are in exactly
+ * one of first and second.
+ * @param first, second - The sets to combine. Not modified.
+ * @return
+ * 	NULL if a NULL was sent or a memory allocation failed.
+ * 	The new set otherwise.
+ */
+Set setSymmetricDifference(Set first, Set second);
+
+/**
+ * setUnionWith: Adds to set the elements of other it does not contain.
+ * The in-place operations keep the elements (and iterators) of set that
+ * remain in it, and copy only elements of other that are added.
+ * Iterator's value is undefined after this operation.
+ * @param set - The set to update.
+ * @param other - The set to update by. Not modified.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent
+ * 	SET_OUT_OF_MEMORY if an allocation failed. set is left unchanged.
+ * 	SET_SUCCESS otherwise
+ */
+SetResult setUnionWith(Set set, Set other);
+
+/**
+ * setIntersectWith: Removes from set the elements that are not in other.
+ * Iterator's value is undefined after this operation.
+ * @return - As in setUnionWith.
+ */
+SetResult setIntersectWith(Set set, Set other);
+
+/**
+ * setDifferenceWith: Removes from set the elements that are in other.
+ * Iterator's value is undefined after this operation.
+ * @return - As in setUnionWith.
+ */
+SetResult setDifferenceWith(Set set, Set other);
+
+/**
+ * setSymmetricDifferenceWith: Removes from set the elements that are in
+ * other, and adds the elements of other that were not in set.
+ * Iterator's value is undefined after this operation.
+ * @return - As in setUnionWith.
+ */
+SetResult setSymmetricDifferenceWith(Set set, Set other);
+
 /**
  * setClear: Removes all elements from target set.
- * The elements are deallocated using the stored free function
+ * The elements are deallocated using the stored free function, and the
+ * set's node pool is released. Elements shared with copies of the set are
+ * left to the copies.
  * @param set
  * 	Target set to remove all element from
  * @return
  * 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+ * 	SET_OUT_OF_MEMORY - if the set shared its elements and allocating a new
+ * 		empty set failed.
  * 	SET_SUCCESS - Otherwise.
  */
 SetResult setClear(Set);
 
+/**
+ * setGetStats: Returns the work done through set since it was created,
+ * copied (a copy starts from 0) or last reset. Nodes are allocated in
+ * slabs, so allocations counts slabs and other blocks, not elements.
+ * Without SET_ENABLE_STATS all counters are 0.
+ * @param set - The set whose counters are requested
+ * @param stats - Receives the counters
+ * @return
+ * 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+ * 	SET_SUCCESS - Otherwise.
+ */
+SetResult setGetStats(Set set, SetStats* stats);
+
+/**
+ * setResetStats: Zeroes the operation counters of set, so the work of a
+ * following workload can be measured on its own.
+ * @return
+ * 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+ * 	SET_SUCCESS - Otherwise.
+ */
+SetResult setResetStats(Set set);
+
+/**
+ * setEnableFilter: Keeps a blocked Bloom filter of the elements of set.
+ * setFind, setContains and setRemove (and mtm::set::find) consult it first,
+ * and return at once for most elements which are not in the set, without
+ * searching the tree. Elements that are in the set always pass the filter.
+ * A lookup passing it costs a hash on top of the search, so the filter pays
+ * off when most lookups miss.
+ *
+ * The filter is sized for twice the number of elements at the given false
+ * positive rate, about 1.44 * log2(1 / falsePositiveRate) bits per element,
+ * and is rebuilt in O(n) as the set doubles, or when half of its capacity
+ * went to elements removed since it was built. maxBytes bounds its memory;
+ * a filter kept smaller than its rate needs rejects less. Copies of the set
+ * keep the filter, and the results of set algebra get one like their first
+ * operand's. Enabling a filter again rebuilds it with the new parameters.
+ * The rate of rejections is available through setGetStats.
+ * @param set - The set to filter
+ * @param hashElement - Hashes an element, receiving the context of the
+ * 		compare function. Equal elements must have equal hashes.
+ * @param falsePositiveRate - The rate of absent elements which pass the
+ * 		filter, between 2^-16 and 0.5 (other values are clamped).
+ * @param maxBytes - Upper bound of the filter size, or 0 for no bound.
+ * @return
+ * 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+ * 	SET_OUT_OF_MEMORY - if an allocation failed, the set has no filter then.
+ * 	SET_SUCCESS - Otherwise.
+ */
+SetResult setEnableFilter(Set set, hashSetElementsWithContext hashElement,
+		double falsePositiveRate, size_t maxBytes);
+
+/**
+ * setDisableFilter: Drops the filter of set, if it has one, and frees it
+ * unless copies of the set still use it.
+ * @return
+ * 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+ * 	SET_SUCCESS - Otherwise.
+ */
+SetResult setDisableFilter(Set set);
+
+/**
+ * setFilterMayContain: Consults only the filter of set, in O(1).
+ * @return
+ * 	0 if a NULL pointer was sent or the element is certainly not in the set.
+ * 	1 if the element may be in the set, which is always the answer of a set
+ * 	without a filter.
+ */
+int setFilterMayContain(Set set, SetElement element);
+
 
 /**
  * Macro for iterating over a set.
@@ -1,483 +1,2042 @@
-#ifndef MTM_SET_HPP_
-#define MTM_SET_HPP_
-
-/* The minimum of headers required */
-#include <utility>
-#include <iterator>
-#include <exception>
-#include <memory>
-#include <assert.h>
-
-/* The C Set generic ADT */
-#include "mtm_set.h"
-
-namespace mtm {
-
-	/**
-	 * Generic Set Class
-	 *
-	 * template <class T, class CmpFcn = std::less<T> >
-	 * class set
-	 *
-	 * T - Stored data type
-	 * CmpFcn - Function object class performing comparison. Default is
-	 * 	   std::less<T>, a (template) class provided in the STL which
-	 * 	   uses T::operator<(T const& other) for comparison.
-	 *
-	 * Implements a set container type. A const_iterator class is provided
-	 * to access the elements of the set. Element type (template parameter)
-	 * must implement (public) copy constructor, destructor and operator <() .
-	 *
-	 * Note: set iterator must be constant (disallowing element modification
-	 * since that might affect the order of elements in the set.
-	 *
-	 * The following public members are available:
-	 *
-	 * Types:
-	 *  class const_iterator - allows iteration over set elements
-	 *  value_type - typedef for T
-	 *  const_reference - typedef for T const&
-	 *  result_type - result value of set insert (see set insert documentation).
-	 *
-	 * Functions:
-	 *  set - set constructor. initializes empty set.
-	 *  set(const set& other) - copy constructor, copies all elements from other.
-	 *  operator= - assignment operator. copies all elements from other.
-	 *  ~set - destroys the set and frees all memory allocated.
-	 *
-	 * Functions for iteration:
-	 *  begin - create a const iterator to first element of the set.
-	 *  end - create a const iterator to one-past-the-last element of the set.
-	 *  cbegin - create a const iterator to first element of the set.
-	 *  cend - create a const iterator to one-past-the-last element of the set.
-	 *
-	 *  Notes:
-	 *  1. In the case of the set container, both begin() and cbegin() need to
-	 *     return const_iterator (and same for end(),cend()) to disallow editing
-	 *     set elements.
-	 *     Both versions of functions are needed to provide STL compatibility.
-	 *
-	 *  2. In C++ 11, iteration over constant containers can be done either by
-	 *     iteration:
-	 *
-	 *     typedef mtm::set<my_element_type> my_set_t;
-	 *     my_set_t cont;
-	 *
-	 *     for(my_set_t::const_iterator it=cont.cbegin(); it!=cont.end(); ++it)
-	 *     {
-	 *        //--- TODO: DO-SOMETHING ---//
-	 *     }
-	 *
-	 *     Or, directly over the elements:
-	 *     for(my_set_t::const_reference el : cont)
-	 *     {
-	 *       // At each iteration el contains the value of one of the
-	 *       //  set elements. Iteration is done in ascending order, induced by
-	 *       //  my_element_type::operator <()
-	 *     }
-	 *
-	 * Other member functions:
-	 *  size - number of elements in set
-	 *
-	 *  find - obtain const iterator to element. If element not found, return value
-	 *         must compare to set<T>::end();
-	 *  find const - identical to non-const find(). Both return const_iterator to
-	 *				disallow modification of set elements.
-	 *
-	 *  insert - inserts element. Return value is a pair <const_iterator, bool>.
-	 *           if the element was inserted, the iterator will be pointing to it
-	 *           and second will be true. Otherwise (an element with the same value
-	 *           exists), element will not be inserted, and the iterator will be
-	 *		    pointing to the existing element in the set.
-	 *
-	 *  erase(T const& element) - erases given value from the set.
-	 *  erase(const_iterator iter) - erases element pointed to by iterator.
-	 *
-	 *  clear() - erases all elements in the set.
-	 */
-
-	template<class T, class CmpFcn = std::less<T> >
-	class set
-	{
-	public:
-		/** iterator type for the container */
-		class const_iterator;
-		/** element data type */
-		typedef T value_type;
-		/** const reference to element data type */
-		typedef T const& const_reference;
-		/** set insert result type */
-		typedef std::pair<const_iterator, bool> result_type;
-		/**
-		 * Ctor/CCtor/Dtor/assignment operator 
-		 *  In case that memory allocation fails constructors/operator= should 
-		 *  throw std::bad_alloc. 
-		 */
-		set();
-		set(const set& other);
-		set& operator=(set const& other);
-		~set();
-		/** 
-		 * Iteration functions
-		 * Should always succeed. Error cases may be handled by assert()
-		 */
-		const_iterator begin() const;
-		const_iterator end() const;
-		const_iterator cbegin() const;
-		const_iterator cend() const;
-		/** returns the number of elements in the set */
-		int size() const;
-		/** 
-		 * find
-		 * obtain const iterator to element. If element not found, return value
-		 *  must compare to set<T>::end();  
-		 */
-		const_iterator find(T const&);
-		/**
-		 * find const 
-		 *  a const overload of find. obtain const iterator to element. If 
-		 *  element not found, return value must compare to set<T>::cend();
-		 */
-		const_iterator find(T const&) const;
-		/**
-		 * insert 
-		 *  inserts an element to the set.
-		 *  Return value is a pair <const_iterator, bool>.
-		 *  - if the element was inserted, the iterator will be pointing to it
-		 *    and second will be true.
-		 *  - Otherwise(an element with the same value already exists), element 
-		 *    will not be inserted, and the iterator will point to the existing 
-		 *    element in the set.
-		 *
-		 *  Does not invalidate iterators. 
-		 */
-		result_type insert(T const& data);
-		/**
-		 * erase(T const& element) 
-		 *  erases given value from the set. 
-		 *  Throws ElementNotFound() if value does not exist in the set. 
-		 *
-		 *  Does not invalidate iterators pointing to other elements. 
-		 */
-		void erase(T const& element);
-		/**
-		 * erase(const_iterator iter) 
-		 *  erases element pointed to by iterator.
-		 *  Throws InvalidIterator() if iterator does not point to an element. 
-		 *
-		 *  Does not invalidate iterators pointing to other elements. 
-		 */
-		void erase(const_iterator iter);
-		/**
-		 * clear
-		 *  erases all elements in the set. After invocation size() returns 0. 
-		 */
-		void clear();
-		//--------------- Exception types: -------------
-		// A general set exception class: 
-		class Exception: public std::exception
-		{
-		};
-		class ElementNotFound: public Exception
-		{
-		};
-		class InvalidIterator: public Exception
-		{
-		};
-
-	private:
-		/** Underlying C set object */
-		Set m_CSet;
-		/** Functions for C set object */
-		static SetElement CopyElementFcn(SetElement lmnt);
-		static void DestroyElementFcn(SetElement lmnt);
-		static int CompareElementFcn(SetElement left, SetElement right);
-	};
-
-	///////////
-	// iterator
-	///////////
-
-	/** 
-	 * Const iterator class for the generic set implementation. 
-	 * Iterator is inherited with and std::forward_iterator_tag to signal to the
-	 *	STL that it may only be advanced in the forward direction. 
-	 */
-	template<class T, class CmpFcn>
-	class set<T, CmpFcn>::const_iterator: public std::iterator<
-			std::forward_iterator_tag, T>
-	{
-	public:
-		/** Prefix and postfix operators to advance the iterator */
-		const_iterator & operator++()
-		{
-			m_Current = setGetNext(m_Owner->m_CSet, m_Current);
-			return *this;
-		}
-		const_iterator operator++(int)
-		{
-			const_iterator newIterator(*this);
-			++*this;
-			return newIterator;
-		}
-
-		/**
-		 * Dereference operator to obtain value the iterator points to. 
-		 * returns const reference type since this is const_iterator. 
-		 */
-		T const& operator*() const;
-
-		/** auto-generated functions that are kept as is */
-		const_iterator(const_iterator const&) = default;
-		const_iterator& operator=(const_iterator const&) = default;
-		~const_iterator() = default;
-
-		bool operator==(const_iterator const& other) const;
-		bool operator!=(const_iterator const& other) const;
-
-	private:
-		/** Needed to allow the set access the private constructor */
-		friend class set;
-
-		/** Set object the iterator belongs to */
-		set<T, CmpFcn> const* m_Owner;
-
-		/** Element of the C implementation the iterator currently points to */
-		SetIterator m_Current;
-
-		/** Constructor for the iterator, to be used by set<T>::begin() */
-		const_iterator(set<T, CmpFcn> const* owner, SetIterator cset_iter);
-	};
-
-	///////////
-	// set funcs
-	///////////
-
-	template<class T, class CmpFcn>
-	set<T, CmpFcn>::set() :
-			m_CSet(NULL)
-	{
-		m_CSet = setCreate(CopyElementFcn, DestroyElementFcn,
-				CompareElementFcn);
-		if (NULL == m_CSet) {
-			throw Exception();
-		}
-	}
-
-	template<class T, class CmpFcn>
-	set<T, CmpFcn>::set(const set& sourceSet) :
-			m_CSet(NULL)
-	{
-		m_CSet = setCopy(sourceSet.m_CSet);
-		if (NULL == m_CSet) {
-			throw Exception();
-		}
-	}
-
-	template<class T, class CmpFcn>
-	set<T, CmpFcn>& set<T, CmpFcn>::operator=(const set<T, CmpFcn>& sourceSet)
-	{
-		if (this == &sourceSet) {
-			return *this;
-		}
-		setDestroy(m_CSet);
-		m_CSet = setCopy(sourceSet.m_CSet);
-		if (NULL == m_CSet) {
-			throw Exception();
-		}
-		return *this;
-	}
-
-	template<class T, class CmpFcn>
-	set<T, CmpFcn>::~set()
-	{
-		setDestroy(m_CSet);
-	}
-
-	template<class T, class CmpFcn>
-	int set<T, CmpFcn>::size() const
-	{
-		assert(m_CSet != NULL);
-		return setGetSize(m_CSet);
-	}
-
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::const_iterator set<T, CmpFcn>::find(
-			T const& element)
-	{
-		for (set<T, CmpFcn>::const_iterator it = begin(); it != end(); ++it) {
-			if (*it == element) {
-				return it;
-			}
-		}
-		throw ElementNotFound();
-	}
-
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::const_iterator set<T, CmpFcn>::find(
-			T const& element) const
-	{
-		for (set<T, CmpFcn>::const_iterator it = begin(); it != end(); ++it) {
-			if (*it == element) {
-				return it;
-			}
-		}
-		throw ElementNotFound();
-	}
-
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::result_type set<T, CmpFcn>::insert(T const& data)
-	{
-		assert(m_CSet != NULL);
-		T* dataPtr = new T(data);
-		SetResult res = setAdd(m_CSet, static_cast<SetElement>(dataPtr));
-		delete dataPtr;
-		assert(res != SET_NULL_ARGUMENT);
-		if (res == SET_OUT_OF_MEMORY) {
-			throw Exception();
-		}
-		if (res == SET_ITEM_ALREADY_EXISTS) {
-			return result_type(find(data), false);
-		}
-		return result_type(find(data), true); // SET_SUCCESS
-	}
-
-	template<class T, class CmpFcn>
-	void set<T, CmpFcn>::erase(T const& element)
-	{
-		assert(m_CSet != NULL);
-		T* lmntNew = new T(element);
-		if (setRemove(m_CSet, static_cast<SetElement>(lmntNew))
-				== SET_ITEM_DOES_NOT_EXIST) {
-			delete lmntNew;
-			throw ElementNotFound();
-		}
-		delete lmntNew;
-	}
-
-	template<class T, class CmpFcn>
-	void set<T, CmpFcn>::erase(set<T, CmpFcn>::const_iterator iter)
-	{
-		erase(*iter);
-		// if iter does not point to an element, *iter will throw InvalidIterator()
-	}
-
-	template<class T, class CmpFcn>
-	void set<T, CmpFcn>::clear()
-	{
-		assert(m_CSet != NULL);
-		setClear(m_CSet);
-	}
-
-	///////////
-	// private set funcs
-	///////////
-
-	template<class T, class CmpFcn>
-	int set<T, CmpFcn>::CompareElementFcn(SetElement left, SetElement right)
-	{
-		if (NULL == left || NULL == right)
-			return 0;
-
-		T const& leftT = *static_cast<T*>(left);
-		T const& rightT = *static_cast<T*>(right);
-		if (CmpFcn().operator()(leftT, rightT))
-			return -1;
-		if (CmpFcn().operator()(rightT, leftT))
-			return 1;
-		return 0;
-	}
-
-	template<class T, class CmpFcn>
-	SetElement set<T, CmpFcn>::CopyElementFcn(SetElement lmnt)
-	{
-		if (lmnt == NULL) {
-			return NULL;
-		}
-		const T& lmntT = *static_cast<T*>(lmnt);
-		T* lmntNew = new T(lmntT);
-		return static_cast<SetElement>(lmntNew);
-	}
-
-	template<class T, class CmpFcn>
-	void set<T, CmpFcn>::DestroyElementFcn(SetElement lmnt)
-	{
-		if (lmnt == NULL) {
-			return;
-		}
-		T* lmntTptr = static_cast<T*>(lmnt);
-		delete lmntTptr;
-	}
-
-	////////
-	// iteration funcs
-	////////
-
-	// iterator funcs in set
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::const_iterator set<T, CmpFcn>::begin() const
-	{
-		return typename set<T, CmpFcn>::const_iterator::const_iterator(this,
-				setGetFirst(m_CSet));
-	}
-
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::const_iterator set<T, CmpFcn>::cbegin() const
-	{
-		return begin();
-	}
-
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::const_iterator set<T, CmpFcn>::end() const
-	{
-		const_iterator iterator = begin();
-		while (iterator.m_Current != NULL) {
-			++iterator;
-		}
-		return iterator;
-	}
-
-	template<class T, class CmpFcn>
-	typename set<T, CmpFcn>::const_iterator set<T, CmpFcn>::cend() const
-	{
-		return end();
-	}
-
-	// iterator funcs in iterator
-	template<class T, class CmpFcn>
-	set<T, CmpFcn>::const_iterator::const_iterator(set<T, CmpFcn> const* owner,
-			SetIterator cset_iter) :
-			m_Owner(owner), m_Current(cset_iter)
-	{
-	}
-
-	template<class T, class CmpFcn>
-	T const& set<T, CmpFcn>::const_iterator::operator*() const
-	{
-		SetElement element = setGetElement(m_Owner->m_CSet, m_Current);
-		if (element == NULL) {
-			throw InvalidIterator();
-		}
-		return *static_cast<T*>(element);
-	}
-
-	template<class T, class CmpFcn>
-	bool set<T, CmpFcn>::const_iterator::operator!=(
-			const_iterator const& other) const
-	{
-		return !(*this == other);
-	}
-
-	template<class T, class CmpFcn>
-	bool set<T, CmpFcn>::const_iterator::operator==(
-			const_iterator const& other) const
-	{
-		return m_Current == other.m_Current;
-	}
-
-////////////////////////////////////////////////////////
-//########## Add other functions' implementation here.
-////////////////////////////////////////////////////////
-}
-
-#endif // #ifndef MTM_SET_H_
\ No newline at end of file
+#ifndef MTM_SET_HPP_
+#define MTM_SET_HPP_
+
+/* The minimum of headers required */
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <new>
+#include <vector>
+#include <type_traits>
+#include <thread>
+#include <atomic>
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MTM_SET_HAS_MMAP 1
+#endif
+/* mtm::pmr::set is defined where std::pmr is available */
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define MTM_SET_HAS_PMR 1
+#endif
+#endif
+
+/* The C Set generic ADT */
+#include "mtm_set.h"
+#include "mtm_set_node.h"
+
+/* Counts work done inline by mtm::set when built with SET_ENABLE_STATS */
+#ifdef SET_ENABLE_STATS
+#define MTM_SET_STATS_ADD(counter, amount) (m_Stats.counter += (amount))
+#else
+#define MTM_SET_STATS_ADD(counter, amount) ((void)0)
+#endif
+
+/* Starts loading a cache line, where the compiler supports it */
+#ifdef __GNUC__
+#define MTM_SET_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define MTM_SET_PREFETCH(address) ((void)(address))
+#endif
+
+namespace mtm {
+
+	namespace detail {
+
+		/**
+		 * Header of a set snapshot file (see set::save). It is followed by
+		 * count elements of element_size bytes, in the order of the set, as
+		 * they are laid out in memory. Snapshots are only meant to be read
+		 * by the machine that wrote them.
+		 */
+		struct snapshot_header {
+			char magic[8];
+			uint32_t version;
+			uint32_t element_size;
+			uint64_t count;
+			uint64_t reserved; // keeps the elements 16 byte aligned
+
+			static snapshot_header make(size_t elementSize, uint64_t count)
+			{
+				snapshot_header header;
+				memcpy(header.magic, magicBytes(), sizeof(header.magic));
+				header.version = VERSION;
+				header.element_size = static_cast<uint32_t>(elementSize);
+				header.count = count;
+				header.reserved = 0;
+				return header;
+			}
+
+			/** Tells if a file of fileSize bytes is a snapshot of elements */
+			bool matches(size_t elementSize, size_t fileSize) const
+			{
+				return memcmp(magic, magicBytes(), sizeof(magic)) == 0
+						&& version == VERSION && element_size == elementSize
+						&& count <= (fileSize - sizeof(*this)) / elementSize
+						&& sizeof(*this) + count * elementSize == fileSize;
+			}
+
+		private:
+			enum { VERSION = 1 };
+			static const char* magicBytes()
+			{
+				return "mtm_set"; // with the terminating 0, 8 bytes
+			}
+		};
+
+		/**
+		 * Read only view of a whole file. The file is memory-mapped where
+		 * supported, so only the pages that are read are loaded, and is read
+		 * into a buffer otherwise. data() is NULL if the file can not be read.
+		 */
+		class file_view
+		{
+		public:
+			explicit file_view(const char* path) :
+					m_Data(NULL), m_Size(0)
+			{
+#ifdef MTM_SET_HAS_MMAP
+				int fd = open(path, O_RDONLY);
+				if (fd < 0) {
+					return;
+				}
+				struct stat status;
+				if (fstat(fd, &status) == 0 && status.st_size > 0) {
+					void* data = mmap(NULL, static_cast<size_t>(status.st_size),
+							PROT_READ, MAP_PRIVATE, fd, 0);
+					if (data != MAP_FAILED) {
+						// the file is read front to back
+						madvise(data, static_cast<size_t>(status.st_size),
+								MADV_SEQUENTIAL);
+						m_Data = static_cast<const char*>(data);
+						m_Size = static_cast<size_t>(status.st_size);
+					}
+				}
+				close(fd);
+#else
+				FILE* file = fopen(path, "rb");
+				if (file == NULL) {
+					return;
+				}
+				char chunk[1 << 16];
+				size_t read;
+				while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+					m_Buffer.insert(m_Buffer.end(), chunk, chunk + read);
+				}
+				if (!ferror(file) && !m_Buffer.empty()) {
+					m_Data = &m_Buffer[0];
+					m_Size = m_Buffer.size();
+				}
+				fclose(file);
+#endif
+			}
+
+			~file_view()
+			{
+#ifdef MTM_SET_HAS_MMAP
+				if (m_Data != NULL) {
+					munmap(const_cast<char*>(m_Data), m_Size);
+				}
+#endif
+			}
+
+			file_view(file_view const&) = delete;
+			file_view& operator=(file_view const&) = delete;
+
+			const char* data() const
+			{
+				return m_Data;
+			}
+			size_t size() const
+			{
+				return m_Size;
+			}
+
+		private:
+			const char* m_Data;
+			size_t m_Size;
+#ifndef MTM_SET_HAS_MMAP
+			std::vector<char> m_Buffer;
+#endif
+		};
+
+		/** The unit in which mtm::set allocates the memory of the C set */
+		struct alignas(16) allocation_unit {
+			unsigned char bytes[16];
+		};
+
+		/**
+		 * Runs the tasks of setAddBatchParallel (see SetTaskRunner) on the
+		 * calling thread and on more threads, up to the unsigned count that
+		 * context points to. Every thread takes the next task until none are
+		 * left. Fewer threads are used if they can not be started.
+		 */
+		inline void run_tasks(void (*task)(void*, int), void* argument,
+				int count, void* context)
+		{
+			unsigned threads = *static_cast<unsigned const*>(context);
+			std::atomic<int> next(0);
+			auto work = [&]() {
+				for (int index; (index = next++) < count;) {
+					task(argument, index);
+				}
+			};
+			std::vector<std::thread> workers;
+			// exceptions must not cross the C set
+			try {
+				for (unsigned i = 1; i < threads
+						&& i < static_cast<unsigned>(count); i++) {
+					workers.emplace_back(work);
+				}
+			} catch (...) {
+			}
+			work();
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+		}
+	}
+
+	/**
+	 * Execution policy of the parallel range constructor and insert of
+	 * mtm::set: the number of threads to sort and build with, or 0 for one per
+	 * hardware thread. Made by mtm::parallel().
+	 */
+	struct parallel_policy {
+		unsigned threads;
+	};
+
+	inline parallel_policy parallel(unsigned threads = 0)
+	{
+		parallel_policy policy = { threads };
+		return policy;
+	}
+
+	/**
+	 * Generic Set Class
+	 *
+	 * template <class T, class CmpFcn = std::less<T>,
+	 * 		class Allocator = std::allocator<T> >
+	 * class set
+	 *
+	 * T - Stored data type
+	 * CmpFcn - Function object class performing comparison. Default is
+	 * 	   std::less<T>, a (template) class provided in the STL which
+	 * 	   uses T::operator<(T const& other) for comparison.
+	 * 	   The set stores a CmpFcn object, so comparators may have state.
+	 * 	   Lookups walk the tree of the C set directly and call it inline.
+	 * Allocator - Allocator of all the memory of the set: its nodes, which
+	 * 	   hold the elements, come from it in slabs (see
+	 * 	   setCreateInlineWithAllocator). Default is std::allocator<T>. Any
+	 * 	   allocator with plain pointers can be used, like
+	 * 	   std::pmr::polymorphic_allocator<T> (see mtm::pmr::set). Sets
+	 * 	   share nodes (see note 3) only while their allocators are equal.
+	 * 	   Copy, move and swap follow std::allocator_traits: an allocator
+	 * 	   that does not propagate stays with its set, and the elements are
+	 * 	   copied into it if the allocators differ.
+	 *
+	 * Implements a set container type. A const_iterator class is provided
+	 * to access the elements of the set. Element type (template parameter)
+	 * must implement (public) copy constructor, destructor and operator <() .
+	 * Elements are stored inside the nodes of the underlying C set (see
+	 * setCreateInline), so every element costs a single pooled allocation.
+	 *
+	 * Note: set iterator must be constant (disallowing element modification
+	 * since that might affect the order of elements in the set.
+	 *
+	 * The following public members are available:
+	 *
+	 * Types:
+	 *  class const_iterator - allows iteration over set elements
+	 *  value_type - typedef for T
+	 *  const_reference - typedef for T const&
+	 *  result_type - result value of set insert (see set insert documentation).
+	 *  allocator_type - typedef for Allocator
+	 *
+	 * Functions:
+	 *  set - set constructor. initializes empty set.
+	 *  set(CmpFcn const& cmp, Allocator const& alloc = Allocator()) -
+	 *                     initializes empty set ordered by cmp, allocating
+	 *                     from alloc.
+	 *  set(Allocator const& alloc) - initializes empty set allocating from
+	 *                     alloc.
+	 *  set(const set& other) - copy constructor, copies all elements from other.
+	 *                     Runs in O(1), see note 3 below.
+	 *  set(const set& other, Allocator const& alloc) - same, allocating from
+	 *                     alloc. Runs in O(n) if alloc differs from the
+	 *                     allocator of other.
+	 *  set(first, last) - range constructor, initializes the set with the
+	 *                     elements of the range.
+	 *  set(mtm::parallel(threads), first, last) - same, sorting the range
+	 *                     and building the set with several threads.
+	 *  operator= - assignment operator. copies all elements from other, in O(1)
+	 *                     unless the allocators differ (see Allocator).
+	 *  set(set&& other), operator=(set&& other) - move constructor and
+	 *                     assignment, take the elements of other. The move
+	 *                     constructor allocates nothing and never throws, and
+	 *                     leaves other holding no elements, so other may
+	 *                     then only be assigned to, swapped or destroyed.
+	 *  swap - exchanges the elements of two sets.
+	 *  ~set - destroys the set and frees all memory allocated.
+	 *
+	 * Functions for iteration:
+	 *  begin - create a const iterator to first element of the set.
+	 *  end - create a const iterator to one-past-the-last element of the set.
+	 *  cbegin - create a const iterator to first element of the set.
+	 *  cend - create a const iterator to one-past-the-last element of the set.
+	 *  rbegin, rend, crbegin, crend - the same for reverse iteration, from the
+	 *         last (greatest) element, which is reached in O(1).
+	 *
+	 *  Notes:
+	 *  1. In the case of the set container, both begin() and cbegin() need to
+	 *     return const_iterator (and same for end(),cend()) to disallow editing
+	 *     set elements.
+	 *     Both versions of functions are needed to provide STL compatibility.
+	 *
+	 *  2. In C++ 11, iteration over constant containers can be done either by
+	 *     iteration:
+	 *
+	 *     typedef mtm::set<my_element_type> my_set_t;
+	 *     my_set_t cont;
+	 *
+	 *     for(my_set_t::const_iterator it=cont.cbegin(); it!=cont.end(); ++it)
+	 *     {
+	 *        //--- TODO: DO-SOMETHING ---//
+	 *     }
+	 *
+	 *     Or, directly over the elements:
+	 *     for(my_set_t::const_reference el : cont)
+	 *     {
+	 *       // At each iteration el contains the value of one of the
+	 *       //  set elements. Iteration is done in ascending order, induced by
+	 *       //  my_element_type::operator <()
+	 *     }
+	 *
+	 *  3. A copy shares the elements of the set it was copied from, until
+	 *     one of the two is modified. The first modification copies the
+	 *     elements in O(n), and invalidates all iterators of the modified
+	 *     set, and all references to its elements. Copies that are never
+	 *     modified cost almost nothing. The iterators of the other sets that
+	 *     shared the elements stay valid. So, while a set may have copies,
+	 *     keep no iterator or reference across its modifications.
+	 *
+	 * Other member functions:
+	 *  get_allocator - the allocator of the set
+	 *  size - number of elements in set
+	 *  reserve - makes room for a number of elements in the set's node pool
+	 *  stats - operation counters of the set (see setGetStats), kept only when
+	 *          built with SET_ENABLE_STATS.
+	 *  reset_stats - zeroes the operation counters.
+	 *  enable_filter - keeps a Bloom filter of the elements, with which find
+	 *          and erase reject most absent elements without a search.
+	 *  disable_filter - drops the filter.
+	 *
+	 *  find - obtain const iterator to element. If element not found, return value
+	 *         must compare to set<T>::end();
+	 *  find const - identical to non-const find(). Both return const_iterator to
+	 *				disallow modification of set elements.
+	 *  find_many - finds all the values of a range at once, faster than one
+	 *         by one (see setContainsBatch).
+	 *  contains - true if a value is in the set.
+	 *  count - 1 if a value is in the set, 0 otherwise.
+	 *  lower_bound, upper_bound - iterator to the first element not less than,
+	 *         or greater than, a given value.
+	 *  equal_range - the pair of lower_bound and upper_bound of a value.
+	 *  rank - number of elements less than a given value.
+	 *  nth - iterator to the element at a given index.
+	 *  count_range - number of elements in a range of values.
+	 *  All of these run in O(log n). When CmpFcn is transparent (defines
+	 *  is_transparent, as std::less<> does), find, contains, count,
+	 *  lower_bound, upper_bound, equal_range and erase also accept any key
+	 *  CmpFcn compares with T, without constructing a T.
+	 *
+	 *  insert - inserts element. Return value is a pair <const_iterator, bool>.
+	 *           if the element was inserted, the iterator will be pointing to it
+	 *           and second will be true. Otherwise (an element with the same value
+	 *           exists), element will not be inserted, and the iterator will be
+	 *		    pointing to the existing element in the set.
+	 *  insert(T&& data) - same as insert, moving data into the set.
+	 *  insert(first, last) - inserts all the elements of a range.
+	 *  insert(mtm::parallel(threads), first, last) - same, sorting the range
+	 *           with several threads.
+	 *  emplace - same as insert, constructing the element in place from the
+	 *            given constructor arguments.
+	 *
+	 *  erase(T const& element) - erases given value from the set.
+	 *  erase(const_iterator iter) - erases element pointed to by iterator.
+	 *
+	 *  clear() - erases all elements in the set.
+	 *
+	 * Snapshots (for trivially copyable T only):
+	 *  save - writes the elements to a file.
+	 *  load - replaces the elements by those of a file written by save, in
+	 *         linear time.
+	 *
+	 * Set algebra (linear in the sizes of both sets):
+	 *  operator| - union of two sets.
+	 *  operator& - intersection of two sets.
+	 *  operator- - elements of the first set which are not in the second.
+	 *  operator^ - symmetric difference of two sets.
+	 *  operator|=, operator&=, operator-=, operator^= - in-place versions.
+	 */
+
+	template<class T, class CmpFcn = std::less<T>,
+			class Allocator = std::allocator<T> >
+	class set
+	{
+	public:
+		/** iterator type for the container */
+		class const_iterator;
+		/** iterator type for iterating the container backwards */
+		typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+		/** element data type */
+		typedef T value_type;
+		/** const reference to element data type */
+		typedef T const& const_reference;
+		/** set insert result type */
+		typedef std::pair<const_iterator, bool> result_type;
+		/** allocator type */
+		typedef Allocator allocator_type;
+		/**
+		 * Ctor/CCtor/Dtor/assignment operator 
+		 *  In case that memory allocation fails constructors/operator= should 
+		 *  throw std::bad_alloc. 
+		 *  The allocator of a copy is chosen by
+		 *  select_on_container_copy_construction. Assignment takes the
+		 *  allocator of other only if it propagates, see Allocator above.
+		 */
+		set();
+		explicit set(CmpFcn const& cmp, Allocator const& alloc = Allocator());
+		explicit set(Allocator const& alloc);
+		set(const set& other);
+		set(const set& other, Allocator const& alloc);
+		/**
+		 * Range constructor
+		 *  builds the set out of the elements in [first, last). Runs in
+		 *  linear time if the range is sorted, see insert(first, last).
+		 */
+		template<class InputIterator>
+		set(InputIterator first, InputIterator last,
+				CmpFcn const& cmp = CmpFcn(),
+				Allocator const& alloc = Allocator());
+		/**
+		 * Parallel range constructor
+		 *  same as the range constructor, with the range sorted and the set
+		 *  built by policy.threads threads (see setAddBatchParallel). CmpFcn
+		 *  and the copy constructor of T are called from all of them, so they
+		 *  must be safe to call concurrently.
+		 */
+		template<class InputIterator>
+		set(parallel_policy policy, InputIterator first, InputIterator last,
+				CmpFcn const& cmp = CmpFcn(),
+				Allocator const& alloc = Allocator());
+		set& operator=(set const& other);
+		set(set&& other) noexcept(
+				std::is_nothrow_copy_constructible<CmpFcn>::value);
+		set& operator=(set&& other);
+		~set();
+		/**
+		 * exchanges the contents of two sets, and their allocators if they
+		 * propagate on swap. Runs in O(1), unless the allocators differ and
+		 * do not propagate, in which case the elements are copied.
+		 */
+		void swap(set& other);
+		/** returns a copy of the allocator of the set */
+		allocator_type get_allocator() const;
+		/** 
+		 * Iteration functions
+		 * Should always succeed. Error cases may be handled by assert()
+		 */
+		const_iterator begin() const;
+		const_iterator end() const;
+		const_iterator cbegin() const;
+		const_iterator cend() const;
+		/**
+		 * Reverse iteration functions
+		 *  rbegin() points to the last element. Visiting the last k elements
+		 *  costs O(k + log n).
+		 */
+		const_reverse_iterator rbegin() const;
+		const_reverse_iterator rend() const;
+		const_reverse_iterator crbegin() const;
+		const_reverse_iterator crend() const;
+		/** returns the number of elements in the set */
+		int size() const;
+		/**
+		 * reserve
+		 *  makes room for capacity elements, so inserting up to capacity
+		 *  elements allocates no set nodes.
+		 *  Throws Exception() if memory allocation fails.
+		 */
+		void reserve(int capacity);
+		/**
+		 * stats
+		 *  returns the comparisons, node visits, allocations and element
+		 *  copies and frees done by this set since it was constructed,
+		 *  copied or reset_stats() was called. Counts the inlined searches
+		 *  and element constructions too. All 0 unless SET_ENABLE_STATS is
+		 *  defined, by both mtm_set.c and the code including this header.
+		 */
+		SetStats stats() const;
+		/** zeroes the counters returned by stats() */
+		void reset_stats();
+		/**
+		 * enable_filter
+		 *  keeps a Bloom filter of the elements hashed by Hash, sized for the
+		 *  given false positive rate within max_bytes (0 for no bound), see
+		 *  setEnableFilter. find and erase consult it first, so lookups of
+		 *  absent elements mostly skip the tree, while lookups of present
+		 *  ones pay for a hash. Copies keep the filter.
+		 *  Throws Exception() if there is no memory for the filter.
+		 */
+		template<class Hash = std::hash<T> >
+		void enable_filter(double false_positive_rate = 0.01,
+				size_t max_bytes = 0);
+		/** drops the filter of the set */
+		void disable_filter();
+		/** 
+		 * find
+		 * obtain const iterator to element. If element not found, return value
+		 *  must compare to set<T>::end();  
+		 */
+		const_iterator find(T const&);
+		/**
+		 * find const 
+		 *  a const overload of find. obtain const iterator to element. If 
+		 *  element not found, return value must compare to set<T>::cend();
+		 */
+		const_iterator find(T const&) const;
+		/**
+		 * contains, count
+		 *  contains returns true if element is in the set, and count
+		 *  returns 1 if it is and 0 otherwise.
+		 */
+		bool contains(T const& element) const;
+		int count(T const& element) const;
+		/**
+		 * Heterogeneous lookup
+		 *  when CmpFcn defines is_transparent, these overloads take a key of
+		 *  any type CmpFcn can compare with T, such as a const char* or a
+		 *  std::string_view for a set of std::string, and search with it
+		 *  directly instead of constructing a T from it. They behave as the
+		 *  overloads taking T, except that they do not consult the filter,
+		 *  which hashes T.
+		 */
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		const_iterator find(Key const& key);
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		const_iterator find(Key const& key) const;
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		bool contains(Key const& key) const;
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		int count(Key const& key) const;
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		const_iterator lower_bound(Key const& key) const;
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		const_iterator upper_bound(Key const& key) const;
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent>
+		std::pair<const_iterator, const_iterator> equal_range(
+				Key const& key) const;
+		/**
+		 * find_many
+		 *  looks up every value of the range [first, last) and writes an
+		 *  iterator to it, or end() if it is not in the set, to result.
+		 *  Returns result past the last iterator written. Sorted values are
+		 *  found in a single walk over the set when there are enough of
+		 *  them; otherwise the searches are interleaved and prefetch the
+		 *  nodes they visit next, so their cache misses overlap.
+		 */
+		template<class InputIterator, class OutputIterator>
+		OutputIterator find_many(InputIterator first, InputIterator last,
+				OutputIterator result) const;
+		/**
+		 * lower_bound, upper_bound
+		 *  obtain const iterator to the first element which is not less than
+		 *  (lower_bound) or is greater than (upper_bound) element. If there is
+		 *  no such element, return value compares to end().
+		 */
+		const_iterator lower_bound(T const& element) const;
+		const_iterator upper_bound(T const& element) const;
+		/**
+		 * equal_range
+		 *  returns the pair <lower_bound(element), upper_bound(element)>,
+		 *  which holds the element if it is in the set and is empty otherwise.
+		 */
+		std::pair<const_iterator, const_iterator> equal_range(
+				T const& element) const;
+		/**
+		 * rank
+		 *  returns the number of elements less than element, which is the
+		 *  index of element if it is in the set.
+		 */
+		int rank(T const& element) const;
+		/**
+		 * nth
+		 *  obtain const iterator to the element at index (begin() for 0). If
+		 *  index is not in [0, size()), return value compares to end().
+		 */
+		const_iterator nth(int index) const;
+		/**
+		 * count_range
+		 *  returns the number of elements in [low, high), that are not less
+		 *  than low and are less than high.
+		 */
+		int count_range(T const& low, T const& high) const;
+		/**
+		 * insert 
+		 *  inserts an element to the set.
+		 *  Return value is a pair <const_iterator, bool>.
+		 *  - if the element was inserted, the iterator will be pointing to it
+		 *    and second will be true.
+		 *  - Otherwise(an element with the same value already exists), element 
+		 *    will not be inserted, and the iterator will point to the existing 
+		 *    element in the set.
+		 *
+		 *  Does not invalidate iterators, unless the set shares its elements
+		 *  with a copy (see note 3), in which case all are invalidated.
+		 */
+		result_type insert(T const& data);
+		/**
+		 * insert(T&& data)
+		 *  same as insert, except the new element is move-constructed from
+		 *  data. data is not moved from if an equal element already exists.
+		 */
+		result_type insert(T&& data);
+		/**
+		 * emplace
+		 *  same as insert, except the element is constructed in place from
+		 *  args. The element is constructed once even if it turns out an equal
+		 *  element already exists, in which case it is destroyed. While the
+		 *  set shares its elements with a copy, the element is constructed
+		 *  aside and moved in only if it is absent. Iterators are invalidated
+		 *  as by insert.
+		 */
+		template<class... Args>
+		result_type emplace(Args&&... args);
+		/**
+		 * insert(first, last)
+		 *  inserts all the elements of [first, last) in a single batch (see
+		 *  setAddBatch): a sorted range is merged with the set in linear time,
+		 *  an unsorted range is sorted first. Iterators are invalidated as by
+		 *  insert.
+		 */
+		template<class InputIterator>
+		void insert(InputIterator first, InputIterator last);
+		/**
+		 * insert(policy, first, last)
+		 *  same as insert(first, last), sorting the range with policy.threads
+		 *  threads. An empty set is also built by them (see the parallel range
+		 *  constructor).
+		 */
+		template<class InputIterator>
+		void insert(parallel_policy policy, InputIterator first,
+				InputIterator last);
+		/**
+		 * erase(T const& element) 
+		 *  erases given value from the set. 
+		 *  Throws ElementNotFound() if value does not exist in the set. 
+		 *
+		 *  Does not invalidate iterators pointing to other elements, unless the
+		 *  set shares its elements with a copy (see note 3), in which case all
+		 *  are invalidated.
+		 */
+		void erase(T const& element);
+		/**
+		 * erase(Key const& key)
+		 *  erases the element equal to key, for a transparent CmpFcn (see
+		 *  Heterogeneous lookup). Keys convertible to const_iterator go to
+		 *  the overload below.
+		 */
+		template<class Key, class C = CmpFcn, class = typename C::is_transparent,
+				class = typename std::enable_if<
+						!std::is_convertible<Key, const_iterator>::value>::type>
+		void erase(Key const& key);
+		/**
+		 * erase(const_iterator iter) 
+		 *  erases element pointed to by iterator.
+		 *  Throws InvalidIterator() if iterator does not point to an element
+		 *  of this set.
+		 *
+		 *  Does not invalidate iterators pointing to other elements, unless the
+		 *  set shares its elements with a copy (see note 3), in which case all
+		 *  others are invalidated. iter itself must be valid: an iterator
+		 *  taken before an earlier modification that copied the elements
+		 *  points into the elements of another set.
+		 */
+		void erase(const_iterator iter);
+		/**
+		 * clear
+		 *  erases all elements in the set. After invocation size() returns 0. 
+		 *  Invalidates all iterators.
+		 */
+		void clear();
+		/**
+		 * save
+		 *  writes a snapshot of the set to the file at path: a header, then
+		 *  the elements in order, byte for byte. Only available when T is
+		 *  trivially copyable.
+		 *  Throws SnapshotError() if the file can not be written.
+		 */
+		void save(const char* path) const;
+		/**
+		 * load
+		 *  replaces the elements of the set by those of the snapshot at
+		 *  path. The file is memory-mapped and the tree is built in a single
+		 *  linear pass, as the snapshot is sorted (if it was saved with
+		 *  another order it is sorted first). Invalidates all iterators.
+		 *  Throws SnapshotError() if the file can not be read or is not a
+		 *  snapshot of T elements, and Exception() if memory allocation
+		 *  fails. The set is unchanged in both cases.
+		 */
+		void load(const char* path);
+		/**
+		 * Set algebra
+		 *  the operands are walked side by side in order, so every operator
+		 *  runs in O(size() + other.size()) and copies only the elements that
+		 *  end up in the result.
+		 *  The in-place operators keep the elements of the set that remain in
+		 *  it, and iterators to them stay valid, unless the set shares its
+		 *  elements with a copy (see note 3), in which case all are
+		 *  invalidated.
+		 *  Throws Exception() if memory allocation fails.
+		 */
+		set operator|(set const& other) const;
+		set operator&(set const& other) const;
+		set operator-(set const& other) const;
+		set operator^(set const& other) const;
+		set& operator|=(set const& other);
+		set& operator&=(set const& other);
+		set& operator-=(set const& other);
+		set& operator^=(set const& other);
+		//--------------- Exception types: -------------
+		// A general set exception class: 
+		class Exception: public std::exception
+		{
+		};
+		class ElementNotFound: public Exception
+		{
+		};
+		class InvalidIterator: public Exception
+		{
+		};
+		class SnapshotError: public Exception
+		{
+		};
+
+	private:
+		/** Elements are placed in C set nodes, aligned to 16 bytes */
+		static_assert(alignof(T) <= 16, "mtm::set element over-aligned");
+		/** Underlying C set object */
+		Set m_CSet;
+		/** The comparator. The C set reaches it through its compare context */
+		mutable CmpFcn m_Cmp;
+		/** The allocator. The C set reaches it through its allocator context */
+		Allocator m_Alloc;
+#ifdef SET_ENABLE_STATS
+		/** Work done by the inline code, the C set counts the rest */
+		mutable SetStats m_Stats;
+#endif
+		/** Takes ownership of a C set, used by set algebra */
+		set(Set cset, CmpFcn const& cmp, Allocator const& alloc);
+		/** Points the compare and allocator contexts of the C set at this object */
+		void bindContext();
+		/**
+		 * Replaces the allocator along with the nodes it allocated. Copy
+		 * constructs it, as allocators like polymorphic_allocator can not be
+		 * assigned.
+		 */
+		void assignAllocator(Allocator const& alloc);
+		typedef std::allocator_traits<Allocator> alloc_traits;
+		/** Tells if nodes allocated by one allocator can be freed by the other */
+		static bool allocatorsEqual(Allocator const& left,
+				Allocator const& right);
+		/** Exchanges the elements and comparators with other, not the allocators */
+		void swapElements(set& other);
+		/** Exchanges the allocators with other, which keep their nodes */
+		void swapAllocators(set& other);
+		/** The allocator hands out nodes as arrays of aligned units */
+		typedef typename std::allocator_traits<Allocator>::template
+				rebind_alloc<detail::allocation_unit> unit_allocator;
+		typedef std::allocator_traits<unit_allocator> unit_traits;
+		/** Node of the C set holding an element */
+		typedef struct SetNode_t Node;
+		static T const& nodeValue(Node const* node);
+		/**
+		 * Searches the tree with the comparator inlined. Returns the node of
+		 * the element equal to element if there is one. Otherwise returns
+		 * NULL, and element belongs under *parent, on its left if *goLeft.
+		 * Key is T, or any type a transparent CmpFcn compares with T.
+		 */
+		template<class Key>
+		Node* locate(Key const& element, Node** parent, bool* goLeft) const;
+		/**
+		 * Searches the tree like locate for the first node not less than
+		 * element, or greater than element if strict. Returns it, or NULL if
+		 * there is none, and sets *rank to the number of nodes before it.
+		 */
+		template<class Key>
+		Node* bound(Key const& element, bool strict, int* rank) const;
+		/** Throws Exception() if an in-place set algebra operation failed */
+		set& checkResult(SetResult result);
+		/** Functions for C set object */
+		static SetElement CopyElementFcn(SetElement dest, SetElement lmnt);
+		static void DestroyElementFcn(SetElement lmnt);
+		static int CompareElementFcn(SetElement left, SetElement right,
+				void* context);
+		template<class Hash>
+		static size_t HashElementFcn(SetElement lmnt, void* context);
+		static void* AllocateFcn(size_t size, void* context);
+		static void DeallocateFcn(void* block, size_t size, void* context);
+		/**
+		 * Constructs the element from data in its node, after a single search
+		 * that both checks for an equal element and finds the position.
+		 */
+		template<class Arg>
+		result_type insertElement(Arg&& data);
+		/**
+		 * Batch insertion of a range whose elements stay in place while it is
+		 * iterated (std::true_type), or of any other range (std::false_type),
+		 * which is copied aside first. The batch is added by runner's tasks
+		 * if there is one (see setAddBatchParallel).
+		 */
+		template<class InputIterator>
+		void insertRange(InputIterator first, InputIterator last,
+				SetTaskRunner const* runner, std::true_type);
+		template<class InputIterator>
+		void insertRange(InputIterator first, InputIterator last,
+				SetTaskRunner const* runner, std::false_type);
+		/** true_type for ranges whose elements can be referred to in place */
+		template<class InputIterator>
+		struct is_in_place;
+		/** find_many of a range that stays in place, or of any other range */
+		template<class InputIterator, class OutputIterator>
+		OutputIterator findMany(InputIterator first, InputIterator last,
+				OutputIterator result, std::true_type) const;
+		template<class InputIterator, class OutputIterator>
+		OutputIterator findMany(InputIterator first, InputIterator last,
+				OutputIterator result, std::false_type) const;
+		/**
+		 * Sets found[i] to the node equal to *keys[i], or NULL, for count
+		 * keys. Sorted keys are merged with the elements, other keys are
+		 * searched for several at a time.
+		 */
+		void locateMany(T const* const* keys, size_t count, Node** found) const;
+	};
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	struct set<T, CmpFcn, Allocator>::is_in_place: std::integral_constant<bool,
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<InputIterator>::iterator_category>::value
+			&& std::is_lvalue_reference<
+					typename std::iterator_traits<InputIterator>::reference>::value
+			&& std::is_same<typename std::decay<typename std::iterator_traits<
+					InputIterator>::reference>::type, T>::value>
+	{
+	};
+
+	///////////
+	// iterator
+	///////////
+
+	/** 
+	 * Const iterator class for the generic set implementation. 
+	 * Iterator is inherited with std::bidirectional_iterator_tag to signal to
+	 *	the STL that it may be moved in both directions. Advancing is a single
+	 *	pointer hop, going back is O(1) amortized.
+	 */
+	template<class T, class CmpFcn, class Allocator>
+	class set<T, CmpFcn, Allocator>::const_iterator
+	{
+	public:
+		/** Iterator traits, as std::iterator_traits reads them */
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T const* pointer;
+		typedef T const& reference;
+
+		/** Prefix and postfix operators to advance the iterator */
+		const_iterator & operator++()
+		{
+			m_Current = setGetNext(m_Owner->m_CSet, m_Current);
+			return *this;
+		}
+		const_iterator operator++(int)
+		{
+			const_iterator newIterator(*this);
+			++*this;
+			return newIterator;
+		}
+
+		/**
+		 * Prefix and postfix operators to move the iterator back. Moving
+		 * back from end() reaches the last element.
+		 */
+		const_iterator & operator--()
+		{
+			m_Current = m_Current == NULL ? setGetLast(m_Owner->m_CSet)
+					: setGetPrevious(m_Owner->m_CSet, m_Current);
+			return *this;
+		}
+		const_iterator operator--(int)
+		{
+			const_iterator newIterator(*this);
+			--*this;
+			return newIterator;
+		}
+
+		/**
+		 * Dereference operator to obtain value the iterator points to. 
+		 * returns const reference type since this is const_iterator. 
+		 */
+		T const& operator*() const;
+
+		/** Singular iterator, which may only be assigned to or compared */
+		const_iterator();
+
+		/** auto-generated functions that are kept as is */
+		const_iterator(const_iterator const&) = default;
+		const_iterator& operator=(const_iterator const&) = default;
+		~const_iterator() = default;
+
+		bool operator==(const_iterator const& other) const;
+		bool operator!=(const_iterator const& other) const;
+
+	private:
+		/** Needed to allow the set access the private constructor */
+		friend class set;
+
+		/** Set object the iterator belongs to */
+		set<T, CmpFcn, Allocator> const* m_Owner;
+
+		/** Node of the C implementation the iterator currently points to */
+		SetIterator m_Current;
+
+		/** Constructor for the iterator, to be used by set<T>::begin() */
+		const_iterator(set<T, CmpFcn, Allocator> const* owner, SetIterator cset_iter);
+	};
+
+	///////////
+	// set funcs
+	///////////
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set() :
+			set(CmpFcn(), Allocator())
+	{
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set(CmpFcn const& cmp, Allocator const& alloc) :
+			m_CSet(NULL), m_Cmp(cmp), m_Alloc(alloc)
+	{
+		SetAllocator allocator = { AllocateFcn, DeallocateFcn, this };
+		m_CSet = setCreateInlineWithAllocator(sizeof(T), CopyElementFcn,
+				DestroyElementFcn, CompareElementFcn, this, &allocator);
+		if (NULL == m_CSet) {
+			throw Exception();
+		}
+		reset_stats();
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set(Allocator const& alloc) :
+			set(CmpFcn(), alloc)
+	{
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	set<T, CmpFcn, Allocator>::set(InputIterator first, InputIterator last,
+			CmpFcn const& cmp, Allocator const& alloc) :
+			set(cmp, alloc)
+	{
+		insert(first, last);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	set<T, CmpFcn, Allocator>::set(parallel_policy policy, InputIterator first,
+			InputIterator last, CmpFcn const& cmp, Allocator const& alloc) :
+			set(cmp, alloc)
+	{
+		insert(policy, first, last);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set(const set& sourceSet) :
+			set(sourceSet, alloc_traits::select_on_container_copy_construction(
+					sourceSet.m_Alloc))
+	{
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set(const set& sourceSet, Allocator const& alloc) :
+			set(sourceSet.m_Cmp, alloc)
+	{
+		if (!allocatorsEqual(m_Alloc, sourceSet.m_Alloc)) {
+			// nodes can only be shared by sets that free them the same way
+			insert(sourceSet.begin(), sourceSet.end());
+			return;
+		}
+		Set copy = setCopy(sourceSet.m_CSet);
+		if (NULL == copy) {
+			throw Exception();
+		}
+		setDestroy(m_CSet);
+		m_CSet = copy;
+		bindContext();
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::operator=(const set<T, CmpFcn, Allocator>& sourceSet)
+	{
+		if (this == &sourceSet) {
+			return *this;
+		}
+		bool propagate =
+				alloc_traits::propagate_on_container_copy_assignment::value;
+		if (!propagate && !allocatorsEqual(m_Alloc, sourceSet.m_Alloc)) {
+			// keep our allocator, and copy the elements into it
+			set copy(sourceSet, m_Alloc);
+			swapElements(copy);
+			reset_stats();
+			return *this;
+		}
+		Set copy = setCopy(sourceSet.m_CSet);
+		if (NULL == copy) {
+			throw Exception();
+		}
+		setDestroy(m_CSet);
+		m_CSet = copy;
+		m_Cmp = sourceSet.m_Cmp;
+		if (propagate) {
+			assignAllocator(sourceSet.m_Alloc);
+		}
+		bindContext();
+		reset_stats();
+		return *this;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set(set&& sourceSet) noexcept(
+			std::is_nothrow_copy_constructible<CmpFcn>::value) :
+			m_CSet(sourceSet.m_CSet), m_Cmp(sourceSet.m_Cmp),
+			m_Alloc(sourceSet.m_Alloc)
+	{
+		// the C set is taken over, sourceSet is left without one
+		sourceSet.m_CSet = NULL;
+		bindContext();
+#ifdef SET_ENABLE_STATS
+		m_Stats = sourceSet.m_Stats;
+#endif
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::operator=(set<T, CmpFcn, Allocator>&& sourceSet)
+	{
+		if (this == &sourceSet) {
+			return *this;
+		}
+		// our old elements are destroyed along with sourceSet
+		if (alloc_traits::propagate_on_container_move_assignment::value) {
+			swapElements(sourceSet);
+			swapAllocators(sourceSet);
+		} else if (allocatorsEqual(m_Alloc, sourceSet.m_Alloc)) {
+			swapElements(sourceSet);
+		} else {
+			// the nodes of sourceSet can not be taken over by our allocator
+			set copy(sourceSet, m_Alloc);
+			swapElements(copy);
+		}
+		return *this;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::~set()
+	{
+		setDestroy(m_CSet);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::swap(set<T, CmpFcn, Allocator>& other)
+	{
+		if (alloc_traits::propagate_on_container_swap::value) {
+			swapElements(other);
+			swapAllocators(other);
+		} else if (allocatorsEqual(m_Alloc, other.m_Alloc)) {
+			swapElements(other);
+		} else {
+			// every set keeps its allocator, the elements are copied into it
+			set ours(*this, other.m_Alloc);
+			set theirs(other, m_Alloc);
+			swapElements(theirs);
+			other.swapElements(ours);
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::allocator_type
+	set<T, CmpFcn, Allocator>::get_allocator() const
+	{
+		return m_Alloc;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	int set<T, CmpFcn, Allocator>::size() const
+	{
+		assert(m_CSet != NULL);
+		return setGetSize(m_CSet);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::reserve(int capacity)
+	{
+		assert(m_CSet != NULL);
+		if (setReserve(m_CSet, capacity) == SET_OUT_OF_MEMORY) {
+			throw Exception();
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	SetStats set<T, CmpFcn, Allocator>::stats() const
+	{
+		SetStats stats;
+		setGetStats(m_CSet, &stats);
+#ifdef SET_ENABLE_STATS
+		stats.comparisons += m_Stats.comparisons;
+		stats.nodesVisited += m_Stats.nodesVisited;
+		stats.allocations += m_Stats.allocations;
+		stats.deallocations += m_Stats.deallocations;
+		stats.elementCopies += m_Stats.elementCopies;
+		stats.elementFrees += m_Stats.elementFrees;
+		stats.filterChecks += m_Stats.filterChecks;
+		stats.filterRejections += m_Stats.filterRejections;
+#endif
+		return stats;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::reset_stats()
+	{
+		setResetStats(m_CSet);
+#ifdef SET_ENABLE_STATS
+		m_Stats = SetStats();
+#endif
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Hash>
+	void set<T, CmpFcn, Allocator>::enable_filter(double false_positive_rate,
+			size_t max_bytes)
+	{
+		checkResult(setEnableFilter(m_CSet, HashElementFcn<Hash>,
+				false_positive_rate, max_bytes));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::disable_filter()
+	{
+		checkResult(setDisableFilter(m_CSet));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::find(
+			T const& element)
+	{
+		return static_cast<set<T, CmpFcn, Allocator> const*>(this)->find(element);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::find(
+			T const& element) const
+	{
+		if (!setFilterMayContain(m_CSet, const_cast<T*>(&element))) {
+			return end();
+		}
+		Node* parent;
+		bool goLeft;
+		return const_iterator(this, locate(element, &parent, &goLeft));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	bool set<T, CmpFcn, Allocator>::contains(T const& element) const
+	{
+		if (!setFilterMayContain(m_CSet, const_cast<T*>(&element))) {
+			return false;
+		}
+		Node* parent;
+		bool goLeft;
+		return locate(element, &parent, &goLeft) != NULL;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	int set<T, CmpFcn, Allocator>::count(T const& element) const
+	{
+		return contains(element) ? 1 : 0;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::find(
+			Key const& key)
+	{
+		return static_cast<set<T, CmpFcn, Allocator> const*>(this)->find(key);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::find(
+			Key const& key) const
+	{
+		Node* parent;
+		bool goLeft;
+		return const_iterator(this, locate(key, &parent, &goLeft));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	bool set<T, CmpFcn, Allocator>::contains(Key const& key) const
+	{
+		Node* parent;
+		bool goLeft;
+		return locate(key, &parent, &goLeft) != NULL;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	int set<T, CmpFcn, Allocator>::count(Key const& key) const
+	{
+		return contains(key) ? 1 : 0;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::lower_bound(
+			Key const& key) const
+	{
+		int rank;
+		return const_iterator(this, bound(key, false, &rank));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::upper_bound(
+			Key const& key) const
+	{
+		int rank;
+		return const_iterator(this, bound(key, true, &rank));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class>
+	std::pair<typename set<T, CmpFcn, Allocator>::const_iterator,
+			typename set<T, CmpFcn, Allocator>::const_iterator> set<T, CmpFcn, Allocator>::equal_range(
+			Key const& key) const
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator, class OutputIterator>
+	OutputIterator set<T, CmpFcn, Allocator>::find_many(InputIterator first,
+			InputIterator last, OutputIterator result) const
+	{
+		return findMany(first, last, result, is_in_place<InputIterator>());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::lower_bound(
+			T const& element) const
+	{
+		int rank;
+		return const_iterator(this, bound(element, false, &rank));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::upper_bound(
+			T const& element) const
+	{
+		int rank;
+		return const_iterator(this, bound(element, true, &rank));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	std::pair<typename set<T, CmpFcn, Allocator>::const_iterator,
+			typename set<T, CmpFcn, Allocator>::const_iterator> set<T, CmpFcn, Allocator>::equal_range(
+			T const& element) const
+	{
+		return std::make_pair(lower_bound(element), upper_bound(element));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	int set<T, CmpFcn, Allocator>::rank(T const& element) const
+	{
+		int rank;
+		bound(element, false, &rank);
+		return rank;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::nth(
+			int index) const
+	{
+		assert(m_CSet != NULL);
+		return const_iterator(this, setGetNth(m_CSet, index));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	int set<T, CmpFcn, Allocator>::count_range(T const& low, T const& high) const
+	{
+		int lowRank = rank(low);
+		int highRank = rank(high);
+		return highRank > lowRank ? highRank - lowRank : 0;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::result_type set<T, CmpFcn, Allocator>::insert(T const& data)
+	{
+		return insertElement(data);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::result_type set<T, CmpFcn, Allocator>::insert(T&& data)
+	{
+		return insertElement(std::move(data));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class... Args>
+	typename set<T, CmpFcn, Allocator>::result_type set<T, CmpFcn, Allocator>::emplace(
+			Args&&... args)
+	{
+		assert(m_CSet != NULL);
+		if (setIsShared(m_CSet)) {
+			// allocating in place would copy the shared tree, even for an
+			// element that turns out to be there already
+			T element(std::forward<Args>(args)...);
+			return insertElement(std::move(element));
+		}
+		SetElement storage = setAllocateElement(m_CSet);
+		if (storage == NULL) {
+			throw Exception();
+		}
+		try {
+			new (storage) T(std::forward<Args>(args)...);
+		} catch (...) {
+			setDeallocateElement(m_CSet, storage);
+			throw;
+		}
+		MTM_SET_STATS_ADD(elementCopies, 1);
+		// the key is only known once the element is built
+		Node* parent;
+		bool goLeft;
+		Node* found = locate(*static_cast<T*>(storage), &parent, &goLeft);
+		if (found != NULL) {
+			static_cast<T*>(storage)->~T();
+			MTM_SET_STATS_ADD(elementFrees, 1);
+			setDeallocateElement(m_CSet, storage);
+			return result_type(const_iterator(this, found), false);
+		}
+		return result_type(const_iterator(this,
+				setLinkElementAt(m_CSet, storage, parent, goLeft)), true);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	void set<T, CmpFcn, Allocator>::insert(InputIterator first, InputIterator last)
+	{
+		// elements of a forward range can be referred to without copying
+		insertRange(first, last, NULL, is_in_place<InputIterator>());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	void set<T, CmpFcn, Allocator>::insert(parallel_policy policy,
+			InputIterator first, InputIterator last)
+	{
+		unsigned threads = policy.threads != 0 ? policy.threads
+				: std::thread::hardware_concurrency();
+		threads = threads == 0 ? 1 : threads > INT_MAX ? INT_MAX : threads;
+		SetTaskRunner runner = { detail::run_tasks, static_cast<int>(threads),
+				&threads };
+		insertRange(first, last, &runner, is_in_place<InputIterator>());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::erase(T const& element)
+	{
+		if (!setFilterMayContain(m_CSet, const_cast<T*>(&element))) {
+			throw ElementNotFound();
+		}
+		Node* parent;
+		bool goLeft;
+		Node* found = locate(element, &parent, &goLeft);
+		if (found == NULL) {
+			throw ElementNotFound();
+		}
+		checkResult(setRemoveIterator(m_CSet, found));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key, class C, class, class>
+	void set<T, CmpFcn, Allocator>::erase(Key const& key)
+	{
+		Node* parent;
+		bool goLeft;
+		Node* found = locate(key, &parent, &goLeft);
+		if (found == NULL) {
+			throw ElementNotFound();
+		}
+		checkResult(setRemoveIterator(m_CSet, found));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::erase(set<T, CmpFcn, Allocator>::const_iterator iter)
+	{
+		// the iterator is the node, no need to search for it
+		if (iter.m_Current == NULL || iter.m_Owner != this) {
+			throw InvalidIterator();
+		}
+		checkResult(setRemoveIterator(m_CSet, iter.m_Current));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::clear()
+	{
+		assert(m_CSet != NULL);
+		checkResult(setClear(m_CSet));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::save(const char* path) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+				"mtm::set snapshots need a trivially copyable element type");
+		FILE* file = fopen(path, "wb");
+		if (file == NULL) {
+			throw SnapshotError();
+		}
+		detail::snapshot_header header = detail::snapshot_header::make(
+				sizeof(T), static_cast<uint64_t>(size()));
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+		for (const_iterator it = begin(); written && it != end(); ++it) {
+			written = fwrite(&*it, sizeof(T), 1, file) == 1;
+		}
+		written = fclose(file) == 0 && written;
+		if (!written) {
+			remove(path); // do not leave a truncated snapshot behind
+			throw SnapshotError();
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::load(const char* path)
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+				"mtm::set snapshots need a trivially copyable element type");
+		detail::file_view file(path);
+		detail::snapshot_header header;
+		if (file.data() == NULL || file.size() < sizeof(header)) {
+			throw SnapshotError();
+		}
+		memcpy(&header, file.data(), sizeof(header));
+		if (!header.matches(sizeof(T), file.size())
+				|| header.count > static_cast<uint64_t>(INT_MAX)) {
+			throw SnapshotError();
+		}
+		// an empty copy keeps the comparator, allocator and filter
+		set loaded(*this, m_Alloc);
+		loaded.clear();
+		if (header.count > 0) {
+			// the elements are copied straight out of the mapping
+			char const* elements = file.data() + sizeof(header);
+			std::vector<SetElement> batch(static_cast<size_t>(header.count));
+			for (size_t i = 0; i < batch.size(); i++) {
+				batch[i] = const_cast<char*>(elements + i * sizeof(T));
+			}
+			loaded.checkResult(setAddBatch(loaded.m_CSet, &batch[0],
+					static_cast<int>(batch.size())));
+		}
+		swap(loaded);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator> set<T, CmpFcn, Allocator>::operator|(set const& other) const
+	{
+		return set(setUnion(m_CSet, other.m_CSet), m_Cmp,
+				m_Alloc);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator> set<T, CmpFcn, Allocator>::operator&(set const& other) const
+	{
+		return set(setIntersection(m_CSet, other.m_CSet), m_Cmp,
+				m_Alloc);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator> set<T, CmpFcn, Allocator>::operator-(set const& other) const
+	{
+		return set(setDifference(m_CSet, other.m_CSet), m_Cmp,
+				m_Alloc);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator> set<T, CmpFcn, Allocator>::operator^(set const& other) const
+	{
+		return set(setSymmetricDifference(m_CSet, other.m_CSet), m_Cmp,
+				m_Alloc);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::operator|=(set const& other)
+	{
+		return checkResult(setUnionWith(m_CSet, other.m_CSet));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::operator&=(set const& other)
+	{
+		return checkResult(setIntersectWith(m_CSet, other.m_CSet));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::operator-=(set const& other)
+	{
+		return checkResult(setDifferenceWith(m_CSet, other.m_CSet));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::operator^=(set const& other)
+	{
+		return checkResult(setSymmetricDifferenceWith(m_CSet, other.m_CSet));
+	}
+
+	///////////
+	// private set funcs
+	///////////
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::set(Set cset, CmpFcn const& cmp,
+			Allocator const& alloc) :
+			m_CSet(cset), m_Cmp(cmp), m_Alloc(alloc)
+	{
+		if (NULL == m_CSet) {
+			throw Exception();
+		}
+		bindContext();
+#ifdef SET_ENABLE_STATS
+		m_Stats = SetStats(); // the C set counted building the result
+#endif
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::bindContext()
+	{
+		setSetCompareContext(m_CSet, this);
+		setSetAllocatorContext(m_CSet, this);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::assignAllocator(Allocator const& alloc)
+	{
+		if (&alloc == &m_Alloc) {
+			return;
+		}
+		m_Alloc.~Allocator();
+		new (&m_Alloc) Allocator(alloc);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	bool set<T, CmpFcn, Allocator>::allocatorsEqual(Allocator const& left,
+			Allocator const& right)
+	{
+		return alloc_traits::is_always_equal::value || left == right;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::swapElements(set& other)
+	{
+		using std::swap;
+		swap(m_CSet, other.m_CSet);
+		swap(m_Cmp, other.m_Cmp);
+#ifdef SET_ENABLE_STATS
+		swap(m_Stats, other.m_Stats);
+#endif
+		bindContext();
+		other.bindContext();
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::swapAllocators(set& other)
+	{
+		// the C sets reach the allocators through this and other, which stay
+		Allocator alloc(m_Alloc);
+		assignAllocator(other.m_Alloc);
+		other.assignAllocator(alloc);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	T const& set<T, CmpFcn, Allocator>::nodeValue(Node const* node)
+	{
+		return *static_cast<T const*>(node->data);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key>
+	typename set<T, CmpFcn, Allocator>::Node* set<T, CmpFcn, Allocator>::locate(Key const& element,
+			Node** parent, bool* goLeft) const
+	{
+		assert(m_CSet != NULL);
+		Node* node = static_cast<Node*>(setGetRoot(m_CSet));
+		Node* candidate = NULL; // the last node seen not less than element
+		Node* last = NULL;
+		bool less = false;
+		// one comparison per level, equality is checked once at the end. The
+		// child is selected without a branch, which mispredicts half the time
+		while (node != NULL) {
+			MTM_SET_STATS_ADD(nodesVisited, 1);
+			MTM_SET_STATS_ADD(comparisons, 1);
+			last = node;
+			less = m_Cmp(nodeValue(node), element);
+			candidate = less ? candidate : node;
+			node = less ? node->right : node->left;
+		}
+		*parent = last;
+		*goLeft = !less;
+		if (candidate == NULL) {
+			return NULL;
+		}
+		MTM_SET_STATS_ADD(comparisons, 1);
+		if (!m_Cmp(element, nodeValue(candidate))) {
+			return candidate;
+		}
+		return NULL;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Key>
+	typename set<T, CmpFcn, Allocator>::Node* set<T, CmpFcn, Allocator>::bound(Key const& element,
+			bool strict, int* rank) const
+	{
+		assert(m_CSet != NULL);
+		Node* node = static_cast<Node*>(setGetRoot(m_CSet));
+		Node* found = NULL;
+		*rank = 0;
+		while (node != NULL) {
+			MTM_SET_STATS_ADD(nodesVisited, 1);
+			MTM_SET_STATS_ADD(comparisons, 1);
+			// does node come before the bound
+			bool before = strict ? !m_Cmp(element, nodeValue(node))
+					: m_Cmp(nodeValue(node), element);
+			if (before) {
+				*rank += (node->left == NULL ? 0 : node->left->count) + 1;
+				node = node->right;
+			} else {
+				found = node;
+				node = node->left;
+			}
+		}
+		return found;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>& set<T, CmpFcn, Allocator>::checkResult(SetResult result)
+	{
+		assert(result != SET_NULL_ARGUMENT);
+		if (result == SET_OUT_OF_MEMORY) {
+			throw Exception();
+		}
+		return *this;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Arg>
+	typename set<T, CmpFcn, Allocator>::result_type set<T, CmpFcn, Allocator>::insertElement(
+			Arg&& data)
+	{
+		Node* parent;
+		bool goLeft;
+		Node* found = locate(data, &parent, &goLeft);
+		if (found != NULL) {
+			return result_type(const_iterator(this, found), false);
+		}
+		if (setIsShared(m_CSet)) {
+			// the position must be found again in the set's own copy
+			checkResult(setUnshare(m_CSet));
+			locate(data, &parent, &goLeft);
+		}
+		SetElement storage = setAllocateElement(m_CSet);
+		if (storage == NULL) {
+			throw Exception();
+		}
+		try {
+			new (storage) T(std::forward<Arg>(data));
+		} catch (...) {
+			setDeallocateElement(m_CSet, storage);
+			throw;
+		}
+		MTM_SET_STATS_ADD(elementCopies, 1);
+		return result_type(const_iterator(this,
+				setLinkElementAt(m_CSet, storage, parent, goLeft)), true);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	void set<T, CmpFcn, Allocator>::insertRange(InputIterator first, InputIterator last,
+			SetTaskRunner const* runner, std::true_type)
+	{
+		assert(m_CSet != NULL);
+		std::vector<SetElement> elements;
+		for (; first != last; ++first) {
+			T const& element = *first;
+			elements.push_back(static_cast<SetElement>(const_cast<T*>(&element)));
+		}
+		if (elements.empty()) {
+			return;
+		}
+		int count = static_cast<int>(elements.size());
+		SetResult result = runner == NULL
+				? setAddBatch(m_CSet, &elements[0], count)
+				: setAddBatchParallel(m_CSet, &elements[0], count, runner);
+		if (result == SET_OUT_OF_MEMORY) {
+			throw Exception();
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator>
+	void set<T, CmpFcn, Allocator>::insertRange(InputIterator first, InputIterator last,
+			SetTaskRunner const* runner, std::false_type)
+	{
+		std::vector<T> elements(first, last);
+		insertRange(elements.begin(), elements.end(), runner, std::true_type());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator, class OutputIterator>
+	OutputIterator set<T, CmpFcn, Allocator>::findMany(InputIterator first,
+			InputIterator last, OutputIterator result, std::true_type) const
+	{
+		std::vector<T const*> keys;
+		keys.reserve(static_cast<size_t>(std::distance(first, last)));
+		for (; first != last; ++first) {
+			T const& key = *first;
+			keys.push_back(&key);
+		}
+		if (keys.empty()) {
+			return result;
+		}
+		std::vector<Node*> found(keys.size());
+		locateMany(&keys[0], keys.size(), &found[0]);
+		for (size_t i = 0; i < found.size(); i++) {
+			*result++ = const_iterator(this, found[i]); // end() if NULL
+		}
+		return result;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class InputIterator, class OutputIterator>
+	OutputIterator set<T, CmpFcn, Allocator>::findMany(InputIterator first,
+			InputIterator last, OutputIterator result, std::false_type) const
+	{
+		std::vector<T> keys(first, last);
+		return findMany(keys.begin(), keys.end(), result, std::true_type());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::locateMany(T const* const* keys,
+			size_t count, Node** found) const
+	{
+		assert(m_CSet != NULL);
+		bool sorted = true;
+		for (size_t i = 1; i < count && sorted; i++) {
+			MTM_SET_STATS_ADD(comparisons, 1);
+			sorted = !m_Cmp(*keys[i], *keys[i - 1]);
+		}
+		Node* root = static_cast<Node*>(setGetRoot(m_CSet));
+		size_t elements = static_cast<size_t>(size());
+		// a walk costs O(size), searching costs O(log size) per key
+		if (sorted && root != NULL
+				&& count >= elements / static_cast<size_t>(root->height)) {
+			Node* node = static_cast<Node*>(setGetFirst(m_CSet));
+			for (size_t i = 0; i < count; i++) {
+				while (node != NULL && m_Cmp(nodeValue(node), *keys[i])) {
+					MTM_SET_STATS_ADD(nodesVisited, 1);
+					MTM_SET_STATS_ADD(comparisons, 1);
+					node = node->next;
+				}
+				MTM_SET_STATS_ADD(comparisons, 1);
+				found[i] = node != NULL && !m_Cmp(*keys[i], nodeValue(node)) ?
+						node : NULL;
+			}
+			return;
+		}
+		/* Number of searches kept in flight */
+		const size_t width = 16;
+		/* A search as in locate, at node on its way down the tree */
+		struct Lookup {
+			Node* node;
+			Node* candidate; // the last node seen not less than the key
+			size_t index;
+		} lookups[width];
+		size_t next = 0, active = 0;
+		// starts the search of the next key the filter does not rule out
+		auto start = [&](Lookup& lookup) -> bool {
+			while (next < count) {
+				size_t index = next++;
+				if (setFilterMayContain(m_CSet, const_cast<T*>(keys[index]))) {
+					lookup.node = root;
+					lookup.candidate = NULL;
+					lookup.index = index;
+					return true;
+				}
+				found[index] = NULL;
+			}
+			return false;
+		};
+		while (active < width && start(lookups[active])) {
+			active++;
+		}
+		// one step of every search in turn, the node a search visits next
+		// is prefetched and usually arrives before its turn comes again
+		while (active > 0) {
+			for (size_t slot = 0; slot < active;) {
+				Lookup& lookup = lookups[slot];
+				T const& key = *keys[lookup.index];
+				Node* node = lookup.node;
+				if (node != NULL) {
+					MTM_SET_STATS_ADD(nodesVisited, 1);
+					MTM_SET_STATS_ADD(comparisons, 1);
+					bool less = m_Cmp(nodeValue(node), key);
+					lookup.candidate = less ? lookup.candidate : node;
+					lookup.node = less ? node->right : node->left;
+					if (lookup.node != NULL) {
+						// the element follows the node, at a 16 byte boundary
+						char const* address = reinterpret_cast<char const*>(
+								lookup.node);
+						MTM_SET_PREFETCH(address);
+						MTM_SET_PREFETCH(address + (sizeof(Node) + 15) / 16 * 16);
+					}
+					slot++;
+					continue;
+				}
+				Node* candidate = lookup.candidate;
+				if (candidate != NULL) {
+					MTM_SET_STATS_ADD(comparisons, 1);
+				}
+				found[lookup.index] = candidate != NULL
+						&& !m_Cmp(key, nodeValue(candidate)) ? candidate : NULL;
+				if (start(lookup)) {
+					slot++;
+				} else {
+					lookup = lookups[--active];
+				}
+			}
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	int set<T, CmpFcn, Allocator>::CompareElementFcn(SetElement left, SetElement right,
+			void* context)
+	{
+		if (NULL == left || NULL == right)
+			return 0;
+
+		CmpFcn& cmp = static_cast<set<T, CmpFcn, Allocator> const*>(context)->m_Cmp;
+		T const& leftT = *static_cast<T*>(left);
+		T const& rightT = *static_cast<T*>(right);
+		if (cmp(leftT, rightT))
+			return -1;
+		if (cmp(rightT, leftT))
+			return 1;
+		return 0;
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	template<class Hash>
+	size_t set<T, CmpFcn, Allocator>::HashElementFcn(SetElement lmnt,
+			void* context)
+	{
+		(void)context;
+		return Hash()(*static_cast<T*>(lmnt));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void* set<T, CmpFcn, Allocator>::AllocateFcn(size_t size, void* context)
+	{
+		unit_allocator alloc(static_cast<set<T, CmpFcn, Allocator>*>(
+				context)->m_Alloc);
+		size_t units = (size + sizeof(detail::allocation_unit) - 1)
+				/ sizeof(detail::allocation_unit);
+		// exceptions must not cross the C set, a failure is reported as NULL
+		try {
+			return static_cast<void*>(std::addressof(
+					*unit_traits::allocate(alloc, units)));
+		} catch (...) {
+			return NULL;
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::DeallocateFcn(void* block, size_t size,
+			void* context)
+	{
+		unit_allocator alloc(static_cast<set<T, CmpFcn, Allocator>*>(
+				context)->m_Alloc);
+		size_t units = (size + sizeof(detail::allocation_unit) - 1)
+				/ sizeof(detail::allocation_unit);
+		unit_traits::deallocate(alloc,
+				static_cast<detail::allocation_unit*>(block), units);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	SetElement set<T, CmpFcn, Allocator>::CopyElementFcn(SetElement dest, SetElement lmnt)
+	{
+		if (dest == NULL || lmnt == NULL) {
+			return NULL;
+		}
+		const T& lmntT = *static_cast<T*>(lmnt);
+		// exceptions must not cross the C set, a failed copy is reported as NULL
+		try {
+			return static_cast<SetElement>(new (dest) T(lmntT));
+		} catch (...) {
+			return NULL;
+		}
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	void set<T, CmpFcn, Allocator>::DestroyElementFcn(SetElement lmnt)
+	{
+		if (lmnt == NULL) {
+			return;
+		}
+		// the memory of the element belongs to the C set's node
+		static_cast<T*>(lmnt)->~T();
+	}
+
+	////////
+	// iteration funcs
+	////////
+
+	// iterator funcs in set
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::begin() const
+	{
+		return typename set<T, CmpFcn, Allocator>::const_iterator::const_iterator(this,
+				setGetFirst(m_CSet));
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::cbegin() const
+	{
+		return begin();
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::end() const
+	{
+		// one-past-the-last is the NULL node, no need to walk the set
+		return typename set<T, CmpFcn, Allocator>::const_iterator::const_iterator(this,
+				NULL);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_iterator set<T, CmpFcn, Allocator>::cend() const
+	{
+		return end();
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_reverse_iterator set<T, CmpFcn, Allocator>::rbegin() const
+	{
+		return const_reverse_iterator(end());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_reverse_iterator set<T, CmpFcn, Allocator>::rend() const
+	{
+		return const_reverse_iterator(begin());
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_reverse_iterator set<T, CmpFcn, Allocator>::crbegin() const
+	{
+		return rbegin();
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	typename set<T, CmpFcn, Allocator>::const_reverse_iterator set<T, CmpFcn, Allocator>::crend() const
+	{
+		return rend();
+	}
+
+	// iterator funcs in iterator
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::const_iterator::const_iterator() :
+			m_Owner(NULL), m_Current(NULL)
+	{
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	set<T, CmpFcn, Allocator>::const_iterator::const_iterator(set<T, CmpFcn, Allocator> const* owner,
+			SetIterator cset_iter) :
+			m_Owner(owner), m_Current(cset_iter)
+	{
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	T const& set<T, CmpFcn, Allocator>::const_iterator::operator*() const
+	{
+		SetElement element = setGetElement(m_Owner->m_CSet, m_Current);
+		if (element == NULL) {
+			throw InvalidIterator();
+		}
+		return *static_cast<T*>(element);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	bool set<T, CmpFcn, Allocator>::const_iterator::operator!=(
+			const_iterator const& other) const
+	{
+		return !(*this == other);
+	}
+
+	template<class T, class CmpFcn, class Allocator>
+	bool set<T, CmpFcn, Allocator>::const_iterator::operator==(
+			const_iterator const& other) const
+	{
+		return m_Current == other.m_Current;
+	}
+
+////////////////////////////////////////////////////////
+//########## Add other functions' implementation here.
+////////////////////////////////////////////////////////
+
+#ifdef MTM_SET_HAS_PMR
+	namespace pmr {
+		/** mtm::set allocating from a std::pmr::memory_resource */
+		template<class T, class CmpFcn = std::less<T> >
+		using set = mtm::set<T, CmpFcn, std::pmr::polymorphic_allocator<T> >;
+	}
+#endif
+}
+
+#undef MTM_SET_STATS_ADD
+#undef MTM_SET_PREFETCH
+#undef MTM_SET_HAS_MMAP
+
+#endif // #ifndef MTM_SET_H_
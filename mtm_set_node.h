@@ -0,0 +1,41 @@
+#ifndef SET_NODE_H_
+#define SET_NODE_H_
+
+#include "mtm_set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Node layout of the Set container.
+ *
+ * A SetIterator points to one of these. The layout is shared with
+ * mtm_set.hpp, which walks the tree directly so that its lookups call the
+ * comparator inline instead of through a compareSetElements pointer. Nodes
+ * must only be read through it; all changes go through the functions of
+ * mtm_set.h.
+ *
+ * The set is an AVL tree whose in-order traversal is the order induced by
+ * the comparison function. The root is returned by setGetRoot. Every node
+ * also knows the size of its subtree, so elements can be found by their
+ * index in the set (see setGetNth and setRank) in O(log n).
+ */
+struct SetNode_t {
+	/** The element. In an inline set it is stored right after the node */
+	SetElement data;
+	struct SetNode_t* left;
+	struct SetNode_t* right;
+	struct SetNode_t* parent;
+	/** The following node in iteration order, NULL for the last one */
+	struct SetNode_t* next;
+	int height;
+	/** Number of nodes in the subtree rooted at this node */
+	int count;
+};
+
+#ifdef __cplusplus
+}	// extern "C"
+#endif
+
+#endif /* SET_NODE_H_ */
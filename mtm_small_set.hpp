@@ -0,0 +1,660 @@
+#ifndef MTM_SMALL_SET_HPP_
+#define MTM_SMALL_SET_HPP_
+
+/* The minimum of headers required */
+#include <utility>
+#include <iterator>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <stddef.h>
+#include <assert.h>
+
+/* The set the elements spill to */
+#include "mtm_set.hpp"
+
+namespace mtm {
+
+	/**
+	 * Small Set Class
+	 *
+	 * template <class T, int N = 8, class CmpFcn = std::less<T> >
+	 * class small_set
+	 *
+	 * T - Stored data type
+	 * N - Number of elements kept inside the small_set object. Default is 8.
+	 * CmpFcn - Function object class performing comparison. Default is
+	 * 	   std::less<T>. The set stores a CmpFcn object, so comparators may
+	 * 	   have state, as in mtm::set. It is handed to the mtm::set the
+	 * 	   elements spill to.
+	 *
+	 * A sibling of mtm::set for sets that are usually tiny. The first N
+	 * elements are kept sorted in a buffer inside the object and searched
+	 * linearly, so constructing, filling and destroying a set of up to N
+	 * elements allocates no memory at all. Inserting element N + 1 moves all
+	 * elements to an mtm::set, which the small_set uses from then on. It
+	 * goes back to the buffer only when cleared, so a set hovering around N
+	 * elements does not move them back and forth.
+	 *
+	 * For arithmetic T compared by std::less<T>, the linear search is a
+	 * branch-free count over the buffer which the compiler vectorizes.
+	 *
+	 * Iterators are bidirectional. While the elements are in the buffer,
+	 * insert and erase invalidate all iterators, and so does the insert that
+	 * moves them to the mtm::set.
+	 *
+	 * The following public members are available:
+	 *
+	 * Types:
+	 *  const_iterator, value_type, const_reference, result_type - as in
+	 *  mtm::set.
+	 *
+	 * Functions:
+	 *  small_set - constructor. initializes empty set, allocates nothing.
+	 *  small_set(CmpFcn const& cmp) - initializes empty set ordered by cmp.
+	 *  small_set(first, last, cmp = CmpFcn()) - range constructor.
+	 *  small_set(const small_set& other), operator= - copy all elements from
+	 *         other. A copy of a set that spilled to an mtm::set is O(1), as
+	 *         in mtm::set.
+	 *  ~small_set - destroys the set and frees all memory allocated.
+	 *  begin, end, cbegin, cend - iteration, in ascending order.
+	 *  size - number of elements in set
+	 *  is_small - true while the elements are kept inside the object.
+	 *  find, contains, count - as in mtm::set.
+	 *  insert - as in mtm::set.
+	 *  erase(T const& element), erase(const_iterator iter) - as in mtm::set.
+	 *  clear() - erases all elements in the set, and frees the mtm::set.
+	 */
+	template<class T, int N = 8, class CmpFcn = std::less<T> >
+	class small_set
+	{
+		static_assert(N > 0, "mtm::small_set needs room for an element");
+
+	public:
+		/** iterator type for the container */
+		class const_iterator;
+		/** element data type */
+		typedef T value_type;
+		/** const reference to element data type */
+		typedef T const& const_reference;
+		/** set insert result type */
+		typedef std::pair<const_iterator, bool> result_type;
+		/**
+		 * Ctor/CCtor/Dtor/assignment operator
+		 *  In case that memory allocation fails constructors/operator= throw
+		 *  Exception().
+		 */
+		small_set();
+		explicit small_set(CmpFcn const& cmp);
+		template<class InputIterator>
+		small_set(InputIterator first, InputIterator last,
+				CmpFcn const& cmp = CmpFcn());
+		small_set(const small_set& other);
+		small_set& operator=(small_set const& other);
+		~small_set();
+
+		const_iterator begin() const;
+		const_iterator end() const;
+		const_iterator cbegin() const;
+		const_iterator cend() const;
+		/** returns the number of elements in the set */
+		int size() const;
+		/** true while the elements are kept inside the object */
+		bool is_small() const;
+		/**
+		 * find
+		 *  obtain const iterator to element. If element is not in the set,
+		 *  return value compares to end().
+		 */
+		const_iterator find(T const& element) const;
+		/**
+		 * contains, count
+		 *  contains returns true if element is in the set, and count
+		 *  returns 1 if it is and 0 otherwise.
+		 */
+		bool contains(T const& element) const;
+		int count(T const& element) const;
+		/**
+		 * insert
+		 *  inserts an element to the set. Return value is as in
+		 *  mtm::set::insert.
+		 *  If moving a buffered element throws, the set is left empty, as the
+		 *  order of the buffer is lost. The same holds for erase. If the set
+		 *  the buffer spills to can not be built, Exception is thrown and the
+		 *  buffer is kept.
+		 */
+		result_type insert(T const& data);
+		/**
+		 * erase(T const& element)
+		 *  erases given value from the set.
+		 *  Throws ElementNotFound() if value does not exist in the set.
+		 */
+		void erase(T const& element);
+		/**
+		 * erase(const_iterator iter)
+		 *  erases element pointed to by iterator.
+		 *  Throws InvalidIterator() if iterator does not point to an element.
+		 */
+		void erase(const_iterator iter);
+		/** erases all elements in the set */
+		void clear();
+		//--------------- Exception types: -------------
+		class Exception: public std::exception
+		{
+		};
+		class ElementNotFound: public Exception
+		{
+		};
+		class InvalidIterator: public Exception
+		{
+		};
+
+	private:
+		/** The set the elements spill to */
+		typedef mtm::set<T, CmpFcn> large_set;
+
+		/** The buffer and the spilled set share the storage */
+		static const size_t storageSize = sizeof(T) * N > sizeof(large_set) ?
+				sizeof(T) * N : sizeof(large_set);
+		static const size_t storageAlign = alignof(T) > alignof(large_set) ?
+				alignof(T) : alignof(large_set);
+		typename std::aligned_storage<storageSize, storageAlign>::type m_Storage;
+		/** Number of elements in the buffer, or -1 once spilled */
+		int m_Count;
+		/** The comparator of the buffer, copied to the spilled set */
+		mutable CmpFcn m_Cmp;
+
+		/** true when lowerBound may use the branch-free count */
+		typedef std::integral_constant<bool, std::is_arithmetic<T>::value
+				&& std::is_same<CmpFcn, std::less<T> >::value> is_branchless;
+
+		/** The sorted buffer, valid while is_small() */
+		T* elements();
+		T const* elements() const;
+		/** The spilled set, valid unless is_small() */
+		large_set& large();
+		large_set const& large() const;
+
+		/** Index of the first buffered element not less than element */
+		int lowerBound(T const& element) const;
+		int lowerBound(T const& element, std::true_type) const;
+		int lowerBound(T const& element, std::false_type) const;
+		/** true if the buffered element at index is equal to element */
+		bool isEqualAt(int index, T const& element) const;
+		/** Moves the buffered elements to a new mtm::set */
+		void spill();
+		/** Erases the buffered element at index */
+		void eraseAt(int index);
+		/** Copies the elements of other to this empty, small set */
+		void copyFrom(small_set const& other);
+	};
+
+	///////////
+	// iterator
+	///////////
+
+	/**
+	 * Const iterator class for the small set. Walks the buffer with a
+	 * pointer, or the spilled set with its iterator.
+	 */
+	template<class T, int N, class CmpFcn>
+	class small_set<T, N, CmpFcn>::const_iterator
+	{
+	public:
+		/** Iterator traits, as std::iterator_traits reads them */
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T const* pointer;
+		typedef T const& reference;
+
+		/** Prefix and postfix operators to advance the iterator */
+		const_iterator & operator++()
+		{
+			if (m_Element != NULL) {
+				++m_Element;
+			} else {
+				++m_Large;
+			}
+			return *this;
+		}
+		const_iterator operator++(int)
+		{
+			const_iterator newIterator(*this);
+			++*this;
+			return newIterator;
+		}
+
+		/** Prefix and postfix operators to move the iterator back */
+		const_iterator & operator--()
+		{
+			if (m_Element != NULL) {
+				--m_Element;
+			} else {
+				--m_Large;
+			}
+			return *this;
+		}
+		const_iterator operator--(int)
+		{
+			const_iterator newIterator(*this);
+			--*this;
+			return newIterator;
+		}
+
+		/**
+		 * Dereference operator to obtain value the iterator points to.
+		 * Throws InvalidIterator() if the iterator does not point to an
+		 * element.
+		 */
+		T const& operator*() const
+		{
+			if (m_Element != NULL) {
+				if (m_Element == m_Owner->elements() + m_Owner->m_Count) {
+					throw InvalidIterator();
+				}
+				return *m_Element;
+			}
+			if (m_Large == m_Owner->large().end()) {
+				throw InvalidIterator();
+			}
+			return *m_Large;
+		}
+
+		const_iterator(const_iterator const&) = default;
+		const_iterator& operator=(const_iterator const&) = default;
+		~const_iterator() = default;
+
+		bool operator==(const_iterator const& other) const
+		{
+			return m_Element == other.m_Element && m_Large == other.m_Large;
+		}
+		bool operator!=(const_iterator const& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		friend class small_set;
+
+		/** Set object the iterator belongs to */
+		small_set<T, N, CmpFcn> const* m_Owner;
+
+		/** Buffered element the iterator points to, NULL once spilled */
+		T const* m_Element;
+
+		/** Position in the spilled set */
+		typename large_set::const_iterator m_Large;
+
+		const_iterator(small_set<T, N, CmpFcn> const* owner, T const* element) :
+				m_Owner(owner), m_Element(element), m_Large()
+		{
+		}
+		const_iterator(small_set<T, N, CmpFcn> const* owner,
+				typename large_set::const_iterator position) :
+				m_Owner(owner), m_Element(NULL), m_Large(position)
+		{
+		}
+	};
+
+	///////////
+	// small_set funcs
+	///////////
+
+	template<class T, int N, class CmpFcn>
+	small_set<T, N, CmpFcn>::small_set() :
+			m_Count(0), m_Cmp()
+	{
+	}
+
+	template<class T, int N, class CmpFcn>
+	small_set<T, N, CmpFcn>::small_set(CmpFcn const& cmp) :
+			m_Count(0), m_Cmp(cmp)
+	{
+	}
+
+	template<class T, int N, class CmpFcn>
+	template<class InputIterator>
+	small_set<T, N, CmpFcn>::small_set(InputIterator first,
+			InputIterator last, CmpFcn const& cmp) :
+			m_Count(0), m_Cmp(cmp)
+	{
+		try {
+			for (; first != last; ++first) {
+				insert(*first);
+			}
+		} catch (...) {
+			clear();
+			throw;
+		}
+	}
+
+	template<class T, int N, class CmpFcn>
+	small_set<T, N, CmpFcn>::small_set(const small_set& other) :
+			m_Count(0), m_Cmp(other.m_Cmp)
+	{
+		copyFrom(other);
+	}
+
+	template<class T, int N, class CmpFcn>
+	small_set<T, N, CmpFcn>& small_set<T, N, CmpFcn>::operator=(
+			small_set const& other)
+	{
+		if (this == &other) {
+			return *this;
+		}
+		clear();
+		m_Cmp = other.m_Cmp;
+		copyFrom(other);
+		return *this;
+	}
+
+	template<class T, int N, class CmpFcn>
+	small_set<T, N, CmpFcn>::~small_set()
+	{
+		clear();
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::const_iterator
+	small_set<T, N, CmpFcn>::begin() const
+	{
+		if (is_small()) {
+			return const_iterator(this, elements());
+		}
+		return const_iterator(this, large().begin());
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::const_iterator
+	small_set<T, N, CmpFcn>::end() const
+	{
+		if (is_small()) {
+			return const_iterator(this, elements() + m_Count);
+		}
+		return const_iterator(this, large().end());
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::const_iterator
+	small_set<T, N, CmpFcn>::cbegin() const
+	{
+		return begin();
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::const_iterator
+	small_set<T, N, CmpFcn>::cend() const
+	{
+		return end();
+	}
+
+	template<class T, int N, class CmpFcn>
+	int small_set<T, N, CmpFcn>::size() const
+	{
+		return is_small() ? m_Count : large().size();
+	}
+
+	template<class T, int N, class CmpFcn>
+	bool small_set<T, N, CmpFcn>::is_small() const
+	{
+		return m_Count >= 0;
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::const_iterator
+	small_set<T, N, CmpFcn>::find(T const& element) const
+	{
+		if (!is_small()) {
+			return const_iterator(this, large().find(element));
+		}
+		int index = lowerBound(element);
+		if (!isEqualAt(index, element)) {
+			return end();
+		}
+		return const_iterator(this, elements() + index);
+	}
+
+	template<class T, int N, class CmpFcn>
+	bool small_set<T, N, CmpFcn>::contains(T const& element) const
+	{
+		if (!is_small()) {
+			return large().contains(element);
+		}
+		return isEqualAt(lowerBound(element), element);
+	}
+
+	template<class T, int N, class CmpFcn>
+	int small_set<T, N, CmpFcn>::count(T const& element) const
+	{
+		return contains(element) ? 1 : 0;
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::result_type
+	small_set<T, N, CmpFcn>::insert(T const& data)
+	{
+		if (is_small()) {
+			int index = lowerBound(data);
+			if (isEqualAt(index, data)) {
+				return result_type(const_iterator(this, elements() + index),
+						false);
+			}
+			if (m_Count < N) {
+				T* buffer = elements();
+				if (index == m_Count) {
+					new (buffer + index) T(data);
+					m_Count++;
+				} else {
+					// open a hole at index by shifting the greater elements up
+					T copy(data);
+					new (buffer + m_Count) T(std::move(buffer[m_Count - 1]));
+					m_Count++; // the new last element is destroyed by clear
+					try {
+						std::move_backward(buffer + index, buffer + m_Count - 2,
+								buffer + m_Count - 1);
+						buffer[index] = std::move(copy);
+					} catch (...) {
+						// the order of the moved elements is lost
+						clear();
+						throw;
+					}
+				}
+				return result_type(const_iterator(this, buffer + index), true);
+			}
+			spill();
+		}
+		try {
+			std::pair<typename large_set::const_iterator, bool> result =
+					large().insert(data);
+			return result_type(const_iterator(this, result.first),
+					result.second);
+		} catch (typename large_set::Exception&) {
+			throw Exception();
+		}
+	}
+
+	template<class T, int N, class CmpFcn>
+	void small_set<T, N, CmpFcn>::erase(T const& element)
+	{
+		if (!is_small()) {
+			try {
+				large().erase(element);
+			} catch (typename large_set::ElementNotFound&) {
+				throw ElementNotFound();
+			}
+			return;
+		}
+		int index = lowerBound(element);
+		if (!isEqualAt(index, element)) {
+			throw ElementNotFound();
+		}
+		eraseAt(index);
+	}
+
+	template<class T, int N, class CmpFcn>
+	void small_set<T, N, CmpFcn>::erase(const_iterator iter)
+	{
+		if (iter.m_Element == NULL) {
+			erase(*iter);
+			// if iter does not point to an element, *iter will throw InvalidIterator()
+			return;
+		}
+		int index = static_cast<int>(iter.m_Element - elements());
+		if (index < 0 || index >= m_Count) {
+			throw InvalidIterator();
+		}
+		eraseAt(index);
+	}
+
+	template<class T, int N, class CmpFcn>
+	void small_set<T, N, CmpFcn>::clear()
+	{
+		if (!is_small()) {
+			large().~large_set();
+			m_Count = 0;
+			return;
+		}
+		T* buffer = elements();
+		for (int i = 0; i < m_Count; i++) {
+			buffer[i].~T();
+		}
+		m_Count = 0;
+	}
+
+	///////////
+	// private small_set funcs
+	///////////
+
+	template<class T, int N, class CmpFcn>
+	T* small_set<T, N, CmpFcn>::elements()
+	{
+		return reinterpret_cast<T*>(&m_Storage);
+	}
+
+	template<class T, int N, class CmpFcn>
+	T const* small_set<T, N, CmpFcn>::elements() const
+	{
+		return reinterpret_cast<T const*>(&m_Storage);
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::large_set& small_set<T, N, CmpFcn>::large()
+	{
+		return *reinterpret_cast<large_set*>(&m_Storage);
+	}
+
+	template<class T, int N, class CmpFcn>
+	typename small_set<T, N, CmpFcn>::large_set const&
+	small_set<T, N, CmpFcn>::large() const
+	{
+		return *reinterpret_cast<large_set const*>(&m_Storage);
+	}
+
+	template<class T, int N, class CmpFcn>
+	bool small_set<T, N, CmpFcn>::isEqualAt(int index, T const& element) const
+	{
+		return index < m_Count && !m_Cmp(element, elements()[index]);
+	}
+
+	template<class T, int N, class CmpFcn>
+	int small_set<T, N, CmpFcn>::lowerBound(T const& element) const
+	{
+		return lowerBound(element, is_branchless());
+	}
+
+	template<class T, int N, class CmpFcn>
+	int small_set<T, N, CmpFcn>::lowerBound(T const& element,
+			std::false_type) const
+	{
+		T const* buffer = elements();
+		int index = 0;
+		while (index < m_Count && m_Cmp(buffer[index], element)) {
+			index++;
+		}
+		return index;
+	}
+
+	template<class T, int N, class CmpFcn>
+	int small_set<T, N, CmpFcn>::lowerBound(T const& element,
+			std::true_type) const
+	{
+		T const* buffer = elements();
+		int less = 0;
+		for (int i = 0; i < m_Count; i++) {
+			less += buffer[i] < element ? 1 : 0;
+		}
+		return less;
+	}
+
+	template<class T, int N, class CmpFcn>
+	void small_set<T, N, CmpFcn>::spill()
+	{
+		assert(is_small());
+		try {
+			// copies, so the buffer is intact if building the set fails
+			large_set spilled(m_Cmp);
+			spilled.insert(elements(), elements() + m_Count);
+			// moving a set allocates nothing, so the buffer is only destroyed
+			// once its elements are safe in spilled
+			clear();
+			try {
+				new (&m_Storage) large_set(std::move(spilled));
+			} catch (...) {
+				// only a comparator whose copy throws gets here, and the set
+				// is left empty
+				throw Exception();
+			}
+			m_Count = -1;
+		} catch (typename large_set::Exception&) {
+			throw Exception();
+		} catch (std::bad_alloc&) {
+			throw Exception();
+		}
+	}
+
+	template<class T, int N, class CmpFcn>
+	void small_set<T, N, CmpFcn>::eraseAt(int index)
+	{
+		assert(is_small() && index >= 0 && index < m_Count);
+		T* buffer = elements();
+		try {
+			std::move(buffer + index + 1, buffer + m_Count, buffer + index);
+		} catch (...) {
+			// the order of the moved elements is lost
+			clear();
+			throw;
+		}
+		buffer[m_Count - 1].~T();
+		m_Count--;
+	}
+
+	template<class T, int N, class CmpFcn>
+	void small_set<T, N, CmpFcn>::copyFrom(small_set const& other)
+	{
+		assert(is_small() && m_Count == 0);
+		if (!other.is_small()) {
+			try {
+				new (&m_Storage) large_set(other.large());
+			} catch (typename large_set::Exception&) {
+				throw Exception();
+			}
+			m_Count = -1;
+			return;
+		}
+		T* buffer = elements();
+		try {
+			for (int i = 0; i < other.m_Count; i++) {
+				new (buffer + i) T(other.elements()[i]);
+				m_Count++;
+			}
+		} catch (...) {
+			clear();
+			throw;
+		}
+	}
+}
+
+#endif // #ifndef MTM_SMALL_SET_HPP_
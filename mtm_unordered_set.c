@@ -0,0 +1,450 @@
+/*
+ * mtm_unordered_set.c
+ */
+
+#include "mtm_unordered_set.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#define IF_NULL_RETURN_NULL(var) { \
+		if ( (var) == NULL) return NULL; }
+
+#define IF_NULL_RETURN_SET_NULL_ARGUMENT(var) { \
+		if ( (var) == NULL) return SET_NULL_ARGUMENT; }
+
+/* The unordered set is an open-addressing hash table with linear probing.
+ * Every slot saves an element (NULL for an empty slot) and its hash, so
+ * probing compares hashes before calling the compare function and growing
+ * the table never calls the hash function again. Removal shifts the
+ * following elements of the probe run back instead of leaving tombstones,
+ * so lookups never walk over deleted slots. */
+struct Slot_t {
+	SetElement data;
+	size_t hash;
+};
+
+typedef struct Slot_t* Slot;
+
+/* Elements of an inline set (see unorderedSetCreateInline) are constructed in
+ * blocks carved out of slabs, so that the slots, which move as the table
+ * changes, only hold pointers to them. Released blocks go to a free list,
+ * through their first bytes, and are reused before any new slab is
+ * allocated. Clearing the set frees whole slabs. */
+struct Slab_t {
+	struct Slab_t* next;
+};
+
+typedef struct Slab_t* Slab;
+
+#define BLOCK_ALIGNMENT 16
+#define ALIGN_SIZE(size) \
+	(((size) + BLOCK_ALIGNMENT - 1) & ~(size_t)(BLOCK_ALIGNMENT - 1))
+#define SLAB_MIN_BLOCKS 16
+#define SLAB_MAX_BLOCKS 8192
+
+#define TABLE_MIN_CAPACITY 16
+/* The table grows when it would become more than 3/4 full */
+#define TABLE_IS_TOO_FULL(size, capacity) ((size) * 4 > (capacity) * 3)
+/* 2^64 divided by the golden ratio, spreads consecutive hashes apart */
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+struct UnorderedSet_t {
+	Slot slots; // NULL while the set is empty
+	int capacity; // number of slots, a power of 2 (or 0)
+	int shift; // 64 - log2(capacity), see slotIndex
+	int size;
+	copySetElements copyFunc; // NULL for inline sets
+	copySetElementsInto copyIntoFunc; // for inline sets only
+	freeSetElements freeFunc;
+	compareSetElements cmpFunc;
+	hashSetElements hashFunc;
+	size_t blockSize; // of an element of an inline set, 0 otherwise
+	Slab slabs;
+	char* slabCursor; // the first never used block of the newest slab
+	int slabUnused; // number of never used blocks at slabCursor
+	int blockCount; // blocks in all slabs
+	void* freeBlocks;
+};
+
+/* Block helpers */
+
+/* Returns a block for an element of an inline set, or NULL. Slabs grow
+ * geometrically, so a set of n elements has O(log n) slabs */
+static SetElement blockAlloc(UnorderedSet set)
+{
+	if (set->freeBlocks != NULL) {
+		void* block = set->freeBlocks;
+		set->freeBlocks = *(void**)block;
+		return block;
+	}
+	if (set->slabUnused == 0) {
+		int blockCount = set->blockCount;
+		if (blockCount < SLAB_MIN_BLOCKS) {
+			blockCount = SLAB_MIN_BLOCKS;
+		} else if (blockCount > SLAB_MAX_BLOCKS) {
+			blockCount = SLAB_MAX_BLOCKS;
+		}
+		Slab slab = (Slab)malloc(ALIGN_SIZE(sizeof(*slab))
+				+ (size_t)blockCount * set->blockSize);
+		if (slab == NULL) {
+			return NULL;
+		}
+		slab->next = set->slabs;
+		set->slabs = slab;
+		set->slabCursor = (char*)slab + ALIGN_SIZE(sizeof(*slab));
+		set->slabUnused = blockCount;
+		set->blockCount += blockCount;
+	}
+	SetElement block = set->slabCursor;
+	set->slabCursor += set->blockSize;
+	set->slabUnused--;
+	return block;
+}
+
+static void blockFree(UnorderedSet set, SetElement block)
+{
+	*(void**)block = set->freeBlocks;
+	set->freeBlocks = block;
+}
+
+/* Frees all slabs, and with them every block of the set */
+static void blockRelease(UnorderedSet set)
+{
+	while (set->slabs != NULL) {
+		Slab next = set->slabs->next;
+		free(set->slabs);
+		set->slabs = next;
+	}
+	set->slabCursor = NULL;
+	set->slabUnused = 0;
+	set->blockCount = 0;
+	set->freeBlocks = NULL;
+}
+
+/* Copies source by the copy function of set. Returns NULL if it failed */
+static SetElement elementCopy(UnorderedSet set, SetElement source)
+{
+	if (set->blockSize == 0) {
+		return set->copyFunc(source);
+	}
+	SetElement block = blockAlloc(set);
+	if (block == NULL) {
+		return NULL;
+	}
+	if (set->copyIntoFunc(block, source) == NULL) {
+		blockFree(set, block);
+		return NULL;
+	}
+	return block;
+}
+
+/* Frees an element by the free function of set, and its block if inline */
+static void elementFree(UnorderedSet set, SetElement element)
+{
+	set->freeFunc(element);
+	if (set->blockSize != 0) {
+		blockFree(set, element);
+	}
+}
+
+/* Table helpers */
+
+/* The home slot of a hash. Multiplicative hashing uses the high bits of the
+ * product, so weak hashes (like the identity hash of integers) spread well */
+static int slotIndex(UnorderedSet set, size_t hash)
+{
+	return (int)(((unsigned long long)hash * HASH_MULTIPLIER) >> set->shift);
+}
+
+/* Returns the slot holding an element equal to element, or NULL */
+static Slot tableFind(UnorderedSet set, SetElement element, size_t hash)
+{
+	if (set->capacity == 0) {
+		return NULL;
+	}
+	int mask = set->capacity - 1;
+	for (int i = slotIndex(set, hash); ; i = (i + 1) & mask) {
+		Slot slot = &set->slots[i];
+		if (slot->data == NULL) {
+			return NULL; // end of the probe run
+		}
+		if (slot->hash == hash && set->cmpFunc(slot->data, element) == 0) {
+			return slot;
+		}
+	}
+}
+
+/* Places an element known not to be in the table in its probe run */
+static Slot tablePlace(UnorderedSet set, SetElement element, size_t hash)
+{
+	int mask = set->capacity - 1;
+	int i = slotIndex(set, hash);
+	while (set->slots[i].data != NULL) {
+		i = (i + 1) & mask;
+	}
+	set->slots[i].data = element;
+	set->slots[i].hash = hash;
+	return &set->slots[i];
+}
+
+/* Moves all elements to a new table of the given capacity */
+static bool tableResize(UnorderedSet set, int capacity)
+{
+	Slot oldSlots = set->slots;
+	int oldCapacity = set->capacity;
+	Slot slots = (Slot)calloc((size_t)capacity, sizeof(*slots));
+	if (slots == NULL) {
+		return false;
+	}
+	int shift = 64;
+	for (int i = capacity; i > 1; i /= 2) {
+		shift--;
+	}
+	set->slots = slots;
+	set->capacity = capacity;
+	set->shift = shift;
+	for (int i = 0; i < oldCapacity; i++) {
+		if (oldSlots[i].data != NULL) {
+			tablePlace(set, oldSlots[i].data, oldSlots[i].hash);
+		}
+	}
+	free(oldSlots);
+	return true;
+}
+
+/* Empties slot, shifting back the elements after it in its probe run that
+ * would otherwise become unreachable */
+static void tableErase(UnorderedSet set, Slot slot)
+{
+	int mask = set->capacity - 1;
+	int hole = (int)(slot - set->slots);
+	for (int i = (hole + 1) & mask; set->slots[i].data != NULL;
+			i = (i + 1) & mask) {
+		int home = slotIndex(set, set->slots[i].hash);
+		// the element may fill the hole unless its home is between them
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			set->slots[hole] = set->slots[i];
+			hole = i;
+		}
+	}
+	set->slots[hole].data = NULL;
+}
+
+/* Returns the first used slot from index on, or NULL */
+static Slot tableNextUsed(UnorderedSet set, int index)
+{
+	for (; index < set->capacity; index++) {
+		if (set->slots[index].data != NULL) {
+			return &set->slots[index];
+		}
+	}
+	return NULL;
+}
+
+/* Creates a set with either copy function, and a block size for inline sets */
+static UnorderedSet unorderedSetCreateInternal(copySetElements copyElement,
+		copySetElementsInto copyElementInto, size_t blockSize,
+		freeSetElements freeElement, compareSetElements compareElements,
+		hashSetElements hashElement)
+{
+	IF_NULL_RETURN_NULL(freeElement)
+	IF_NULL_RETURN_NULL(compareElements)
+	IF_NULL_RETURN_NULL(hashElement)
+	UnorderedSet set = (UnorderedSet)malloc(sizeof(*set));
+	IF_NULL_RETURN_NULL(set)
+	set->slots = NULL; // the table is allocated by the first add
+	set->capacity = 0;
+	set->shift = 64;
+	set->size = 0;
+	set->copyFunc = copyElement;
+	set->copyIntoFunc = copyElementInto;
+	set->freeFunc = freeElement;
+	set->cmpFunc = compareElements;
+	set->hashFunc = hashElement;
+	set->blockSize = blockSize;
+	set->slabs = NULL;
+	set->slabCursor = NULL;
+	set->slabUnused = 0;
+	set->blockCount = 0;
+	set->freeBlocks = NULL;
+	return set;
+}
+
+UnorderedSet unorderedSetCreate(copySetElements copyElement,
+		freeSetElements freeElement, compareSetElements compareElements,
+		hashSetElements hashElement)
+{
+	IF_NULL_RETURN_NULL(copyElement)
+	return unorderedSetCreateInternal(copyElement, NULL, 0, freeElement,
+			compareElements, hashElement);
+}
+
+UnorderedSet unorderedSetCreateInline(size_t elementSize,
+		copySetElementsInto copyElement, freeSetElements destroyElement,
+		compareSetElements compareElements, hashSetElements hashElement)
+{
+	IF_NULL_RETURN_NULL(copyElement)
+	if (elementSize == 0) {
+		return NULL;
+	}
+	// a free block holds the pointer to the next one
+	size_t blockSize = ALIGN_SIZE(elementSize < sizeof(void*) ? sizeof(void*)
+			: elementSize);
+	return unorderedSetCreateInternal(NULL, copyElement, blockSize,
+			destroyElement, compareElements, hashElement);
+}
+
+UnorderedSet unorderedSetCopy(UnorderedSet set)
+{
+	IF_NULL_RETURN_NULL(set)
+	UnorderedSet newSet = unorderedSetCreateInternal(set->copyFunc,
+			set->copyIntoFunc, set->blockSize, set->freeFunc, set->cmpFunc,
+			set->hashFunc);
+	IF_NULL_RETURN_NULL(newSet)
+	if (set->capacity == 0) {
+		return newSet;
+	}
+	if (!tableResize(newSet, set->capacity)) {
+		unorderedSetDestroy(newSet);
+		return NULL;
+	}
+	// same capacity and hashes, so every element keeps its slot
+	for (int i = 0; i < set->capacity; i++) {
+		if (set->slots[i].data == NULL) {
+			continue;
+		}
+		SetElement copy = elementCopy(newSet, set->slots[i].data);
+		if (copy == NULL) {
+			unorderedSetDestroy(newSet);
+			return NULL;
+		}
+		newSet->slots[i].data = copy;
+		newSet->slots[i].hash = set->slots[i].hash;
+		newSet->size++;
+	}
+	return newSet;
+}
+
+void unorderedSetDestroy(UnorderedSet set)
+{
+	if (set == NULL) {
+		return; // mimic free() behavior
+	}
+	unorderedSetClear(set);
+	free(set);
+}
+
+int unorderedSetGetSize(UnorderedSet set)
+{
+	if (set == NULL) {
+		return -1;
+	}
+	assert(set->size >= 0);
+	return set->size;
+}
+
+SetIterator unorderedSetGetFirst(UnorderedSet set)
+{
+	IF_NULL_RETURN_NULL(set)
+	return tableNextUsed(set, 0);
+}
+
+SetIterator unorderedSetGetNext(UnorderedSet set, SetIterator iter)
+{
+	if (set == NULL || iter == NULL) {
+		return NULL;
+	}
+	return tableNextUsed(set, (int)((Slot)iter - set->slots) + 1);
+}
+
+SetElement unorderedSetGetElement(UnorderedSet set, SetIterator iter)
+{
+	if (set == NULL || iter == NULL) {
+		return NULL;
+	}
+	return ((Slot)iter)->data;
+}
+
+SetIterator unorderedSetFind(UnorderedSet set, SetElement element)
+{
+	IF_NULL_RETURN_NULL(set)
+	IF_NULL_RETURN_NULL(element)
+	return tableFind(set, element, set->hashFunc(element));
+}
+
+SetElement unorderedSetContains(UnorderedSet set, SetElement element)
+{
+	Slot slot = (Slot)unorderedSetFind(set, element);
+	IF_NULL_RETURN_NULL(slot)
+	return slot->data;
+}
+
+SetResult unorderedSetAdd(UnorderedSet set, SetElement element)
+{
+	return unorderedSetInsert(set, element, NULL);
+}
+
+SetResult unorderedSetInsert(UnorderedSet set, SetElement element,
+		SetIterator* position)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
+	size_t hash = set->hashFunc(element);
+	Slot found = tableFind(set, element, hash);
+	if (found != NULL) {
+		if (position != NULL) {
+			*position = found;
+		}
+		return SET_ITEM_ALREADY_EXISTS;
+	}
+	if (TABLE_IS_TOO_FULL(set->size + 1, set->capacity)) {
+		int capacity = set->capacity == 0 ? TABLE_MIN_CAPACITY
+				: set->capacity * 2;
+		if (!tableResize(set, capacity)) {
+			return SET_OUT_OF_MEMORY;
+		}
+	}
+	SetElement copy = elementCopy(set, element);
+	if (copy == NULL) {
+		return SET_OUT_OF_MEMORY;
+	}
+	Slot slot = tablePlace(set, copy, hash);
+	set->size++;
+	if (position != NULL) {
+		*position = slot;
+	}
+	return SET_SUCCESS;
+}
+
+SetResult unorderedSetRemove(UnorderedSet set, SetElement element)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(element)
+	Slot slot = tableFind(set, element, set->hashFunc(element));
+	if (slot == NULL) {
+		return SET_ITEM_DOES_NOT_EXIST;
+	}
+	SetElement data = slot->data;
+	tableErase(set, slot);
+	elementFree(set, data);
+	set->size--;
+	return SET_SUCCESS;
+}
+
+SetResult unorderedSetClear(UnorderedSet set)
+{
+	IF_NULL_RETURN_SET_NULL_ARGUMENT(set)
+	for (int i = 0; i < set->capacity; i++) {
+		if (set->slots[i].data != NULL) {
+			set->freeFunc(set->slots[i].data);
+		}
+	}
+	blockRelease(set); // the blocks of the elements freed above
+	free(set->slots);
+	set->slots = NULL;
+	set->capacity = 0;
+	set->shift = 64;
+	set->size = 0;
+	return SET_SUCCESS;
+}
@@ -0,0 +1,240 @@
+#ifndef UNORDERED_SET_H_
+#define UNORDERED_SET_H_
+
+/* Shares the element, callback and result types of the ordered set */
+#include "mtm_set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Generic Unordered Set Container
+ *
+ * Implements a set container type with the same shape as the Set of
+ * mtm_set.h, for elements that only need membership tests. Elements are kept
+ * in an open-addressing hash table, so add, contains and remove run in O(1)
+ * expected time, but the iteration order is unspecified.
+ *
+ * Elements are owned by the set exactly as in a Set: they are copied in by
+ * the copy function and released by the free function. The compare function
+ * is only used to test elements for equality (a result of 0), and equal
+ * elements must have equal hashes.
+ *
+ * The following functions are available:
+ *   unorderedSetCreate		- Creates a new empty set
+ *   unorderedSetCreateInline - Creates a new empty set that stores its
+ *   						  elements in pooled blocks of its own.
+ *   unorderedSetCopy		- Copies an existing set
+ *   unorderedSetDestroy	- Deletes an existing set and frees all resources
+ *   unorderedSetGetSize	- Returns the size of a given set
+ *   unorderedSetContains	- Searches an item exists inside the set and
+ *   						  returns it if found.
+ *   unorderedSetFind		- Like unorderedSetContains, but returns an
+ *   						  iterator to the item.
+ *   unorderedSetGetFirst	- Returns an iterator to some first element.
+ *   unorderedSetGetNext	- Advances the iterator to the next element
+ *   unorderedSetGetElement	- Returns the element pointed to by the iterator
+ *   unorderedSetAdd		- Adds a new element to the set.
+ *   unorderedSetInsert		- Same, also returning an iterator to the element.
+ *   unorderedSetRemove		- Removes an element which matches a given element
+ *   unorderedSetClear		- Clears the contents of the set.
+ *   UNORDERED_SET_FOREACH	- A macro for iterating over the set's elements.
+ */
+
+/** Type for defining the unordered set */
+typedef struct UnorderedSet_t *UnorderedSet;
+
+/**
+ * unorderedSetCreate: Allocates a new empty set.
+ *
+ * @param copyElement - Function pointer to be used for copying elements into
+ *  	the set or when copying the set.
+ * @param freeElement - Function pointer to be used for removing elements from
+ * 		the set
+ * @param compareElements - Function pointer to be used for comparing elements
+ * 		inside the set. Elements are equal if it returns 0.
+ * @param hashElement - Function pointer to be used for hashing elements.
+ * 		Equal elements must have the same hash.
+ * @return
+ * 	NULL - if one of the parameters is NULL or allocations failed.
+ * 	A new UnorderedSet in case of success.
+ */
+UnorderedSet unorderedSetCreate(copySetElements copyElement,
+		freeSetElements freeElement, compareSetElements compareElements,
+		hashSetElements hashElement);
+
+/**
+ * unorderedSetCreateInline: Allocates a new empty set that constructs its
+ * elements in blocks of its own, carved out of pooled slabs, instead of
+ * holding pointers to elements allocated by the copy function (see
+ * setCreateInline). Elements stay in their blocks while the table changes,
+ * so they are never moved. Elements must not require an alignment stricter
+ * than 16 bytes.
+ *
+ * @param elementSize - The size in bytes of an element.
+ * @param copyElement - Function pointer used to construct a copy of an element
+ * 		in memory provided by the set.
+ * @param destroyElement - Function pointer used when an element is removed.
+ * 		Should release the resources held by the element, but not the memory of
+ * 		the element itself, which belongs to the set.
+ * @param compareElements - As in unorderedSetCreate.
+ * @param hashElement - As in unorderedSetCreate.
+ * @return
+ * 	NULL - if one of the parameters is NULL or 0, or allocations failed.
+ * 	A new UnorderedSet in case of success.
+ */
+UnorderedSet unorderedSetCreateInline(size_t elementSize,
+		copySetElementsInto copyElement, freeSetElements destroyElement,
+		compareSetElements compareElements, hashSetElements hashElement);
+
+/**
+ * unorderedSetCopy: Creates a copy of target set.
+ *
+ * @param set - Target set.
+ * @return
+ * 	NULL if a NULL was sent or a memory allocation failed.
+ * 	An UnorderedSet containing the same elements as set otherwise.
+ */
+UnorderedSet unorderedSetCopy(UnorderedSet set);
+
+/**
+ * unorderedSetDestroy: Deallocates an existing set. Clears all elements by
+ * using the stored free function.
+ *
+ * @param set - Target set to be deallocated. If set is NULL nothing will be
+ * 		done
+ */
+void unorderedSetDestroy(UnorderedSet set);
+
+/**
+ * unorderedSetGetSize: Returns the number of elements in a set
+ * @param set - The set which size is requested
+ * @return
+ * 	-1 if a NULL pointer was sent.
+ * 	Otherwise the number of elements in the set.
+ */
+int unorderedSetGetSize(UnorderedSet set);
+
+/**
+ *	unorderedSetGetFirst: Returns an iterator to the first element of the
+ *	set, in an unspecified order.
+ *
+ * @param set - The set to iterate over.
+ * @return
+ * 	NULL if a NULL pointer was sent or the set is empty.
+ * 	Iterator to the first element of the set otherwise
+ */
+SetIterator unorderedSetGetFirst(UnorderedSet set);
+
+/**
+ *	unorderedSetGetNext: Advances the iterator to the next element.
+ * @param set - The set for which to advance the iterator
+ * @param iter - The iterator to advance. Must be an iterator of set.
+ * @return
+ * 	NULL if reached the end of the set, or a NULL sent as argument
+ * 	Iterator to the next element in the set in case of success
+ */
+SetIterator unorderedSetGetNext(UnorderedSet set, SetIterator iter);
+
+/**
+ *	unorderedSetGetElement: Returns the element pointed to by the iterator
+ * @param set - The set the iterator belongs to
+ * @param iter - The iterator to dereference.
+ * @return
+ * 	NULL if a NULL was sent as argument
+ * 	The element of the set pointed to by iter in case of success
+ */
+SetElement unorderedSetGetElement(UnorderedSet set, SetIterator iter);
+
+/**
+ *	unorderedSetContains: if the given element exists in the set, returns it.
+ * @param set - The set to search in
+ * @param element - The element to look for.
+ * @return
+ * 	NULL if a NULL pointer was sent or if the element was not found.
+ * 	The found element in the set in case of success
+ */
+SetElement unorderedSetContains(UnorderedSet set, SetElement element);
+
+/**
+ *	unorderedSetFind: if the given element exists in the set, returns an
+ *	iterator to it.
+ * @param set - The set to search in
+ * @param element - The element to look for.
+ * @return
+ * 	NULL if a NULL pointer was sent or if the element was not found.
+ * 	An iterator to the found element in case of success
+ */
+SetIterator unorderedSetFind(UnorderedSet set, SetElement element);
+
+/**
+ *	unorderedSetAdd: Adds a new element to the set.
+ *  Iterators are invalidated by this operation.
+ *
+ * @param set - The set for which to add an element
+ * @param element - The element to insert. A copy of the element will be
+ * 		inserted as supplied by the copying function.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set or element
+ * 	SET_OUT_OF_MEMORY if an allocation failed
+ *  SET_ITEM_ALREADY_EXISTS if an equal item already exists in the set
+ * 	SET_SUCCESS the element has been inserted successfully
+ */
+SetResult unorderedSetAdd(UnorderedSet set, SetElement element);
+
+/**
+ *	unorderedSetInsert: Same as unorderedSetAdd, also reporting where the
+ *	element is, so that the caller does not have to search for it again.
+ *  Iterators are invalidated by this operation, except the one returned.
+ *
+ * @param set - The set for which to add an element
+ * @param element - The element to insert, as in unorderedSetAdd.
+ * @param position - Output, may be NULL. On SET_SUCCESS the iterator of the
+ * 		added element, on SET_ITEM_ALREADY_EXISTS that of the equal element
+ * 		of the set. Unchanged otherwise.
+ * @return
+ * 	As unorderedSetAdd.
+ */
+SetResult unorderedSetInsert(UnorderedSet set, SetElement element,
+		SetIterator* position);
+
+/**
+ * 	unorderedSetRemove: Removes an element from the set, and deallocates it
+ * 	using the free function.
+ *  Iterators are invalidated by this operation.
+ *
+ * @param set - The set to remove the element from.
+ * @param element - The element to remove from the set.
+ * @return
+ * 	SET_NULL_ARGUMENT if a NULL was sent as set or element
+ * 	SET_ITEM_DOES_NOT_EXIST if the element doesn't exist in the set
+ * 	SET_SUCCESS if the element was successfully removed.
+ */
+SetResult unorderedSetRemove(UnorderedSet set, SetElement element);
+
+/**
+ * unorderedSetClear: Removes all elements from target set.
+ * The elements are deallocated using the stored free function.
+ * @param set - Target set to remove all element from
+ * @return
+ * 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+ * 	SET_SUCCESS - Otherwise.
+ */
+SetResult unorderedSetClear(UnorderedSet set);
+
+/**
+ * Macro for iterating over an unordered set.
+ * Declares a new iterator for the loop.
+ */
+#define UNORDERED_SET_FOREACH(iterator,set) \
+	for(SetIterator iterator = unorderedSetGetFirst(set) ; \
+		iterator ;\
+		iterator = unorderedSetGetNext(set, iterator))
+
+
+#ifdef __cplusplus
+}	// extern "C"
+#endif
+
+#endif /* UNORDERED_SET_H_ */
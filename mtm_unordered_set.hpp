@@ -0,0 +1,408 @@
+#ifndef MTM_UNORDERED_SET_HPP_
+#define MTM_UNORDERED_SET_HPP_
+
+/* The minimum of headers required */
+#include <utility>
+#include <iterator>
+#include <exception>
+#include <functional>
+#include <new>
+#include <assert.h>
+
+/* The C UnorderedSet generic ADT */
+#include "mtm_unordered_set.h"
+
+namespace mtm {
+
+	/**
+	 * Generic Unordered Set Class
+	 *
+	 * template <class T, class Hash = std::hash<T>, class Eq = std::equal_to<T> >
+	 * class unordered_set
+	 *
+	 * T - Stored data type
+	 * Hash - Function object class hashing an element. Default is
+	 * 	   std::hash<T>.
+	 * Eq - Function object class comparing two elements for equality. Default
+	 * 	   is std::equal_to<T>, which uses T::operator==.
+	 *
+	 * A set for elements that only need membership tests, built on the C
+	 * UnorderedSet (a hash table). insert, find and erase run in O(1) expected
+	 * time, and iteration visits the elements in an unspecified order.
+	 * Otherwise the interface and semantics are those of mtm::set, except that
+	 * insert and erase invalidate all iterators. Elements are constructed in
+	 * pooled blocks of the C set (see unorderedSetCreateInline), so an element
+	 * costs no allocation of its own, and are never moved.
+	 *
+	 * The following public members are available:
+	 *
+	 * Types:
+	 *  class const_iterator - allows iteration over set elements
+	 *  value_type - typedef for T
+	 *  const_reference - typedef for T const&
+	 *  result_type - result value of set insert
+	 *
+	 * Functions:
+	 *  unordered_set - constructor. initializes empty set.
+	 *  unordered_set(const unordered_set& other) - copy constructor.
+	 *  operator= - assignment operator. copies all elements from other.
+	 *  ~unordered_set - destroys the set and frees all memory allocated.
+	 *  begin, end, cbegin, cend - iteration.
+	 *  size - number of elements in set
+	 *  find - obtain const iterator to element, or end() if the element is
+	 *         not in the set.
+	 *  contains - true if the element is in the set.
+	 *  count - 1 if the element is in the set, 0 otherwise.
+	 *  insert - inserts element. Return value is as in mtm::set::insert.
+	 *  erase(T const& element) - erases given value from the set.
+	 *  erase(const_iterator iter) - erases element pointed to by iterator.
+	 *  clear() - erases all elements in the set.
+	 */
+	template<class T, class Hash = std::hash<T>, class Eq = std::equal_to<T> >
+	class unordered_set
+	{
+	public:
+		/** iterator type for the container */
+		class const_iterator;
+		/** element data type */
+		typedef T value_type;
+		/** const reference to element data type */
+		typedef T const& const_reference;
+		/** set insert result type */
+		typedef std::pair<const_iterator, bool> result_type;
+		/**
+		 * Ctor/CCtor/Dtor/assignment operator
+		 *  In case that memory allocation fails constructors/operator= throw
+		 *  Exception().
+		 */
+		unordered_set();
+		unordered_set(const unordered_set& other);
+		unordered_set& operator=(unordered_set const& other);
+		~unordered_set();
+
+		const_iterator begin() const;
+		const_iterator end() const;
+		const_iterator cbegin() const;
+		const_iterator cend() const;
+		/** returns the number of elements in the set */
+		int size() const;
+		/**
+		 * find
+		 *  obtain const iterator to element. If element is not in the set,
+		 *  return value compares to end().
+		 */
+		const_iterator find(T const& element) const;
+		/**
+		 * contains, count
+		 *  contains returns true if element is in the set, and count
+		 *  returns 1 if it is and 0 otherwise.
+		 */
+		bool contains(T const& element) const;
+		int count(T const& element) const;
+		/**
+		 * insert
+		 *  inserts an element to the set. Return value is a pair
+		 *  <const_iterator, bool>, as in mtm::set::insert.
+		 */
+		result_type insert(T const& data);
+		/**
+		 * erase(T const& element)
+		 *  erases given value from the set.
+		 *  Throws ElementNotFound() if value does not exist in the set.
+		 */
+		void erase(T const& element);
+		/**
+		 * erase(const_iterator iter)
+		 *  erases element pointed to by iterator.
+		 *  Throws InvalidIterator() if iterator does not point to an element.
+		 */
+		void erase(const_iterator iter);
+		/** erases all elements in the set */
+		void clear();
+		//--------------- Exception types: -------------
+		class Exception: public std::exception
+		{
+		};
+		class ElementNotFound: public Exception
+		{
+		};
+		class InvalidIterator: public Exception
+		{
+		};
+
+	private:
+		/** Elements are placed in C set blocks, aligned to 16 bytes */
+		static_assert(alignof(T) <= 16,
+				"mtm::unordered_set element over-aligned");
+		/** Underlying C unordered set object */
+		UnorderedSet m_CSet;
+		/** Functions for C unordered set object */
+		static SetElement CopyElementFcn(SetElement dest, SetElement lmnt);
+		static void DestroyElementFcn(SetElement lmnt);
+		static int CompareElementFcn(SetElement left, SetElement right);
+		static size_t HashElementFcn(SetElement lmnt);
+	};
+
+	///////////
+	// iterator
+	///////////
+
+	/**
+	 * Const iterator class for the unordered set. It may only be advanced in
+	 * the forward direction.
+	 */
+	template<class T, class Hash, class Eq>
+	class unordered_set<T, Hash, Eq>::const_iterator
+	{
+	public:
+		/** Iterator traits, as std::iterator_traits reads them */
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T const* pointer;
+		typedef T const& reference;
+
+		/** Prefix and postfix operators to advance the iterator */
+		const_iterator & operator++()
+		{
+			m_Current = unorderedSetGetNext(m_Owner->m_CSet, m_Current);
+			return *this;
+		}
+		const_iterator operator++(int)
+		{
+			const_iterator newIterator(*this);
+			++*this;
+			return newIterator;
+		}
+
+		/**
+		 * Dereference operator to obtain value the iterator points to.
+		 * Throws InvalidIterator() if the iterator does not point to an
+		 * element.
+		 */
+		T const& operator*() const
+		{
+			SetElement element = unorderedSetGetElement(m_Owner->m_CSet,
+					m_Current);
+			if (element == NULL) {
+				throw InvalidIterator();
+			}
+			return *static_cast<T*>(element);
+		}
+
+		const_iterator(const_iterator const&) = default;
+		const_iterator& operator=(const_iterator const&) = default;
+		~const_iterator() = default;
+
+		bool operator==(const_iterator const& other) const
+		{
+			return m_Current == other.m_Current;
+		}
+		bool operator!=(const_iterator const& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		friend class unordered_set;
+
+		/** Set object the iterator belongs to */
+		unordered_set<T, Hash, Eq> const* m_Owner;
+
+		/** Slot of the C implementation the iterator currently points to */
+		SetIterator m_Current;
+
+		const_iterator(unordered_set<T, Hash, Eq> const* owner,
+				SetIterator cset_iter) :
+				m_Owner(owner), m_Current(cset_iter)
+		{
+		}
+	};
+
+	///////////
+	// unordered_set funcs
+	///////////
+
+	template<class T, class Hash, class Eq>
+	unordered_set<T, Hash, Eq>::unordered_set() :
+			m_CSet(NULL)
+	{
+		m_CSet = unorderedSetCreateInline(sizeof(T), CopyElementFcn,
+				DestroyElementFcn, CompareElementFcn, HashElementFcn);
+		if (NULL == m_CSet) {
+			throw Exception();
+		}
+	}
+
+	template<class T, class Hash, class Eq>
+	unordered_set<T, Hash, Eq>::unordered_set(const unordered_set& sourceSet) :
+			m_CSet(NULL)
+	{
+		m_CSet = unorderedSetCopy(sourceSet.m_CSet);
+		if (NULL == m_CSet) {
+			throw Exception();
+		}
+	}
+
+	template<class T, class Hash, class Eq>
+	unordered_set<T, Hash, Eq>& unordered_set<T, Hash, Eq>::operator=(
+			const unordered_set& sourceSet)
+	{
+		if (this == &sourceSet) {
+			return *this;
+		}
+		UnorderedSet copy = unorderedSetCopy(sourceSet.m_CSet);
+		if (NULL == copy) {
+			throw Exception();
+		}
+		unorderedSetDestroy(m_CSet);
+		m_CSet = copy;
+		return *this;
+	}
+
+	template<class T, class Hash, class Eq>
+	unordered_set<T, Hash, Eq>::~unordered_set()
+	{
+		unorderedSetDestroy(m_CSet);
+	}
+
+	template<class T, class Hash, class Eq>
+	typename unordered_set<T, Hash, Eq>::const_iterator
+	unordered_set<T, Hash, Eq>::begin() const
+	{
+		return const_iterator(this, unorderedSetGetFirst(m_CSet));
+	}
+
+	template<class T, class Hash, class Eq>
+	typename unordered_set<T, Hash, Eq>::const_iterator
+	unordered_set<T, Hash, Eq>::end() const
+	{
+		return const_iterator(this, NULL);
+	}
+
+	template<class T, class Hash, class Eq>
+	typename unordered_set<T, Hash, Eq>::const_iterator
+	unordered_set<T, Hash, Eq>::cbegin() const
+	{
+		return begin();
+	}
+
+	template<class T, class Hash, class Eq>
+	typename unordered_set<T, Hash, Eq>::const_iterator
+	unordered_set<T, Hash, Eq>::cend() const
+	{
+		return end();
+	}
+
+	template<class T, class Hash, class Eq>
+	int unordered_set<T, Hash, Eq>::size() const
+	{
+		assert(m_CSet != NULL);
+		return unorderedSetGetSize(m_CSet);
+	}
+
+	template<class T, class Hash, class Eq>
+	typename unordered_set<T, Hash, Eq>::const_iterator
+	unordered_set<T, Hash, Eq>::find(T const& element) const
+	{
+		assert(m_CSet != NULL);
+		// a miss is NULL, which is end()
+		return const_iterator(this, unorderedSetFind(m_CSet,
+				static_cast<SetElement>(const_cast<T*>(&element))));
+	}
+
+	template<class T, class Hash, class Eq>
+	bool unordered_set<T, Hash, Eq>::contains(T const& element) const
+	{
+		assert(m_CSet != NULL);
+		return unorderedSetContains(m_CSet,
+				static_cast<SetElement>(const_cast<T*>(&element))) != NULL;
+	}
+
+	template<class T, class Hash, class Eq>
+	int unordered_set<T, Hash, Eq>::count(T const& element) const
+	{
+		return contains(element) ? 1 : 0;
+	}
+
+	template<class T, class Hash, class Eq>
+	typename unordered_set<T, Hash, Eq>::result_type
+	unordered_set<T, Hash, Eq>::insert(T const& data)
+	{
+		assert(m_CSet != NULL);
+		SetIterator position = NULL;
+		SetResult res = unorderedSetInsert(m_CSet,
+				static_cast<SetElement>(const_cast<T*>(&data)), &position);
+		assert(res != SET_NULL_ARGUMENT);
+		if (res == SET_OUT_OF_MEMORY) {
+			throw Exception();
+		}
+		return result_type(const_iterator(this, position), res == SET_SUCCESS);
+	}
+
+	template<class T, class Hash, class Eq>
+	void unordered_set<T, Hash, Eq>::erase(T const& element)
+	{
+		assert(m_CSet != NULL);
+		if (unorderedSetRemove(m_CSet,
+				static_cast<SetElement>(const_cast<T*>(&element)))
+				== SET_ITEM_DOES_NOT_EXIST) {
+			throw ElementNotFound();
+		}
+	}
+
+	template<class T, class Hash, class Eq>
+	void unordered_set<T, Hash, Eq>::erase(const_iterator iter)
+	{
+		erase(*iter);
+		// if iter does not point to an element, *iter will throw InvalidIterator()
+	}
+
+	template<class T, class Hash, class Eq>
+	void unordered_set<T, Hash, Eq>::clear()
+	{
+		assert(m_CSet != NULL);
+		unorderedSetClear(m_CSet);
+	}
+
+	///////////
+	// private unordered_set funcs
+	///////////
+
+	template<class T, class Hash, class Eq>
+	SetElement unordered_set<T, Hash, Eq>::CopyElementFcn(SetElement dest,
+			SetElement lmnt)
+	{
+		if (dest == NULL || lmnt == NULL) {
+			return NULL;
+		}
+		// exceptions must not cross the C set, a failed copy is reported as NULL
+		try {
+			return static_cast<SetElement>(new (dest) T(*static_cast<T*>(lmnt)));
+		} catch (...) {
+			return NULL;
+		}
+	}
+
+	template<class T, class Hash, class Eq>
+	void unordered_set<T, Hash, Eq>::DestroyElementFcn(SetElement lmnt)
+	{
+		// the memory of the element belongs to the C set
+		static_cast<T*>(lmnt)->~T();
+	}
+
+	template<class T, class Hash, class Eq>
+	int unordered_set<T, Hash, Eq>::CompareElementFcn(SetElement left,
+			SetElement right)
+	{
+		return Eq()(*static_cast<T*>(left), *static_cast<T*>(right)) ? 0 : 1;
+	}
+
+	template<class T, class Hash, class Eq>
+	size_t unordered_set<T, Hash, Eq>::HashElementFcn(SetElement lmnt)
+	{
+		return Hash()(*static_cast<T*>(lmnt));
+	}
+}
+
+#endif // #ifndef MTM_UNORDERED_SET_HPP_
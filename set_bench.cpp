@@ -0,0 +1,950 @@
+/*
+ * set_bench.cpp
+ *
+ * Benchmarks for the set containers. Not part of the tests, build with
+ * optimizations and run through
+ *   make bench BENCH_ARGS="[--format text|csv|json] [--min-size n]
+ *       [--max-size n] [--threads n]"
+ *
+ * The comparison times insert, find, erase, iterate, copy and clear of
+ * mtm::set and mtm::unordered_set against std::set and std::unordered_set,
+ * for int, std::string and 64 byte POD elements, with keys inserted in
+ * random, sorted and reverse order, for sizes from --min-size (default 10)
+ * to --max-size (default 1000000, use 10000000 for a full run) in powers
+ * of 10. Every row reports the mean time per operation and the throughput
+ * of an untimed loop, and the median and 99th percentile latency of single
+ * calls from a second loop. For iterate, copy and clear an operation is one
+ * element, and the latencies are those of whole calls. Latencies include
+ * the overhead of reading the clock, which is reported once.
+ *
+ * The csv and json formats print only the comparison, so results of
+ * releases can be diffed. The text format is followed by the benchmarks of
+ * the comparator, filters, batch lookups, copies, snapshots, tiny sets,
+ * integer bitmaps, parallel builds and contention, on --max-size keys and up
+ * to --threads threads (default all hardware threads).
+ */
+
+#include "mtm_set.hpp"
+#include "mtm_bitmap_set.hpp"
+#include "mtm_small_set.hpp"
+#include "mtm_unordered_set.hpp"
+#include "mtm_concurrent_set.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+using std::cout;
+using std::endl;
+
+typedef std::chrono::steady_clock Clock;
+
+/* Nanoseconds since start */
+static double nsSince(Clock::time_point start)
+{
+	std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+/* Nanoseconds per operation since start */
+static double nsPerOp(Clock::time_point start, size_t operations)
+{
+	return nsSince(start) / operations;
+}
+
+/* Callbacks of the plain C set, the path mtm::set used to take */
+static SetElement copyIntInto(SetElement dest, SetElement src)
+{
+	*static_cast<int*>(dest) = *static_cast<int*>(src);
+	return dest;
+}
+
+static void freeInt(SetElement element)
+{
+	(void)element; // stored inline
+}
+
+static int compareInts(SetElement left, SetElement right)
+{
+	int l = *static_cast<int*>(left);
+	int r = *static_cast<int*>(right);
+	return l < r ? -1 : (r < l ? 1 : 0);
+}
+
+static size_t hashInt(SetElement element, void* context)
+{
+	(void)context;
+	return static_cast<size_t>(*static_cast<int*>(element));
+}
+
+/* Compares the comparator inlined by mtm::set to the C callback path */
+static void benchComparator(std::vector<int> const& keys)
+{
+	size_t n = keys.size();
+	size_t found = 0;
+
+	Set cset = setCreateInline(sizeof(int), copyIntInto, freeInt,
+			compareInts);
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < n; i++) {
+		setAdd(cset, const_cast<int*>(&keys[i]));
+	}
+	double cInsert = nsPerOp(start, n);
+	start = Clock::now();
+	for (size_t i = 0; i < n; i++) {
+		found += setContains(cset, const_cast<int*>(&keys[i])) != NULL;
+	}
+	double cFind = nsPerOp(start, n);
+	setDestroy(cset);
+
+	mtm::set<int> set;
+	start = Clock::now();
+	for (size_t i = 0; i < n; i++) {
+		set.insert(keys[i]);
+	}
+	double inlineInsert = nsPerOp(start, n);
+	start = Clock::now();
+	for (size_t i = 0; i < n; i++) {
+		found += *set.find(keys[i]) == keys[i];
+	}
+	double inlineFind = nsPerOp(start, n);
+
+	cout << "comparator, " << n << " random ints (ns/op)" << endl;
+	cout << "  insert: callback " << cInsert << ", inline " << inlineInsert
+			<< endl;
+	cout << "  find:   callback " << cFind << ", inline " << inlineFind
+			<< endl;
+	if (found != 2 * n) {
+		cout << "  error: not all keys found" << endl;
+	}
+}
+
+/* Lookups which mostly miss, with and without a filter */
+static void benchFilter(std::vector<int> const& keys)
+{
+	size_t n = keys.size();
+	Set cset = setCreateInline(sizeof(int), copyIntInto, freeInt,
+			compareInts);
+	// even keys are in the set, and 9 of every 10 lookups are of odd keys
+	std::vector<int> lookups(keys);
+	for (size_t i = 0; i < n; i++) {
+		int even = 2 * keys[i];
+		setAdd(cset, &even);
+		lookups[i] = i % 10 == 0 ? even : even + 1;
+	}
+	double times[2];
+	size_t found[2] = { 0, 0 };
+	for (int filtered = 0; filtered < 2; filtered++) {
+		if (filtered) {
+			setEnableFilter(cset, hashInt, 0.01, 0);
+		}
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < n; i++) {
+			found[filtered] += setContains(cset, &lookups[i]) != NULL;
+		}
+		times[filtered] = nsPerOp(start, n);
+	}
+	setDestroy(cset);
+	cout << "filter, " << n << " ints, 90% misses (ns/op)" << endl;
+	cout << "  find: no filter " << times[0] << ", 1% filter " << times[1]
+			<< endl;
+	if (found[0] != found[1]) {
+		cout << "  error: the filter changed the results" << endl;
+	}
+}
+
+/* Copies of a set share its nodes until the first modification */
+static void benchCopy(std::vector<int> const& keys)
+{
+	const int copies = 1000;
+	mtm::set<int> set(keys.begin(), keys.end());
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < copies; i++) {
+		mtm::set<int> snapshot(set);
+	}
+	double copy = nsPerOp(start, copies);
+	mtm::set<int> snapshot(set);
+	start = Clock::now();
+	snapshot.insert(-1);
+	double firstInsert = nsPerOp(start, 1);
+	cout << "copy, " << keys.size() << " ints (ns)" << endl;
+	cout << "  copy: " << copy << ", first insert to the copy: "
+			<< firstInsert << endl;
+}
+
+/* Loading a snapshot compared to inserting the elements one by one */
+static void benchSnapshot(std::vector<int> const& keys)
+{
+	const char* path = "set_bench.snapshot";
+	Clock::time_point start = Clock::now();
+	mtm::set<int> set;
+	for (size_t i = 0; i < keys.size(); i++) {
+		set.insert(keys[i]);
+	}
+	double insert = nsSince(start) / 1e6;
+	set.save(path);
+	mtm::set<int> loaded;
+	start = Clock::now();
+	loaded.load(path);
+	double load = nsSince(start) / 1e6;
+	remove(path);
+	cout << "snapshot, " << keys.size() << " ints (ms)" << endl;
+	cout << "  insert one by one: " << insert << ", load: " << load << endl;
+}
+
+/* mtm::set behind one mutex, the way threads shared a set before */
+struct LockedSet {
+	mtm::set<int> set;
+	std::mutex mutex;
+	bool insert(int key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return set.insert(key).second;
+	}
+	bool erase(int key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		try {
+			set.erase(key);
+			return true;
+		} catch (mtm::set<int>::ElementNotFound&) {
+			return false;
+		}
+	}
+	bool contains(int key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return set.contains(key);
+	}
+};
+
+/*
+ * Runs operations operations split between threads threads, 80% lookups,
+ * 10% inserts and 10% erases of random keys below range, and returns the
+ * total throughput in millions of operations per second
+ */
+template<class SharedSet>
+static double runContention(SharedSet& set, int threads, int operations,
+		int range)
+{
+	std::vector<std::thread> workers;
+	Clock::time_point start = Clock::now();
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&set, t, threads, operations, range]() {
+			std::mt19937 random(t);
+			for (int i = t; i < operations; i += threads) {
+				int key = random() % range;
+				int op = random() % 10;
+				if (op == 0) {
+					set.insert(key);
+				} else if (op == 1) {
+					set.erase(key);
+				} else {
+					set.contains(key);
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	return 1000 / nsPerOp(start, operations);
+}
+
+/* Builds a set out of unsorted keys with more and more threads */
+static void benchParallelBuild(std::vector<int> const& keys, int maxThreads)
+{
+	cout << "parallel build, " << keys.size() << " ints (ms)" << endl;
+	Clock::time_point start = Clock::now();
+	mtm::set<int> serial(keys.begin(), keys.end());
+	double serialTime = nsSince(start) / 1e6;
+	cout << "  range constructor: " << serialTime << endl;
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		start = Clock::now();
+		mtm::set<int> parallel(mtm::parallel(threads), keys.begin(),
+				keys.end());
+		double time = nsSince(start) / 1e6;
+		cout << "  " << threads << " threads: " << time << ", speedup "
+				<< serialTime / time << endl;
+		if (parallel.size() != serial.size()) {
+			cout << "  error: the parallel build lost elements" << endl;
+		}
+	}
+}
+
+/* Compares mtm::concurrent_set to a locked mtm::set as threads are added */
+static void benchContention(int range, int maxThreads)
+{
+	const int operations = 2000000;
+	cout << "contention, " << operations << " operations on " << range
+			<< " keys (Mops/s)" << endl;
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		mtm::concurrent_set<int> concurrent;
+		LockedSet locked;
+		for (int key = 0; key < range; key += 2) {
+			concurrent.insert(key);
+			locked.insert(key);
+		}
+		double concurrentRate = runContention(concurrent, threads, operations,
+				range);
+		double lockedRate = runContention(locked, threads, operations, range);
+		cout << "  " << threads << " threads: concurrent_set " << concurrentRate
+				<< ", locked set " << lockedRate << endl;
+	}
+}
+
+
+/* A 64 byte element ordered by its key, the rest is payload */
+struct Pod64 {
+	long long key;
+	char payload[56];
+};
+
+static bool operator<(Pod64 const& left, Pod64 const& right)
+{
+	return left.key < right.key;
+}
+
+static bool operator==(Pod64 const& left, Pod64 const& right)
+{
+	return left.key == right.key;
+}
+
+namespace std {
+	template<>
+	struct hash<Pod64> {
+		size_t operator()(Pod64 const& element) const
+		{
+			return hash<long long>()(element.key);
+		}
+	};
+}
+
+/* Element types of the comparison: make builds the element of a key, so
+ * that keys in sorted order build elements in sorted order, and touch
+ * reads an element so that lookups are not optimized away */
+template<class T>
+struct Element;
+
+template<>
+struct Element<int> {
+	static const char* name()
+	{
+		return "int";
+	}
+	static int make(int key)
+	{
+		return key;
+	}
+	static size_t touch(int element)
+	{
+		return element;
+	}
+};
+
+template<>
+struct Element<std::string> {
+	static const char* name()
+	{
+		return "string";
+	}
+	static std::string make(int key)
+	{
+		char buffer[32]; // longer than the small string buffer of libraries
+		snprintf(buffer, sizeof(buffer), "element-%012d", key);
+		return buffer;
+	}
+	static size_t touch(std::string const& element)
+	{
+		return element[element.size() - 1];
+	}
+};
+
+template<>
+struct Element<Pod64> {
+	static const char* name()
+	{
+		return "pod64";
+	}
+	static Pod64 make(int key)
+	{
+		Pod64 element;
+		element.key = key;
+		memset(element.payload, key & 0xff, sizeof(element.payload));
+		return element;
+	}
+	static size_t touch(Pod64 const& element)
+	{
+		return element.key;
+	}
+};
+
+static volatile size_t sink;
+
+enum Operation {
+	OP_INSERT, OP_FIND, OP_ERASE, OP_ITERATE, OP_COPY, OP_CLEAR, OPERATIONS
+};
+
+static const char* const operationNames[OPERATIONS] = { "insert", "find",
+		"erase", "iterate", "copy", "clear" };
+
+enum Distribution {
+	RANDOM, SORTED, REVERSE, DISTRIBUTIONS
+};
+
+static const char* const distributionNames[DISTRIBUTIONS] = { "random",
+		"sorted", "reverse" };
+
+/* Every size is run at least this many operations, repeating small sizes */
+static const size_t MIN_OPERATIONS = 100000;
+/* Latencies kept per row, larger runs time only every few calls */
+static const size_t MAX_SAMPLES = 100000;
+
+/* Measurements of one operation of one container */
+struct Measurement {
+	double ns; // total time of the untimed loop
+	size_t operations; // operations of the untimed loop
+	std::vector<double> samples; // nanoseconds of single calls
+	Measurement() :
+			ns(0), operations(0)
+	{
+	}
+};
+
+/*
+ * Calls operation(i) for every i below count. Adds the time of the loop to
+ * measurement or, when sampled, the latency of every stride-th call
+ */
+template<class Function>
+static void timeLoop(Measurement& measurement, size_t count, bool sampled,
+		size_t stride, Function operation)
+{
+	if (!sampled) {
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < count; i++) {
+			operation(i);
+		}
+		measurement.ns += nsSince(start);
+		measurement.operations += count;
+		return;
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (i % stride != 0) {
+			operation(i);
+			continue;
+		}
+		Clock::time_point start = Clock::now();
+		operation(i);
+		measurement.samples.push_back(nsSince(start));
+	}
+}
+
+/* Times one call handling elements elements */
+template<class Function>
+static void timeCall(Measurement& measurement, size_t elements,
+		Function operation)
+{
+	Clock::time_point start = Clock::now();
+	operation();
+	double ns = nsSince(start);
+	measurement.ns += ns;
+	measurement.operations += elements;
+	measurement.samples.push_back(ns);
+}
+
+/*
+ * Runs the operations on a Set of inserts, looking up and erasing lookups
+ * (a permutation of inserts). The untimed pass times whole loops and calls
+ * of every operation, the sampled pass times single inserts, finds and
+ * erases
+ */
+template<class Set, class T>
+static void runPass(std::vector<T> const& inserts, std::vector<T> const& lookups,
+		size_t repetitions, bool sampled, size_t stride,
+		Measurement results[OPERATIONS])
+{
+	size_t n = inserts.size();
+	for (size_t r = 0; r < repetitions; r++) {
+		Set set;
+		timeLoop(results[OP_INSERT], n, sampled, stride, [&](size_t i) {
+			set.insert(inserts[i]);
+		});
+		timeLoop(results[OP_FIND], n, sampled, stride, [&](size_t i) {
+			sink = sink + Element<T>::touch(*set.find(lookups[i]));
+		});
+		if (!sampled) {
+			timeCall(results[OP_ITERATE], n, [&]() {
+				size_t sum = 0;
+				for (typename Set::const_iterator it = set.begin();
+						it != set.end(); ++it) {
+					sum += Element<T>::touch(*it);
+				}
+				sink = sink + sum;
+			});
+			Set* copy = NULL;
+			timeCall(results[OP_COPY], n, [&]() {
+				copy = new Set(set);
+			});
+			delete copy;
+		}
+		timeLoop(results[OP_ERASE], n, sampled, stride, [&](size_t i) {
+			set.erase(lookups[i]);
+		});
+		if (!sampled) {
+			for (size_t i = 0; i < n; i++) {
+				set.insert(inserts[i]);
+			}
+			timeCall(results[OP_CLEAR], n, [&]() {
+				set.clear();
+			});
+		}
+	}
+}
+
+/* One row of the report */
+struct Row {
+	const char* container;
+	const char* element;
+	const char* distribution;
+	size_t size;
+	const char* operation;
+	double nsPerOp;
+	double mopsPerSecond;
+	double p50;
+	double p99;
+};
+
+enum Format {
+	FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON
+};
+
+/* Prints rows as they are measured */
+class Report {
+public:
+	Report(Format format, double clockOverhead) :
+			format(format), rows(0)
+	{
+		if (format == FORMAT_CSV) {
+			cout << "container,element,distribution,size,operation,ns_per_op,"
+					"mops_per_s,p50_ns,p99_ns" << endl;
+		} else if (format == FORMAT_JSON) {
+			cout << "{\"clock_overhead_ns\": " << clockOverhead
+					<< ", \"results\": [";
+		} else {
+			cout << "comparison (latencies include " << clockOverhead
+					<< " ns of clock overhead)" << endl;
+			cout << std::left << std::setw(20) << "container"
+					<< std::setw(8) << "element" << std::setw(9) << "keys"
+					<< std::right << std::setw(9) << "size" << "  "
+					<< std::left << std::setw(8) << "op" << std::right
+					<< std::setw(10) << "ns/op" << std::setw(10) << "Mops/s"
+					<< std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns"
+					<< endl;
+		}
+	}
+
+	~Report()
+	{
+		if (format == FORMAT_JSON) {
+			cout << "\n]}" << endl;
+		}
+	}
+
+	void add(Row const& row)
+	{
+		if (format == FORMAT_CSV) {
+			cout << row.container << ',' << row.element << ','
+					<< row.distribution << ',' << row.size << ','
+					<< row.operation << ',' << row.nsPerOp << ','
+					<< row.mopsPerSecond << ',' << row.p50 << ',' << row.p99
+					<< endl;
+		} else if (format == FORMAT_JSON) {
+			cout << (rows == 0 ? "\n" : ",\n") << "  {\"container\": \""
+					<< row.container << "\", \"element\": \"" << row.element
+					<< "\", \"distribution\": \"" << row.distribution
+					<< "\", \"size\": " << row.size << ", \"operation\": \""
+					<< row.operation << "\", \"ns_per_op\": " << row.nsPerOp
+					<< ", \"mops_per_s\": " << row.mopsPerSecond
+					<< ", \"p50_ns\": " << row.p50 << ", \"p99_ns\": "
+					<< row.p99 << "}";
+		} else {
+			cout << std::left << std::setw(20) << row.container
+					<< std::setw(8) << row.element << std::setw(9)
+					<< row.distribution << std::right << std::setw(9)
+					<< row.size << "  " << std::left << std::setw(8)
+					<< row.operation << std::right << std::fixed
+					<< std::setprecision(1) << std::setw(10) << row.nsPerOp
+					<< std::setw(10) << row.mopsPerSecond << std::setw(10)
+					<< row.p50 << std::setw(10) << row.p99 << endl;
+			cout.unsetf(std::ios::fixed);
+			cout << std::setprecision(6);
+		}
+		rows++;
+	}
+
+private:
+	Format format;
+	size_t rows;
+};
+
+/* The sample at quantile of sorted samples */
+static double percentile(std::vector<double> const& sorted, double quantile)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+	return sorted[static_cast<size_t>(quantile * (sorted.size() - 1))];
+}
+
+/* Measures one container on one set of keys and reports every operation */
+template<class Set, class T>
+static void compareContainer(const char* container, Distribution distribution,
+		std::vector<T> const& inserts, std::vector<T> const& lookups,
+		Report& report)
+{
+	size_t n = inserts.size();
+	size_t repetitions = std::max<size_t>(1, MIN_OPERATIONS / n);
+	size_t stride = std::max<size_t>(1, n * repetitions / MAX_SAMPLES);
+	Measurement results[OPERATIONS];
+	runPass<Set>(inserts, lookups, repetitions, false, stride, results);
+	runPass<Set>(inserts, lookups, repetitions, true, stride, results);
+	for (int op = 0; op < OPERATIONS; op++) {
+		Measurement& measurement = results[op];
+		std::sort(measurement.samples.begin(), measurement.samples.end());
+		Row row;
+		row.container = container;
+		row.element = Element<T>::name();
+		row.distribution = distributionNames[distribution];
+		row.size = n;
+		row.operation = operationNames[op];
+		row.nsPerOp = measurement.ns / measurement.operations;
+		row.mopsPerSecond = 1000 / row.nsPerOp;
+		row.p50 = percentile(measurement.samples, 0.5);
+		row.p99 = percentile(measurement.samples, 0.99);
+		report.add(row);
+	}
+}
+
+/* Keys 0..size-1 in the order of distribution */
+static std::vector<int> orderKeys(Distribution distribution, size_t size,
+		std::mt19937& random)
+{
+	std::vector<int> keys;
+	for (size_t i = 0; i < size; i++) {
+		keys.push_back(static_cast<int>(i));
+	}
+	if (distribution == RANDOM) {
+		std::shuffle(keys.begin(), keys.end(), random);
+	} else if (distribution == REVERSE) {
+		std::reverse(keys.begin(), keys.end());
+	}
+	return keys;
+}
+
+/* Compares all containers of T elements on all sizes and distributions */
+template<class T>
+static void compareElements(size_t minSize, size_t maxSize, Report& report)
+{
+	std::mt19937 random(2015);
+	for (int d = 0; d < DISTRIBUTIONS; d++) {
+		Distribution distribution = static_cast<Distribution>(d);
+		for (size_t size = minSize; size <= maxSize; size *= 10) {
+			// random keys are looked up in another random order
+			std::vector<int> insertKeys = orderKeys(distribution, size, random);
+			std::vector<int> lookupKeys = distribution == RANDOM ?
+					orderKeys(distribution, size, random) : insertKeys;
+			std::vector<T> inserts;
+			std::vector<T> lookups;
+			for (size_t i = 0; i < size; i++) {
+				inserts.push_back(Element<T>::make(insertKeys[i]));
+				lookups.push_back(Element<T>::make(lookupKeys[i]));
+			}
+			compareContainer<mtm::set<T> >("mtm::set", distribution, inserts,
+					lookups, report);
+			compareContainer<std::set<T> >("std::set", distribution, inserts,
+					lookups, report);
+			compareContainer<mtm::unordered_set<T> >("mtm::unordered_set",
+					distribution, inserts, lookups, report);
+			compareContainer<std::unordered_set<T> >("std::unordered_set",
+					distribution, inserts, lookups, report);
+		}
+	}
+}
+
+/* Batches of lookups compared to looking the keys up one at a time */
+static void benchBatch(std::vector<int> const& keys)
+{
+	const size_t batchSize = 1024;
+	size_t n = keys.size();
+	size_t batches = std::max<size_t>(1, n / batchSize);
+	Set cset = setCreateInline(sizeof(int), copyIntInto, freeInt,
+			compareInts);
+	mtm::set<int> set;
+	for (size_t i = 0; i < n; i++) {
+		setAdd(cset, const_cast<int*>(&keys[i]));
+		set.insert(keys[i]);
+	}
+	// batches of random keys from the set, and the same batches sorted
+	std::vector<int> probes(keys);
+	std::mt19937 random(2015);
+	std::shuffle(probes.begin(), probes.end(), random);
+	std::vector<int> sortedProbes(probes);
+	for (size_t b = 0; b < batches; b++) {
+		std::vector<int>::iterator first = sortedProbes.begin() + b * batchSize;
+		std::sort(first, std::min(first + batchSize, sortedProbes.end()));
+	}
+	size_t count = std::min(batchSize, n);
+	std::vector<SetElement> elements(count);
+	std::vector<SetElement> found(count);
+	std::vector<mtm::set<int>::const_iterator> iterators;
+	iterators.reserve(count);
+	double times[2][4];
+	for (int sorted = 0; sorted < 2; sorted++) {
+		int const* batch = sorted ? &sortedProbes[0] : &probes[0];
+		Clock::time_point start = Clock::now();
+		for (size_t b = 0; b < batches; b++) {
+			for (size_t i = 0; i < count; i++) {
+				sink = sink + (setContains(cset,
+						const_cast<int*>(&batch[b * count + i])) != NULL);
+			}
+		}
+		times[sorted][0] = nsPerOp(start, batches * count);
+		start = Clock::now();
+		for (size_t b = 0; b < batches; b++) {
+			for (size_t i = 0; i < count; i++) {
+				elements[i] = const_cast<int*>(&batch[b * count + i]);
+			}
+			setContainsBatch(cset, &elements[0], static_cast<int>(count),
+					&found[0]);
+			sink = sink + (found[count - 1] != NULL);
+		}
+		times[sorted][1] = nsPerOp(start, batches * count);
+		start = Clock::now();
+		for (size_t b = 0; b < batches; b++) {
+			for (size_t i = 0; i < count; i++) {
+				sink = sink + *set.find(batch[b * count + i]);
+			}
+		}
+		times[sorted][2] = nsPerOp(start, batches * count);
+		start = Clock::now();
+		for (size_t b = 0; b < batches; b++) {
+			iterators.clear();
+			set.find_many(batch + b * count, batch + (b + 1) * count,
+					std::back_inserter(iterators));
+			sink = sink + *iterators.back();
+		}
+		times[sorted][3] = nsPerOp(start, batches * count);
+	}
+	setDestroy(cset);
+	cout << "batches of " << count << " lookups, " << n << " ints (ns/op)"
+			<< endl;
+	for (int sorted = 0; sorted < 2; sorted++) {
+		cout << (sorted ? "  sorted: " : "  random: ") << "setContains "
+				<< times[sorted][0] << ", setContainsBatch " << times[sorted][1]
+				<< ", find " << times[sorted][2] << ", find_many "
+				<< times[sorted][3] << endl;
+	}
+}
+
+/* Nanoseconds to build, search and destroy a set of size keys */
+template<class Set>
+static double runTinySets(std::vector<int> const& keys, size_t size)
+{
+	size_t sets = keys.size() / size;
+	Clock::time_point start = Clock::now();
+	for (size_t s = 0; s < sets; s++) {
+		Set set;
+		for (size_t i = 0; i < size; i++) {
+			set.insert(keys[s * size + i]);
+		}
+		for (size_t i = 0; i < size; i++) {
+			sink = sink + *set.find(keys[s * size + i]);
+		}
+	}
+	return nsPerOp(start, sets);
+}
+
+/* Compares sets of a few elements, kept inline by mtm::small_set */
+static void benchTinySets(std::vector<int> const& keys)
+{
+	cout << "tiny sets, build + find all + destroy (ns per set)" << endl;
+	for (size_t size = 1; size <= 16; size *= 2) {
+		cout << "  " << size << " ints: mtm::set "
+				<< runTinySets<mtm::set<int> >(keys, size)
+				<< ", std::set " << runTinySets<std::set<int> >(keys, size)
+				<< ", mtm::small_set<int, 8> "
+				<< runTinySets<mtm::small_set<int, 8> >(keys, size) << endl;
+	}
+}
+
+/* Allocator counting the bytes a container holds */
+template<class T>
+struct ByteCounter {
+	typedef T value_type;
+	size_t* bytes;
+	explicit ByteCounter(size_t* counter) :
+			bytes(counter)
+	{
+	}
+	template<class U>
+	ByteCounter(ByteCounter<U> const& other) :
+			bytes(other.bytes)
+	{
+	}
+	T* allocate(size_t n)
+	{
+		*bytes += n * sizeof(T);
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+	void deallocate(T* block, size_t n)
+	{
+		*bytes -= n * sizeof(T);
+		::operator delete(block);
+	}
+};
+template<class T, class U>
+static bool operator==(ByteCounter<T> const& left, ByteCounter<U> const& right)
+{
+	return left.bytes == right.bytes;
+}
+template<class T, class U>
+static bool operator!=(ByteCounter<T> const& left, ByteCounter<U> const& right)
+{
+	return !(left == right);
+}
+
+/* Nanoseconds to insert and to find all keys, and to unite and intersect */
+template<class Set>
+static void runIntegerSet(Set& set, Set& other, std::vector<int> const& keys,
+		double times[4])
+{
+	size_t n = keys.size();
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < n; i++) {
+		set.insert(keys[i]);
+		if (keys[i] % 3 == 0) {
+			other.insert(keys[i]);
+		}
+	}
+	times[0] = nsPerOp(start, n + n / 3);
+	start = Clock::now();
+	for (size_t i = 0; i < n; i++) {
+		sink = sink + *set.find(keys[i]);
+	}
+	times[1] = nsPerOp(start, n);
+	start = Clock::now();
+	sink = sink + (set | other).size();
+	times[2] = nsPerOp(start, n);
+	start = Clock::now();
+	sink = sink + (set & other).size();
+	times[3] = nsPerOp(start, n);
+}
+
+/* Dense integer IDs in mtm::set and in the compressed mtm::bitmap_set */
+static void benchBitmap(std::vector<int> const& keys)
+{
+	size_t treeBytes = 0;
+	typedef mtm::set<int, std::less<int>, ByteCounter<int> > counted_set;
+	ByteCounter<int> counter(&treeBytes);
+	counted_set tree(counter);
+	counted_set treeThirds(counter);
+	mtm::bitmap_set<int> bitmap;
+	mtm::bitmap_set<int> bitmapThirds;
+	double treeTimes[4];
+	double bitmapTimes[4];
+	runIntegerSet(tree, treeThirds, keys, treeTimes);
+	runIntegerSet(bitmap, bitmapThirds, keys, bitmapTimes);
+	size_t elements = keys.size() + keys.size() / 3;
+	cout << "dense ids, " << keys.size() << " ints and every third"
+			<< " (ns/op, ns per element for | and &)" << endl;
+	const char* names[4] = { "insert", "find", "|", "&" };
+	for (int i = 0; i < 4; i++) {
+		cout << "  " << names[i] << ": mtm::set " << treeTimes[i]
+				<< ", mtm::bitmap_set " << bitmapTimes[i] << endl;
+	}
+	size_t bitmapBytes = bitmap.memory_usage() + bitmapThirds.memory_usage();
+	bitmap.optimize();
+	bitmapThirds.optimize();
+	cout << "  bytes per element: mtm::set "
+			<< static_cast<double>(treeBytes) / elements
+			<< ", mtm::bitmap_set " << static_cast<double>(bitmapBytes) / elements
+			<< ", optimized "
+			<< static_cast<double>(bitmap.memory_usage()
+					+ bitmapThirds.memory_usage()) / elements << endl;
+}
+
+/* Nanoseconds of one timed call on an empty body */
+static double clockOverhead()
+{
+	Measurement measurement;
+	timeLoop(measurement, MAX_SAMPLES, true, 1, [](size_t) {
+	});
+	std::sort(measurement.samples.begin(), measurement.samples.end());
+	return percentile(measurement.samples, 0.5);
+}
+
+int main(int argc, char** argv)
+{
+	Format format = FORMAT_TEXT;
+	size_t minSize = 10;
+	size_t maxSize = 1000000;
+	int maxThreads = static_cast<int>(std::thread::hardware_concurrency());
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && strcmp(argv[i], "--format") == 0) {
+			const char* name = argv[++i];
+			format = strcmp(name, "csv") == 0 ? FORMAT_CSV
+					: strcmp(name, "json") == 0 ? FORMAT_JSON : FORMAT_TEXT;
+		} else if (i + 1 < argc && strcmp(argv[i], "--min-size") == 0) {
+			minSize = strtoul(argv[++i], NULL, 10);
+		} else if (i + 1 < argc && strcmp(argv[i], "--max-size") == 0) {
+			maxSize = strtoul(argv[++i], NULL, 10);
+		} else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) {
+			maxThreads = atoi(argv[++i]);
+		} else {
+			std::cerr << "usage: " << argv[0] << " [--format text|csv|json]"
+					" [--min-size n] [--max-size n] [--threads n]" << endl;
+			return 1;
+		}
+	}
+	if (minSize == 0 || maxSize < minSize) {
+		std::cerr << "error: sizes must satisfy 0 < min-size <= max-size"
+				<< endl;
+		return 1;
+	}
+	{
+		Report report(format, clockOverhead());
+		compareElements<int>(minSize, maxSize, report);
+		compareElements<std::string>(minSize, maxSize, report);
+		compareElements<Pod64>(minSize, maxSize, report);
+	}
+	if (format != FORMAT_TEXT) {
+		return 0;
+	}
+	cout << endl;
+	std::mt19937 random(2015);
+	std::vector<int> keys;
+	for (size_t i = 0; i < maxSize; i++) {
+		keys.push_back(static_cast<int>(i));
+	}
+	std::shuffle(keys.begin(), keys.end(), random);
+	benchComparator(keys);
+	benchCopy(keys);
+	benchFilter(keys);
+	benchBatch(keys);
+	benchSnapshot(keys);
+	benchTinySets(keys);
+	benchBitmap(keys);
+	benchParallelBuild(keys, maxThreads > 0 ? maxThreads : 1);
+	benchContention(static_cast<int>(maxSize), maxThreads > 0 ? maxThreads : 1);
+	return 0;
+}
@@ -6,11 +6,120 @@
  */
 
 #include "mtm_set.hpp"
+#include "mtm_bitmap_set.hpp"
+#include "mtm_flat_set.hpp"
+#include "mtm_small_set.hpp"
+#include "mtm_unordered_set.hpp"
+#include "mtm_concurrent_set.hpp"
+#include <algorithm>
 #include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <stdlib.h>
 using namespace mtm;
 using std::cout;
 using std::endl;
 
+/* When positive, the number of allocations until operator new fails */
+static int allocationsUntilFailure = 0;
+
+/* Inlined, the replacements look to GCC like new and free mixed up */
+#ifdef __GNUC__
+#define NOT_INLINED __attribute__((noinline))
+#else
+#define NOT_INLINED
+#endif
+
+NOT_INLINED void* operator new(size_t size)
+{
+	if (allocationsUntilFailure > 0 && --allocationsUntilFailure == 0) {
+		throw std::bad_alloc();
+	}
+	void* block = malloc(size > 0 ? size : 1);
+	if (block == NULL) {
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+NOT_INLINED void* operator new(size_t size, std::nothrow_t const&) noexcept
+{
+	return malloc(size > 0 ? size : 1);
+}
+
+NOT_INLINED void operator delete(void* block) noexcept
+{
+	free(block);
+}
+
+NOT_INLINED void operator delete(void* block, size_t) noexcept
+{
+	free(block);
+}
+
+/* Orders ints by their remainder, a comparator with state */
+struct RemainderLess {
+	int divisor;
+	bool operator()(int left, int right) const
+	{
+		return left % divisor < right % divisor;
+	}
+};
+
+/* Orders strings, and compares them with C strings without copying */
+struct StringLess {
+	typedef void is_transparent;
+	bool operator()(std::string const& left, std::string const& right) const
+	{
+		return left < right;
+	}
+	bool operator()(std::string const& left, const char* right) const
+	{
+		return left.compare(right) < 0;
+	}
+	bool operator()(const char* left, std::string const& right) const
+	{
+		return right.compare(left) > 0;
+	}
+};
+
+/* Allocates with new, keeping count of the units it has handed out */
+template<class T>
+struct CountingAllocator {
+	typedef T value_type;
+	long* outstanding;
+	explicit CountingAllocator(long* counter) :
+			outstanding(counter)
+	{
+	}
+	template<class U>
+	CountingAllocator(CountingAllocator<U> const& other) :
+			outstanding(other.outstanding)
+	{
+	}
+	T* allocate(size_t n)
+	{
+		*outstanding += (long)n;
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+	void deallocate(T* block, size_t n)
+	{
+		*outstanding -= (long)n;
+		::operator delete(block);
+	}
+};
+template<class T, class U>
+bool operator==(CountingAllocator<T> const& a, CountingAllocator<U> const& b)
+{
+	return a.outstanding == b.outstanding;
+}
+template<class T, class U>
+bool operator!=(CountingAllocator<T> const& a, CountingAllocator<U> const& b)
+{
+	return !(a == b);
+}
+
 int main()
 {
 	set<int> sett;
@@ -18,24 +127,296 @@ int main()
 	sett.insert(1);
 	cout << *sett.find(1) << " is in sett" << endl;
 	cout << *sett.find(2) << " is in sett" << endl;
+	if (sett.find(3) == sett.end() && !sett.contains(3)
+			&& sett.count(1) == 1) {
+		cout << "find of a missing element returns end()" << endl;
+	}
 	try {
-		cout << *sett.find(3) << endl;
+		sett.erase(3);
 	} catch (set<int>::ElementNotFound&) {
 		cout << "ElementNotFound exception works" << endl;
 	}
 	set<int> set2(sett);
-	try {
+	if (set2.find(2) != set2.end()) {
 		cout << *set2.find(2) << " is in set2" << endl;
-	} catch (set<int>::ElementNotFound&) {
+	} else {
 		cout << "error" << endl;
 	}
 	set2.erase(2);
-	try {
-		cout << *set2.find(2) << " is in set2" << endl;
-	} catch (set<int>::ElementNotFound&) {
+	if (set2.find(2) == set2.end()) {
 		cout << "erase works - 2 removed from set2" << endl;
 	}
 	set<int> set3;
 	set3 = set2;
+	try {
+		set3.erase(set2.begin()); // an element of set2, not of set3
+	} catch (set<int>::InvalidIterator&) {
+		cout << "InvalidIterator exception works" << endl;
+	}
+	set<std::string> strings;
+	std::string moved("moved");
+	strings.insert(std::move(moved));
+	strings.emplace(3, 'x');
+	if (!strings.insert(std::string("xxx")).second && strings.size() == 2) {
+		cout << "insert(T&&) and emplace work" << endl;
+	}
+	set<std::string> sharedStrings(strings);
+	set<std::string>::const_iterator xxx = sharedStrings.find("xxx");
+	// a duplicate leaves the shared elements, and the iterator, as they are
+	if (!sharedStrings.emplace(3, 'x').second
+			&& sharedStrings.find("xxx") == xxx
+			&& sharedStrings.emplace("new").second && sharedStrings.size() == 3
+			&& strings.size() == 2) {
+		cout << "emplace of a duplicate into a copy copies nothing" << endl;
+	}
+	int values[] = { 5, 3, 9, 3, 1 };
+	set<int> fromRange(values, values + 5);
+	if (fromRange.size() == 4 && *fromRange.begin() == 1) {
+		cout << "range constructor works" << endl;
+	}
+	int otherValues[] = { 1, 2, 3 };
+	set<int> other(otherValues, otherValues + 3);
+	if ((fromRange | other).size() == 5 && (fromRange & other).size() == 2
+			&& (fromRange - other).size() == 2 && (fromRange ^ other).size() == 3) {
+		cout << "set algebra works" << endl;
+	}
+	fromRange -= other;
+	if (fromRange.size() == 2 && *fromRange.begin() == 5) {
+		cout << "in-place set algebra works" << endl;
+	}
+	int rangeValues[] = { 10, 20, 30, 40 };
+	set<int> ordered(rangeValues, rangeValues + 4);
+	if (*ordered.lower_bound(20) == 20 && *ordered.upper_bound(20) == 30
+			&& ordered.lower_bound(41) == ordered.end()
+			&& ordered.equal_range(25).first == ordered.equal_range(25).second
+			&& ordered.rank(30) == 2 && *ordered.nth(3) == 40
+			&& ordered.nth(4) == ordered.end()
+			&& ordered.count_range(15, 40) == 2) {
+		cout << "range queries work" << endl;
+	}
+	set<int>::const_reverse_iterator last = ordered.rbegin();
+	set<int>::const_iterator beforeEnd = ordered.end();
+	--beforeEnd;
+	if (*last == 40 && *++last == 30 && *beforeEnd == 40
+			&& *--beforeEnd == 30 && std::distance(ordered.rbegin(),
+					ordered.rend()) == 4) {
+		cout << "reverse iteration works" << endl;
+	}
+	std::vector<int> dump;
+	for (int i = 0; i < 100000; i++) {
+		dump.push_back(i * 7919 % 60000); // every value 0..59999, some twice
+	}
+	set<int> builtSerially(dump.begin(), dump.end());
+	set<int> builtInParallel(parallel(4), dump.begin(), dump.end());
+	set<int> extended(ordered);
+	extended.insert(parallel(), dump.rbegin(), dump.rend());
+	if (builtInParallel.size() == 60000 && std::equal(builtInParallel.begin(),
+			builtInParallel.end(), builtSerially.begin())
+			&& *builtInParallel.nth(30000) == 30000
+			&& extended.size() == 60000 && extended.contains(40)) {
+		cout << "parallel build works" << endl;
+	}
+	ordered.save("set_test.snapshot");
+	set<int> restored(values, values + 5);
+	restored.load("set_test.snapshot");
+	remove("set_test.snapshot");
+	bool rejected = false;
+	try {
+		restored.load("set_test.snapshot");
+	} catch (set<int>::SnapshotError&) {
+		rejected = true;
+	}
+	if (rejected && restored.size() == 4 && *restored.begin() == 10
+			&& *restored.rbegin() == 40) {
+		cout << "snapshots work" << endl;
+	}
+	flat_set<int> flat(values, values + 5);
+	flat.insert(4);
+	flat.erase(9);
+	if (flat.size() == 4 && *flat.find(4) == 4 && *flat.begin() == 1
+			&& flat.find(9) == flat.end() && flat.count(4) == 1) {
+		cout << "flat_set works" << endl;
+	}
+	RemainderLess byFour = { 4 };
+	flat_set<int, RemainderLess> flatRemainders(values, values + 5, byFour);
+	if (flatRemainders.size() == 2 && *flatRemainders.begin() == 5
+			&& flatRemainders.contains(13) && !flatRemainders.insert(7).second) {
+		cout << "flat_set stateful comparator works" << endl;
+	}
+	set<int> snapshot(fromRange);
+	fromRange.insert(7);
+	if (snapshot.size() == 2 && fromRange.size() == 3) {
+		cout << "copies are independent" << endl;
+	}
+	small_set<int, 4> tiny(values, values + 5);
+	bool stayedSmall = tiny.is_small() && tiny.size() == 4;
+	tiny.insert(7);
+	tiny.erase(3);
+	small_set<int, 4> tinyCopy(tiny);
+	tinyCopy.clear();
+	if (stayedSmall && !tiny.is_small() && tiny.size() == 4
+			&& *tiny.begin() == 1 && *--tiny.end() == 9
+			&& tinyCopy.is_small() && tinyCopy.size() == 0
+			&& tiny.find(3) == tiny.end() && tiny.contains(7)) {
+		cout << "small_set works" << endl;
+	}
+	small_set<int, 2, RemainderLess> tinyRemainders(values, values + 5,
+			byFour);
+	bool smallByRemainder = tinyRemainders.is_small()
+			&& tinyRemainders.contains(13);
+	tinyRemainders.insert(6); // spills, keeping the comparator
+	if (smallByRemainder && !tinyRemainders.is_small()
+			&& tinyRemainders.size() == 3 && tinyRemainders.contains(13)
+			&& !tinyRemainders.insert(10).second) {
+		cout << "small_set stateful comparator works" << endl;
+	}
+	// fail each allocation of an insert that spills in turn, until it succeeds
+	bool spillKeepsBuffer = true;
+	for (int failAt = 1; spillKeepsBuffer; failAt++) {
+		small_set<int, 4> full(values, values + 5);
+		allocationsUntilFailure = failAt;
+		try {
+			full.insert(7);
+			allocationsUntilFailure = 0;
+			break;
+		} catch (small_set<int, 4>::Exception&) {
+			allocationsUntilFailure = 0;
+			spillKeepsBuffer = full.size() == 4 && full.contains(1)
+					&& full.contains(9) && !full.contains(7);
+		}
+	}
+	if (spillKeepsBuffer) {
+		cout << "small_set spill failure keeps the buffer" << endl;
+	}
+	bitmap_set<int> ids(values, values + 5);
+	ids.insert(-7);
+	ids.insert(70000);
+	ids.erase(9);
+	bitmap_set<int> dense;
+	for (int i = 0; i < 10000; i++) {
+		dense.insert(i);
+	}
+	dense.optimize();
+	bitmap_set<int> common = ids & dense;
+	if (ids.size() == 5 && *ids.begin() == -7 && *--ids.end() == 70000
+			&& *ids.find(5) == 5 && ids.find(9) == ids.end()
+			&& ids.contains(70000) && common.size() == 3
+			&& *common.begin() == 1 && (ids | dense).size() == 10002
+			&& dense.memory_usage() < 1000) {
+		cout << "bitmap_set works" << endl;
+	}
+	set<std::string, StringLess> words;
+	words.insert("apple");
+	words.insert("cherry");
+	words.erase("apple");
+	if (words.contains("cherry") && words.count("apple") == 0
+			&& *words.find("cherry") == "cherry"
+			&& *words.lower_bound("banana") == "cherry"
+			&& words.count(std::string("cherry")) == 1) {
+		cout << "transparent lookup works" << endl;
+	}
+	RemainderLess byRemainder = { 10 };
+	set<int, RemainderLess> remainders(byRemainder);
+	remainders.insert(13);
+	set<int, RemainderLess> remaindersCopy(remainders);
+	if (!remaindersCopy.insert(3).second && remaindersCopy.insert(4).second
+			&& remainders.size() == 1) {
+		cout << "stateful comparator works" << endl;
+	}
+	set<int> counted(values, values + 5);
+	counted.reset_stats();
+	counted.find(9);
+	counted.insert(2);
+	SetStats stats = counted.stats();
+#ifdef SET_ENABLE_STATS
+	bool countersWork = stats.comparisons > 0 && stats.nodesVisited > 0
+			&& stats.elementCopies == 1 && stats.elementFrees == 0;
+#else
+	bool countersWork = stats.comparisons == 0 && stats.elementCopies == 0;
+#endif
+	if (countersWork) {
+		cout << "operation counters work" << endl;
+	}
+	int probes[] = { 9, 2, 5, 4 };
+	std::vector<set<int>::const_iterator> probed;
+	fromRange.find_many(probes, probes + 4, std::back_inserter(probed));
+	if (probed.size() == 4 && *probed[0] == 9 && probed[1] == fromRange.end()
+			&& *probed[2] == 5 && probed[3] == fromRange.end()) {
+		cout << "find_many works" << endl;
+	}
+	set<int> filtered(values, values + 5);
+	filtered.enable_filter(0.01);
+	filtered.insert(4);
+	filtered.erase(9);
+	set<int> filteredCopy(filtered);
+	int misses = 0;
+	for (int i = 100; i < 200; i++) {
+		misses += filteredCopy.find(i) == filteredCopy.end();
+	}
+	if (misses == 100 && *filteredCopy.find(4) == 4 && filtered.size() == 4
+			&& (filtered | filteredCopy).size() == 4) {
+		cout << "filter works" << endl;
+	}
+	long outstanding = 0;
+	{
+		typedef set<std::string, std::less<std::string>,
+				CountingAllocator<std::string> > counting_set;
+		counting_set allocated((CountingAllocator<std::string>(&outstanding)));
+		allocated.insert("one");
+		allocated.insert("two");
+		counting_set allocatedCopy(allocated);
+		allocatedCopy.insert("three");
+		if (outstanding > 0 && allocatedCopy.size() == 3
+				&& allocated.get_allocator().outstanding == &outstanding) {
+			cout << "allocators work" << endl;
+		}
+	}
+	if (outstanding != 0) {
+		cout << "allocator leaked " << outstanding << " units" << endl;
+	}
+#ifdef MTM_SET_HAS_PMR
+	char arena[4096];
+	std::pmr::monotonic_buffer_resource resource(arena, sizeof(arena));
+	pmr::set<int> fromArena(&resource);
+	fromArena.insert(values, values + 5);
+	if (fromArena.size() == 4 && *fromArena.begin() == 1) {
+		cout << "pmr set works" << endl;
+	}
+	pmr::set<int> global;
+	pmr::set<int> movedToGlobal;
+	{
+		char scratch[4096];
+		std::pmr::monotonic_buffer_resource request(scratch, sizeof(scratch));
+		pmr::set<int> requestScoped(values, values + 5, std::less<int>(),
+				&request);
+		global = requestScoped;
+		movedToGlobal = std::move(requestScoped);
+	}
+	global.insert(6);
+	movedToGlobal.insert(6);
+	if (global.size() == 5 && movedToGlobal.size() == 5
+			&& global.get_allocator().resource()
+					== std::pmr::get_default_resource()
+			&& std::equal(global.begin(), global.end(),
+					movedToGlobal.begin())) {
+		cout << "pmr assignment keeps the allocator" << endl;
+	}
+#endif
+	unordered_set<std::string> hashed;
+	hashed.insert("one");
+	hashed.insert("two");
+	hashed.erase("one");
+	if (!hashed.insert("two").second && *hashed.find("two") == "two"
+			&& hashed.find("one") == hashed.end() && hashed.count("two") == 1
+			&& hashed.size() == 1) {
+		cout << "unordered_set works" << endl;
+	}
+	concurrent_set<int> shared;
+	shared.insert(2);
+	shared.insert(1);
+	if (!shared.insert(2) && shared.erase(1) && !shared.contains(1)
+			&& shared.contains(2) && shared.size() == 1) {
+		cout << "concurrent_set works" << endl;
+	}
 	return 0;
 }